@@ -0,0 +1,112 @@
+#include "AdaptiveFeatures.hpp"
+
+#include <algorithm>
+#include <string>
+#include "Metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+double adaptiveScale(Size imageSize, const AdaptiveParams &params) {
+    int longSide = max(imageSize.width, imageSize.height);
+    int shortSide = min(imageSize.width, imageSize.height);
+    if (params.maxSide <= 0 || longSide <= params.maxSide) return 1.0;
+
+    double scale = (double)params.maxSide / longSide;
+    // No reducir tanto que la señal más pequeña esperada pierda sus keypoints
+    double smallestSign = params.minSignFraction * shortSide;
+    if (smallestSign > 0) scale = max(scale, params.minSignPixels / smallestSign);
+    return min(scale, 1.0);
+}
+
+vector<int> selectKeypoints(const vector<KeyPoint> &keypoints, Size imageSize, const AdaptiveParams &params) {
+    int n = (int)keypoints.size();
+    vector<int> selected;
+    if (params.keypointBudget <= 0 || n <= params.keypointBudget) {
+        selected.resize(n);
+        for (int i = 0; i < n; i++) selected[i] = i;
+        return selected;
+    }
+
+    int cols = max(1, params.gridCols), rows = max(1, params.gridRows);
+    vector<vector<int>> cells(cols * rows);
+    for (int i = 0; i < n; i++) {
+        int cx = min(cols - 1, max(0, (int)(keypoints[i].pt.x * cols / imageSize.width)));
+        int cy = min(rows - 1, max(0, (int)(keypoints[i].pt.y * rows / imageSize.height)));
+        cells[cy * cols + cx].push_back(i);
+    }
+
+    auto byResponse = [&keypoints](int a, int b) {
+        if (keypoints[a].response != keypoints[b].response) return keypoints[a].response > keypoints[b].response;
+        return a < b;
+    };
+
+    // Cuota por celda; lo que una celda no usa queda para los mejores del resto
+    int quota = max(1, params.keypointBudget / (cols * rows));
+    vector<int> leftovers;
+    for (auto &cell : cells) {
+        sort(cell.begin(), cell.end(), byResponse);
+        int take = min((int)cell.size(), quota);
+        selected.insert(selected.end(), cell.begin(), cell.begin() + take);
+        leftovers.insert(leftovers.end(), cell.begin() + take, cell.end());
+    }
+    if ((int)selected.size() > params.keypointBudget) {
+        sort(selected.begin(), selected.end(), byResponse);
+        selected.resize(params.keypointBudget);
+    } else {
+        int missing = min((int)leftovers.size(), params.keypointBudget - (int)selected.size());
+        partial_sort(leftovers.begin(), leftovers.begin() + missing, leftovers.end(), byResponse);
+        selected.insert(selected.end(), leftovers.begin(), leftovers.begin() + missing);
+    }
+    sort(selected.begin(), selected.end());
+    return selected;
+}
+
+double extractAdaptive(Feature2D &extractor, const Mat &image, const AdaptiveParams &params,
+                       vector<KeyPoint> &keypoints, Mat &descriptors, const Mat &mask) {
+    ScopedTimer timer(METRIC_FEATURES);
+    double scale = adaptiveScale(image.size(), params);
+    Mat work = image, workMask = mask;
+    if (scale < 1.0) {
+        resize(image, work, Size(), scale, scale, INTER_AREA);
+        if (!mask.empty()) resize(mask, workMask, work.size(), 0, 0, INTER_NEAREST);
+    }
+
+    vector<KeyPoint> found;
+    Mat foundDes;
+    extractor.detectAndCompute(work, workMask, found, foundDes); // máscara vacía: toda la imagen
+
+    vector<int> keep = selectKeypoints(found, work.size(), params);
+    keypoints.clear();
+    keypoints.reserve(keep.size());
+    if (keep.size() == found.size()) {
+        keypoints = found;
+        descriptors = foundDes;
+    } else {
+        descriptors.create((int)keep.size(), foundDes.cols, foundDes.type());
+        for (size_t k = 0; k < keep.size(); k++) {
+            keypoints.push_back(found[keep[k]]);
+            foundDes.row(keep[k]).copyTo(descriptors.row((int)k));
+        }
+    }
+
+    // De vuelta a coordenadas de la imagen original
+    if (scale < 1.0) {
+        for (auto &kp : keypoints) {
+            kp.pt.x = (float)(kp.pt.x / scale);
+            kp.pt.y = (float)(kp.pt.y / scale);
+            kp.size = (float)(kp.size / scale);
+        }
+    }
+    addCounter(COUNTER_KEYPOINTS, keypoints.size());
+    return scale;
+}
+
+AdaptiveParams parseAdaptiveArgs(int argc, char *argv[], AdaptiveParams params) {
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--max-side") params.maxSide = max(0, atoi(argv[++i]));
+        else if (arg == "--budget") params.keypointBudget = max(0, atoi(argv[++i]));
+    }
+    return params;
+}
@@ -0,0 +1,44 @@
+#ifndef ADAPTIVE_FEATURES_HPP
+#define ADAPTIVE_FEATURES_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Extracción de características sobre las imágenes de consulta con costo acotado:
+//
+//  1. Resolución de trabajo: la imagen se reduce para que su lado mayor no pase
+//     de maxSide, pero nunca tanto que la señal más pequeña esperada (una
+//     fracción minSignFraction del lado menor) quede por debajo de minSignPixels.
+//  2. Presupuesto de keypoints: si el extractor entrega más de keypointBudget,
+//     se reparten entre una rejilla de gridCols x gridRows celdas (los de mayor
+//     respuesta de cada celda) y el resto del presupuesto se llena con los
+//     mejores que queden. Así no se concentran todos en una zona con textura.
+//  3. Los keypoints se devuelven en coordenadas de la imagen original.
+//
+// Con maxSide = 0 y keypointBudget = 0 equivale a detectAndCompute directo.
+struct AdaptiveParams {
+    int maxSide = 1280;
+    double minSignFraction = 0.03;
+    int minSignPixels = 32;
+    int keypointBudget = 2000;
+    int gridCols = 8;
+    int gridRows = 6;
+};
+
+// Escala (<= 1) a la que se procesa una imagen de ese tamaño
+double adaptiveScale(cv::Size imageSize, const AdaptiveParams &params);
+
+// Índices de los keypoints que entran en el presupuesto, en su orden original
+std::vector<int> selectKeypoints(const std::vector<cv::KeyPoint> &keypoints, cv::Size imageSize,
+                                 const AdaptiveParams &params);
+
+// detectAndCompute a la escala de trabajo, con presupuesto y keypoints en coordenadas originales.
+// La máscara opcional (CV_8U, tamaño de la imagen) limita dónde se buscan keypoints.
+// Devuelve la escala usada.
+double extractAdaptive(cv::Feature2D &extractor, const cv::Mat &image, const AdaptiveParams &params,
+                       std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors, const cv::Mat &mask = cv::Mat());
+
+// Lee "--max-side N" y "--budget N" de la línea de comandos
+AdaptiveParams parseAdaptiveArgs(int argc, char *argv[], AdaptiveParams params = AdaptiveParams());
+
+#endif
@@ -0,0 +1,245 @@
+#include "AnnotationIndex.hpp"
+
+#include <tinyxml2.h>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "DatasetLoader.hpp"
+#include "Parallel.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace tinyxml2;
+namespace fs = std::filesystem;
+
+// offset + count * itemSize <= limit, sin desbordar
+static bool fitsIn(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit) {
+    if (offset > limit) return false;
+    return count <= (limit - offset) / itemSize;
+}
+
+// Si falla, el índice queda vacío y compileAnnotations vuelve a parsear todos los XML
+bool AnnotationIndex::load(const string &path) {
+    entries.clear();
+    byPath.clear();
+
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) return false;
+    vector<char> file((size_t)in.tellg());
+    in.seekg(0);
+    if (!in.read(file.data(), file.size()) || file.size() < sizeof(AnnHeader)) {
+        cerr << "[ERROR] Índice de anotaciones inválido: " << path << endl;
+        return false;
+    }
+
+    AnnHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    if (memcmp(h.magic, ANN_MAGIC, sizeof(ANN_MAGIC)) != 0 || h.version != ANN_VERSION) {
+        cerr << "[ERROR] " << path << " no es un índice de anotaciones compatible." << endl;
+        return false;
+    }
+    if (h.fileSize != file.size() || !fitsIn(h.imagesOffset, h.numImages, sizeof(AnnImage), file.size()) ||
+        !fitsIn(h.objectsOffset, h.numObjects, sizeof(AnnObject), file.size()) ||
+        !fitsIn(h.stringsOffset, h.stringsSize, 1, file.size())) {
+        cerr << "[ERROR] Índice de anotaciones truncado: " << path << endl;
+        return false;
+    }
+
+    const AnnImage *images = (const AnnImage *)(file.data() + h.imagesOffset);
+    const AnnObject *objects = (const AnnObject *)(file.data() + h.objectsOffset);
+    const char *strings = file.data() + h.stringsOffset;
+
+    entries.reserve(h.numImages);
+    for (uint64_t i = 0; i < h.numImages; i++) {
+        const AnnImage &src = images[i];
+        bool valid = fitsIn(src.firstObject, src.objectCount, 1, h.numObjects) &&
+                     fitsIn(src.pathOffset, src.pathLength, 1, h.stringsSize);
+        for (uint32_t k = 0; valid && k < src.objectCount; k++) {
+            const AnnObject &o = objects[src.firstObject + k];
+            valid = fitsIn(o.nameOffset, o.nameLength, 1, h.stringsSize);
+        }
+        if (!valid) {
+            cerr << "[ERROR] Índice de anotaciones corrupto: " << path << endl;
+            entries.clear();
+            byPath.clear();
+            return false;
+        }
+        AnnotatedImage image;
+        image.imagePath.assign(strings + src.pathOffset, src.pathLength);
+        image.xml.size = src.xmlSize;
+        image.xml.mtime = src.xmlMtime;
+        image.xml.hash = src.xmlHash;
+        image.valid = src.valid != 0;
+        for (uint32_t k = 0; k < src.objectCount; k++) {
+            const AnnObject &o = objects[src.firstObject + k];
+            image.objects.push_back({string(strings + o.nameOffset, o.nameLength),
+                                     Rect(o.box[0], o.box[1], o.box[2], o.box[3])});
+        }
+        add(image);
+    }
+    return true;
+}
+
+bool AnnotationIndex::save(const string &path) const {
+    vector<AnnImage> images;
+    vector<AnnObject> objects;
+    string strings;
+    for (const auto &image : entries) {
+        AnnImage dst;
+        memset(&dst, 0, sizeof(dst));
+        dst.xmlSize = image.xml.size;
+        dst.xmlMtime = image.xml.mtime;
+        dst.xmlHash = image.xml.hash;
+        dst.valid = image.valid;
+        dst.firstObject = objects.size();
+        dst.objectCount = (uint32_t)image.objects.size();
+        dst.pathOffset = strings.size();
+        dst.pathLength = (uint32_t)image.imagePath.size();
+        strings += image.imagePath;
+        for (const auto &o : image.objects) {
+            AnnObject obj;
+            memset(&obj, 0, sizeof(obj));
+            obj.box[0] = o.box.x;
+            obj.box[1] = o.box.y;
+            obj.box[2] = o.box.width;
+            obj.box[3] = o.box.height;
+            obj.nameOffset = strings.size();
+            obj.nameLength = (uint32_t)o.name.size();
+            strings += o.name;
+            objects.push_back(obj);
+        }
+        images.push_back(dst);
+    }
+
+    AnnHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ANN_MAGIC, sizeof(h.magic));
+    h.version = ANN_VERSION;
+    h.numImages = images.size();
+    h.numObjects = objects.size();
+    h.imagesOffset = sizeof(AnnHeader);
+    h.objectsOffset = h.imagesOffset + images.size() * sizeof(AnnImage);
+    h.stringsOffset = h.objectsOffset + objects.size() * sizeof(AnnObject);
+    h.stringsSize = strings.size();
+    h.fileSize = h.stringsOffset + h.stringsSize;
+
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)images.data(), images.size() * sizeof(AnnImage));
+    out.write((const char *)objects.data(), objects.size() * sizeof(AnnObject));
+    out.write(strings.data(), strings.size());
+    out.close();
+
+    if (!out) {
+        cerr << "[ERROR] Falló la escritura de " << tmpPath << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo renombrar " << tmpPath << " a " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+const AnnotatedImage *AnnotationIndex::find(const string &imagePath) const {
+    auto it = byPath.find(imagePath);
+    return it == byPath.end() ? nullptr : &entries[it->second];
+}
+
+void AnnotationIndex::add(const AnnotatedImage &image) {
+    auto it = byPath.find(image.imagePath);
+    if (it != byPath.end()) {
+        entries[it->second] = image;
+        return;
+    }
+    byPath[image.imagePath] = entries.size();
+    entries.push_back(image);
+}
+
+size_t AnnotationIndex::objectCount() const {
+    size_t n = 0;
+    for (const auto &image : entries) n += image.objects.size();
+    return n;
+}
+
+bool parseVOCAnnotation(const string &xmlPath, vector<AnnotatedObject> &objects) {
+    objects.clear();
+    XMLDocument doc;
+    if (doc.LoadFile(xmlPath.c_str()) != XML_SUCCESS) return false;
+
+    XMLElement *annotation = doc.FirstChildElement("annotation");
+    if (!annotation) return true;
+
+    for (XMLElement *object = annotation->FirstChildElement("object"); object;
+         object = object->NextSiblingElement("object")) {
+        XMLElement *bndbox = object->FirstChildElement("bndbox");
+        if (!bndbox) continue;
+
+        int xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+        XMLElement *e;
+        if ((e = bndbox->FirstChildElement("xmin"))) e->QueryIntText(&xmin);
+        if ((e = bndbox->FirstChildElement("ymin"))) e->QueryIntText(&ymin);
+        if ((e = bndbox->FirstChildElement("xmax"))) e->QueryIntText(&xmax);
+        if ((e = bndbox->FirstChildElement("ymax"))) e->QueryIntText(&ymax);
+
+        XMLElement *name = object->FirstChildElement("name");
+        objects.push_back({name && name->GetText() ? name->GetText() : "", Rect(xmin, ymin, xmax - xmin, ymax - ymin)});
+    }
+    return true;
+}
+
+string annotationIndexPathFor(const string &folder) {
+    string base = folder;
+    while (base.size() > 1 && base.back() == '/') base.pop_back();
+    return base + ".annidx";
+}
+
+AnnotationIndex compileAnnotations(const string &folder, unsigned jobs) {
+    string indexPath = annotationIndexPathFor(folder);
+    AnnotationIndex previous;
+    previous.load(indexPath);
+
+    vector<string> images;
+    for (const auto &imagePath : listDatasetImages(folder)) {
+        if (fs::exists(fs::path(imagePath).replace_extension(".xml"))) images.push_back(imagePath);
+    }
+
+    // Solo se parsean los XML cuyo tamaño y fecha (o contenido) cambiaron
+    vector<AnnotatedImage> current(images.size());
+    vector<char> parsed(images.size(), 0);
+    parallelFor(images.size(), jobs, [&](size_t i) {
+        string xmlPath = fs::path(images[i]).replace_extension(".xml").string();
+        const AnnotatedImage *prev = previous.find(images[i]);
+        current[i].imagePath = images[i];
+        if (prev && fileUnchanged(xmlPath, &prev->xml, current[i].xml)) {
+            current[i].valid = prev->valid;
+            current[i].objects = prev->objects;
+            return;
+        }
+        if (!prev) fileUnchanged(xmlPath, nullptr, current[i].xml);
+        current[i].valid = parseVOCAnnotation(xmlPath, current[i].objects);
+        parsed[i] = 1;
+    });
+
+    AnnotationIndex index;
+    size_t changed = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        index.add(current[i]);
+        changed += parsed[i];
+    }
+    // También cuenta como cambio que desaparezca una imagen
+    if (changed > 0 || index.size() != previous.size()) {
+        index.save(indexPath);
+        cout << "[INFO] Índice de anotaciones " << indexPath << ": " << changed << " XML parseados, "
+             << index.size() - changed << " reutilizados." << endl;
+    }
+    return index;
+}
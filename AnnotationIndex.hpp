@@ -0,0 +1,97 @@
+#ifndef ANNOTATION_INDEX_HPP
+#define ANNOTATION_INDEX_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Manifest.hpp"
+
+// Índice compilado de las anotaciones VOC de una carpeta del dataset.
+//
+// En vez de abrir y parsear un XML por imagen en cada ejecución, las
+// anotaciones se guardan en una tabla binaria (<carpeta>.annidx) con la ruta de
+// cada imagen, el sello de su XML (tamaño, fecha y hash, como en el manifiesto)
+// y todos sus objetos <object> (clase y rectángulo). Al abrir una carpeta solo
+// se vuelven a parsear los XML cuyo sello cambió.
+//
+// Estructura del archivo (little-endian):
+//   AnnHeader
+//   AnnImage[numImages]
+//   AnnObject[numObjects]     objetos de todas las imágenes, en orden
+//   cadenas                   rutas y nombres de clase, sin terminador
+
+static const char ANN_MAGIC[4] = {'V', 'A', 'N', 'N'};
+static const uint32_t ANN_VERSION = 1;
+
+#pragma pack(push, 1)
+struct AnnHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t numImages;
+    uint64_t numObjects;
+    uint64_t imagesOffset;
+    uint64_t objectsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fileSize;
+};
+
+struct AnnImage {
+    uint64_t xmlSize;
+    int64_t xmlMtime;
+    uint64_t xmlHash;
+    int32_t valid;              // 0 si el XML no se pudo leer
+    uint64_t firstObject;
+    uint32_t objectCount;
+    uint64_t pathOffset;
+    uint32_t pathLength;
+};
+
+struct AnnObject {
+    int32_t box[4];             // x, y, width, height (tal como vienen en el XML)
+    uint64_t nameOffset;
+    uint32_t nameLength;
+};
+#pragma pack(pop)
+
+struct AnnotatedObject {
+    std::string name;
+    cv::Rect box;
+};
+
+struct AnnotatedImage {
+    std::string imagePath;
+    FileStamp xml;
+    bool valid = false;
+    std::vector<AnnotatedObject> objects;
+};
+
+class AnnotationIndex {
+public:
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    const AnnotatedImage *find(const std::string &imagePath) const;
+    void add(const AnnotatedImage &image);
+    const std::vector<AnnotatedImage> &images() const { return entries; }
+    size_t size() const { return entries.size(); }
+    size_t objectCount() const;
+
+private:
+    std::vector<AnnotatedImage> entries;
+    std::unordered_map<std::string, size_t> byPath;
+};
+
+// Todos los <object> con <bndbox> del XML (false si no se pudo leer)
+bool parseVOCAnnotation(const std::string &xmlPath, std::vector<AnnotatedObject> &objects);
+
+std::string annotationIndexPathFor(const std::string &folder);
+
+// Anotaciones de las imágenes de la carpeta que tienen XML: carga el índice
+// compilado, vuelve a parsear (con "jobs" hilos) solo los XML nuevos o
+// modificados y, si hubo cambios, guarda el índice actualizado.
+AnnotationIndex compileAnnotations(const std::string &folder, unsigned jobs);
+
+#endif
@@ -0,0 +1,529 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/xfeatures2d.hpp>
+#include <opencv2/ml.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include "AdaptiveFeatures.hpp"
+#include "AnnotationIndex.hpp"
+#include "Cascade.hpp"
+#include "DescriptorCodec.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "GlobalIndex.hpp"
+#include "HomographyDetector.hpp"
+#include "Metrics.hpp"
+#include "Parallel.hpp"
+#include "lbp server/SignDetector.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::xfeatures2d;
+namespace fs = std::filesystem;
+
+// Benchmark de precisión y latencia de los tres detectores contra las
+// anotaciones VOC de test/:
+//   flann      -> SIFT + índice FLANN global + ROI de los matches (Test2.cpp)
+//   homography -> SIFT + dos vecinos por ROI (RatioMatcher) + homografía (Test3.cpp)
+// Los dos primeros usan el extractor registrado en su base de descriptores; si
+// no es SIFT se agrega al nombre del pipeline (p. ej. "flann-orb").
+//   lbp        -> segmentación HSV + LBP + SVM (lbp server/validacion.cpp)
+//   cascade    -> lbp propone candidatos y homography verifica solo dentro de ellos
+//                 (Cascade.hpp); usa la base de homography
+//
+// Una detección es correcta si su IoU con una anotación todavía libre supera
+// el umbral (0.5 por defecto). Se reportan precisión, recall, IoU medio de los
+// aciertos y percentiles de latencia por etapa.
+
+// Objeto anotado en el XML de una imagen de test
+struct GroundTruth {
+    Rect box;
+    int label; // 1: 30 km/h, 2: 50 km/h, 0: otra clase
+};
+
+// Detección de un pipeline (label = 0 si el pipeline no clasifica)
+struct BenchDetection {
+    Rect box;
+    int label;
+};
+
+// Etapas medidas en cada imagen (ms)
+enum Stage { DECODE, FEATURES, MATCHING, VERIFICATION, TOTAL, STAGE_COUNT };
+static const char *STAGE_NAMES[STAGE_COUNT] = {"decode", "features", "matching", "verification", "total"};
+
+struct ImageRun {
+    bool ok = false;
+    vector<BenchDetection> detections;
+    double stageMs[STAGE_COUNT] = {0, 0, 0, 0, 0};
+};
+
+struct Pipeline {
+    string name;
+    function<ImageRun(const string &)> run;
+};
+
+// Resultado acumulado de un pipeline
+struct PipelineSummary {
+    string name;
+    size_t images = 0;
+    size_t failed = 0;
+    size_t truePositives = 0;
+    size_t falsePositives = 0;
+    size_t falseNegatives = 0;
+    size_t labeled = 0;         // aciertos con clase predicha
+    size_t labelCorrect = 0;    // aciertos con la clase correcta
+    double iouSum = 0;
+    vector<double> stageMs[STAGE_COUNT];
+};
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+static int labelFromName(const string &name) {
+    if (name == "Speed limit 30") return 1;
+    if (name == "Speed limit 50") return 2;
+    return 0;
+}
+
+// Anotaciones de la imagen tal como quedaron en el índice compilado
+vector<GroundTruth> groundTruthFor(const AnnotatedImage &image) {
+    vector<GroundTruth> objects;
+    for (const auto &o : image.objects) objects.push_back({o.box, labelFromName(o.name)});
+    return objects;
+}
+
+static double iou(const Rect &a, const Rect &b) {
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0;
+}
+
+// Empareja detecciones y anotaciones de forma voraz (cada anotación se usa una sola vez)
+void evaluateImage(const ImageRun &run, const vector<GroundTruth> &truth, double iouThresh,
+                   PipelineSummary &summary) {
+    vector<bool> used(truth.size(), false);
+    for (const auto &det : run.detections) {
+        int best = -1;
+        double bestIoU = iouThresh;
+        for (size_t g = 0; g < truth.size(); g++) {
+            if (used[g]) continue;
+            double v = iou(det.box, truth[g].box);
+            if (v >= bestIoU) {
+                bestIoU = v;
+                best = (int)g;
+            }
+        }
+        if (best < 0) {
+            summary.falsePositives++;
+            continue;
+        }
+        used[best] = true;
+        summary.truePositives++;
+        summary.iouSum += bestIoU;
+        if (det.label != 0) {
+            summary.labeled++;
+            if (det.label == truth[best].label) summary.labelCorrect++;
+        }
+    }
+    for (bool u : used) {
+        if (!u) summary.falseNegatives++;
+    }
+}
+
+static double percentile(vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    sort(values.begin(), values.end());
+    size_t rank = (size_t)ceil(p / 100.0 * values.size());
+    return values[rank == 0 ? 0 : rank - 1];
+}
+
+//----------------------------------------------------------
+// Pipelines
+//----------------------------------------------------------
+
+// Nombre del pipeline con el extractor de la base cuando no es el de referencia
+static string pipelineName(const string &base, FeatureBackend backend) {
+    return backend == FEATURE_SIFT ? base : base + "-" + featureBackendName(backend);
+}
+
+// Características + índice global: misma lógica que processTestImage de Test2.cpp
+Pipeline makeFlannPipeline(const GlobalIndex &index, FeatureBackend backend, const DescriptorCodec &codec,
+                           const AdaptiveParams &adaptive) {
+    return {pipelineName("flann", backend), [&index, backend, &codec, adaptive](const string &imagePath) {
+        thread_local Ptr<Feature2D> extractor = createFeatureExtractor(backend);
+        ImageRun r;
+        int64 start = getTickCount();
+
+        Mat img = imread(imagePath, IMREAD_GRAYSCALE);
+        r.stageMs[DECODE] = msSince(start);
+        if (img.empty()) return r;
+
+        int64 t = getTickCount();
+        vector<KeyPoint> keypoints;
+        Mat descriptors;
+        extractAdaptive(*extractor, img, adaptive, keypoints, descriptors);
+        codec.encode(descriptors, descriptors);
+        r.stageMs[FEATURES] = msSince(t);
+        r.ok = true;
+        if (descriptors.empty()) {
+            r.stageMs[TOTAL] = msSince(start);
+            return r;
+        }
+
+        t = getTickCount();
+        vector<DMatch> matches;
+        index.match(descriptors, 0.75f, matches);
+        r.stageMs[MATCHING] = msSince(t);
+
+        t = getTickCount();
+        vector<int> votes = index.votesPerImage(matches);
+        int best = -1, maxVotes = 0;
+        for (size_t i = 0; i < votes.size(); i++) {
+            if (votes[i] > maxVotes) {
+                maxVotes = votes[i];
+                best = (int)i;
+            }
+        }
+        vector<Point2f> points;
+        for (const auto &m : matches) {
+            if (m.imgIdx == best) points.push_back(keypoints[m.queryIdx].pt);
+        }
+        if (!points.empty()) {
+            Rect roi = boundingRect(points);
+            if (roi.area() > 0) r.detections.push_back({roi, 0});
+        }
+        r.stageMs[VERIFICATION] = msSince(t);
+        r.stageMs[TOTAL] = msSince(start);
+        return r;
+    }};
+}
+
+// Características + homografía por ROI (Test3.cpp); la detección es el rectángulo que encierra las esquinas
+Pipeline makeHomographyPipeline(const vector<TrainROI> &trainROIs, const DetectorParams &params,
+                                FeatureBackend backend, const DescriptorCodec &codec, const AdaptiveParams &adaptive) {
+    return {pipelineName("homography", backend), [&trainROIs, params, backend, &codec, adaptive](const string &imagePath) {
+        thread_local Ptr<Feature2D> extractor = createFeatureExtractor(backend);
+        thread_local Ptr<DescriptorMatcher> matcher = createFeatureMatcher(backend);
+        ImageRun r;
+        int64 start = getTickCount();
+
+        Mat img = imread(imagePath, IMREAD_COLOR);
+        r.stageMs[DECODE] = msSince(start);
+        if (img.empty()) return r;
+
+        int64 t = getTickCount();
+        Mat gray;
+        cvtColor(img, gray, COLOR_BGR2GRAY);
+        vector<KeyPoint> keypoints;
+        Mat descriptors;
+        extractAdaptive(*extractor, gray, adaptive, keypoints, descriptors);
+        codec.encode(descriptors, descriptors);
+        r.stageMs[FEATURES] = msSince(t);
+        r.ok = true;
+        if (descriptors.empty()) {
+            r.stageMs[TOTAL] = msSince(start);
+            return r;
+        }
+
+        DetectorTiming timing;
+        vector<RoiDetection> dets = detectROIs(keypoints, descriptors, img.size(), trainROIs, params,
+                                               *matcher, false, &timing);
+        r.stageMs[MATCHING] = timing.matchingMs;
+        r.stageMs[VERIFICATION] = timing.verificationMs;
+        for (const auto &d : dets) {
+            r.detections.push_back({boundingRect(d.corners), 0});
+        }
+        r.stageMs[TOTAL] = msSince(start);
+        return r;
+    }};
+}
+
+// Segmentación + LBP + SVM; "features" incluye la segmentación y el LBP, "matching" el SVM
+Pipeline makeLBPPipeline(const SignClassifier &classifier, int maskScale) {
+    return {"lbp", [&classifier, maskScale](const string &imagePath) {
+        ImageRun r;
+        int64 start = getTickCount();
+
+        Mat img = imread(imagePath, IMREAD_COLOR);
+        r.stageMs[DECODE] = msSince(start);
+        if (img.empty()) return r;
+        r.ok = true;
+
+        SignTiming timing;
+        for (const auto &d : detectSigns(img, classifier, &timing, maskScale)) {
+            r.detections.push_back({d.box, d.label});
+        }
+        r.stageMs[FEATURES] = timing.segmentationMs + timing.featuresMs;
+        r.stageMs[MATCHING] = timing.classifyMs;
+        r.stageMs[TOTAL] = msSince(start);
+        return r;
+    }};
+}
+
+// Cascada: "features" incluye los candidatos de color/LBP, "matching" toda la verificación
+// (knnMatch + homografía, con el respaldo de frame completo si se usó)
+Pipeline makeCascadePipeline(const vector<TrainROI> &trainROIs, const DetectorParams &params,
+                             FeatureBackend backend, const DescriptorCodec &codec, const AdaptiveParams &adaptive,
+                             const SignClassifier *classifier, int maskScale) {
+    return {pipelineName("cascade", backend),
+            [&trainROIs, params, backend, &codec, adaptive, classifier, maskScale](const string &imagePath) {
+        thread_local Ptr<Feature2D> extractor = createFeatureExtractor(backend);
+        thread_local Ptr<DescriptorMatcher> matcher = createFeatureMatcher(backend);
+        ImageRun r;
+        int64 start = getTickCount();
+
+        Mat img = imread(imagePath, IMREAD_COLOR);
+        r.stageMs[DECODE] = msSince(start);
+        if (img.empty()) return r;
+        r.ok = true;
+
+        auto verify = [&](const vector<KeyPoint> &keypoints, const Mat &des) {
+            Mat descriptors;
+            codec.encode(des, descriptors);
+            return detectROIs(keypoints, descriptors, img.size(), trainROIs, params, *matcher, false);
+        };
+        CascadeParams cascadeParams;
+        cascadeParams.maskScale = maskScale;
+        CascadeTiming timing;
+        CascadeResult result = runCascade(img, classifier, *extractor, adaptive, cascadeParams, verify, &timing);
+        for (const auto &d : result.detections) {
+            r.detections.push_back({boundingRect(d.corners), 0});
+        }
+        r.stageMs[FEATURES] = timing.candidatesMs + timing.featuresMs;
+        r.stageMs[MATCHING] = timing.verificationMs;
+        r.stageMs[TOTAL] = msSince(start);
+        return r;
+    }};
+}
+
+//----------------------------------------------------------
+// Reporte
+//----------------------------------------------------------
+
+void printSummary(const PipelineSummary &s) {
+    size_t detected = s.truePositives + s.falsePositives;
+    size_t annotated = s.truePositives + s.falseNegatives;
+    double precision = detected ? (double)s.truePositives / detected : 0.0;
+    double recall = annotated ? (double)s.truePositives / annotated : 0.0;
+    double meanIoU = s.truePositives ? s.iouSum / s.truePositives : 0.0;
+
+    cout << "\n[INFO] Pipeline " << s.name << ": " << s.images << " imágenes (" << s.failed << " con errores)" << endl;
+    cout << fixed << setprecision(3);
+    cout << "  TP " << s.truePositives << "  FP " << s.falsePositives << "  FN " << s.falseNegatives
+         << "  precisión " << precision << "  recall " << recall << "  IoU medio " << meanIoU << endl;
+    if (s.labeled > 0) {
+        cout << "  clase correcta en " << s.labelCorrect << "/" << s.labeled << " aciertos" << endl;
+    }
+    cout << setprecision(2);
+    cout << "  " << left << setw(14) << "etapa (ms)" << right << setw(10) << "media" << setw(10) << "p50"
+         << setw(10) << "p90" << setw(10) << "p99" << endl;
+    for (int st = 0; st < STAGE_COUNT; st++) {
+        const vector<double> &v = s.stageMs[st];
+        double mean = v.empty() ? 0.0 : accumulate(v.begin(), v.end(), 0.0) / v.size();
+        cout << "  " << left << setw(14) << STAGE_NAMES[st] << right << setw(10) << mean << setw(10)
+             << percentile(v, 50) << setw(10) << percentile(v, 90) << setw(10) << percentile(v, 99) << endl;
+    }
+    cout.unsetf(ios::floatfield);
+}
+
+// Una fila por pipeline para poder comparar ejecuciones
+void writeSummaryCSV(const string &path, const vector<PipelineSummary> &summaries, double iouThresh) {
+    ofstream out(path);
+    out << "pipeline,images,failed,iou_thresh,tp,fp,fn,precision,recall,mean_iou";
+    for (int st = 0; st < STAGE_COUNT; st++) {
+        out << "," << STAGE_NAMES[st] << "_p50," << STAGE_NAMES[st] << "_p90," << STAGE_NAMES[st] << "_p99";
+    }
+    out << "\n";
+    for (const auto &s : summaries) {
+        size_t detected = s.truePositives + s.falsePositives;
+        size_t annotated = s.truePositives + s.falseNegatives;
+        out << s.name << "," << s.images << "," << s.failed << "," << iouThresh << "," << s.truePositives << ","
+            << s.falsePositives << "," << s.falseNegatives << ","
+            << (detected ? (double)s.truePositives / detected : 0.0) << ","
+            << (annotated ? (double)s.truePositives / annotated : 0.0) << ","
+            << (s.truePositives ? s.iouSum / s.truePositives : 0.0);
+        for (int st = 0; st < STAGE_COUNT; st++) {
+            out << "," << percentile(s.stageMs[st], 50) << "," << percentile(s.stageMs[st], 90) << ","
+                << percentile(s.stageMs[st], 99);
+        }
+        out << "\n";
+    }
+}
+
+// Uso:
+//   ./benchmark.bin [--test test/] [--pipelines flann,homography,lbp,cascade] [--iou 0.5]
+//                   [--svm "lbp server/svm_limit.yml"] [--mask-scale N] [--out resumen.csv] [-j N]
+//                   [--flann-db sift_descriptors.vdb] [--homography-db train_sift_descriptors.vdb]
+//                   [--max-side 1280] [--budget 2000] [--roi-jobs N] [--early-exit N]
+//                   [--metrics ARCHIVO [--metrics-interval S]]
+// Con --flann-db / --homography-db se comparan bases generadas con otro extractor
+// (train.bin / train2.bin --features orb ...). --max-side / --budget fijan la
+// resolución de trabajo y el máximo de keypoints de flann y homography
+// (0 = resolución original / sin límite, como antes). --roi-jobs reparte las ROIs de
+// cada imagen de homography y cascade entre N hilos y --early-exit corta al confirmar
+// una ROI con N inliers (ver DetectorParams).
+// Por defecto las imágenes se procesan de una en una para que las latencias no
+// incluyan la contención entre hilos; con -j se reparte entre N hilos.
+// --metrics exporta además los histogramas por etapa de las funciones compartidas
+// (suma de todos los pipelines), en el mismo formato que los demás binarios.
+int main(int argc, char *argv[]) {
+    initMetricsFromArgs(argc, argv, "benchmark");
+    string testFolder = "test";
+    string pipelineList = "flann,homography,lbp,cascade";
+    string svmPath = "lbp server/svm_limit.yml";
+    string outputPath;
+    string flannDbPath = "sift_descriptors.vdb";
+    string homographyDbPath = "train_sift_descriptors.vdb";
+    double iouThresh = 0.5;
+    DetectorParams params;
+    int maskScale = 1;
+    unsigned jobs = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--test") testFolder = argv[++i];
+        else if (arg == "--pipelines") pipelineList = argv[++i];
+        else if (arg == "--iou") iouThresh = atof(argv[++i]);
+        else if (arg == "--svm") svmPath = argv[++i];
+        else if (arg == "--mask-scale") maskScale = max(1, atoi(argv[++i]));
+        else if (arg == "--out") outputPath = argv[++i];
+        else if (arg == "--flann-db") flannDbPath = argv[++i];
+        else if (arg == "--homography-db") homographyDbPath = argv[++i];
+        else if (arg == "-j") { jobs = parseJobsArg(argc, argv); i++; }
+        else if (arg == "--roi-jobs") params.threads = (unsigned)max(1, atoi(argv[++i]));
+        else if (arg == "--early-exit") params.earlyExitInliers = max(0, atoi(argv[++i]));
+    }
+    AdaptiveParams adaptive = parseAdaptiveArgs(argc, argv);
+
+    // 🔹 Imágenes con su XML de anotaciones (índice compilado: solo se parsean los XML modificados)
+    vector<string> images;
+    vector<vector<GroundTruth>> truth;
+    AnnotationIndex annotations = compileAnnotations(testFolder, jobs);
+    for (const auto &image : annotations.images()) {
+        if (!image.valid) {
+            cerr << "[ERROR] Sin anotaciones válidas para " << image.imagePath << ", se omite." << endl;
+            continue;
+        }
+        images.push_back(image.imagePath);
+        truth.push_back(groundTruthFor(image));
+    }
+    if (images.empty()) {
+        cerr << "[ERROR] No se encontraron imágenes anotadas en " << testFolder << endl;
+        return -1;
+    }
+    // Orden estable para que dos ejecuciones sean comparables
+    vector<size_t> order(images.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return images[a] < images[b]; });
+
+    // 🔹 Modelos de cada pipeline (los que falten se omiten)
+    vector<Pipeline> pipelines;
+    auto wanted = [&](const string &name) {
+        stringstream ss(pipelineList);
+        string item;
+        while (getline(ss, item, ',')) {
+            if (item == name) return true;
+        }
+        return false;
+    };
+
+    DescriptorDB siftDb;
+    GlobalIndex siftIndex;
+    DescriptorCodec siftCodec;
+    if (wanted("flann")) {
+        string dbPath = flannDbPath;
+        if (siftDb.open(dbPath) && loadCodecFor(siftDb, dbPath, siftCodec)) {
+            if (!siftIndex.load(siftDb, indexPathFor(dbPath))) siftIndex.build(siftDb);
+            pipelines.push_back(makeFlannPipeline(siftIndex, siftDb.featureBackend(), siftCodec, adaptive));
+        } else {
+            cerr << "[ERROR] No se pudo abrir " << dbPath << ", se omite el pipeline flann." << endl;
+        }
+    }
+
+    DescriptorDB trainDb;
+    DescriptorCodec trainCodec;
+    vector<TrainROI> trainROIs;
+    bool haveTrainROIs = false;
+    if (wanted("homography") || wanted("cascade")) {
+        trainROIs = loadTrainDescriptors(trainDb, homographyDbPath);
+        haveTrainROIs = !trainROIs.empty() && loadCodecFor(trainDb, homographyDbPath, trainCodec);
+        params.norm = featureNorm(trainDb.featureBackend());
+    }
+    if (wanted("homography")) {
+        if (haveTrainROIs) {
+            pipelines.push_back(makeHomographyPipeline(trainROIs, params, trainDb.featureBackend(), trainCodec, adaptive));
+        } else {
+            cerr << "[ERROR] Sin ROIs de entrenamiento, se omite el pipeline homography." << endl;
+        }
+    }
+
+    SignClassifier classifier;
+    bool haveClassifier = false;
+    if (wanted("lbp") || wanted("cascade")) haveClassifier = loadSignClassifier(svmPath, classifier);
+    if (wanted("lbp")) {
+        if (haveClassifier) {
+            pipelines.push_back(makeLBPPipeline(classifier, maskScale));
+        } else {
+            cerr << "[ERROR] No se pudo cargar el SVM desde " << svmPath << ", se omite el pipeline lbp." << endl;
+        }
+    }
+
+    // La cascada funciona sin SVM (solo color), pero necesita las ROIs de homography
+    if (wanted("cascade")) {
+        if (haveTrainROIs) {
+            pipelines.push_back(makeCascadePipeline(trainROIs, params, trainDb.featureBackend(), trainCodec, adaptive,
+                                                    haveClassifier ? &classifier : nullptr, maskScale));
+        } else {
+            cerr << "[ERROR] Sin ROIs de entrenamiento, se omite el pipeline cascade." << endl;
+        }
+    }
+
+    if (pipelines.empty()) {
+        cerr << "[ERROR] Ningún pipeline disponible." << endl;
+        return -1;
+    }
+
+    cout << "[INFO] " << images.size() << " imágenes anotadas, " << pipelines.size() << " pipeline(s), "
+         << jobs << " hilo(s), " << params.threads << " hilo(s) por imagen para las ROIs, IoU >= " << iouThresh << endl;
+
+    int cvThreads = getNumThreads();
+    if (jobs > 1 || params.threads > 1) setNumThreads(1);
+
+    vector<PipelineSummary> summaries;
+    for (const auto &pipeline : pipelines) {
+        vector<ImageRun> runs(images.size());
+        parallelFor(order.size(), jobs, [&](size_t k) {
+            runs[order[k]] = pipeline.run(images[order[k]]);
+        });
+
+        PipelineSummary s;
+        s.name = pipeline.name;
+        for (size_t k : order) {
+            s.images++;
+            if (!runs[k].ok) {
+                cerr << "[ERROR] " << pipeline.name << ": no se pudo procesar " << images[k] << endl;
+                s.failed++;
+                s.falseNegatives += truth[k].size();
+                continue;
+            }
+            evaluateImage(runs[k], truth[k], iouThresh, s);
+            for (int st = 0; st < STAGE_COUNT; st++) s.stageMs[st].push_back(runs[k].stageMs[st]);
+        }
+        printSummary(s);
+        summaries.push_back(s);
+    }
+
+    setNumThreads(cvThreads);
+
+    if (!outputPath.empty()) {
+        writeSummaryCSV(outputPath, summaries, iouThresh);
+        cout << "\n[INFO] Resumen guardado en " << outputPath << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "Cascade.hpp"
+
+using namespace std;
+using namespace cv;
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+// Extrae en gris, opcionalmente solo dentro de la máscara y del recorte que la contiene
+static void extractFeatures(const Mat &gray, const Mat &mask, Rect crop, Feature2D &extractor,
+                            const AdaptiveParams &adaptive, vector<KeyPoint> &keypoints, Mat &descriptors) {
+    if (mask.empty()) {
+        extractAdaptive(extractor, gray, adaptive, keypoints, descriptors);
+        return;
+    }
+    extractAdaptive(extractor, gray(crop), adaptive, keypoints, descriptors, mask(crop));
+    for (auto &kp : keypoints) {
+        kp.pt.x += crop.x;
+        kp.pt.y += crop.y;
+    }
+}
+
+CascadeResult runCascade(const Mat &frame, const SignClassifier *classifier, Feature2D &extractor,
+                         const AdaptiveParams &adaptive, const CascadeParams &params,
+                         const CascadeVerifier &verify, CascadeTiming *timing) {
+    CascadeResult result;
+    CascadeTiming local;
+    CascadeTiming &t = timing ? *timing : local;
+
+    // 1-2. Candidatos baratos
+    int64 start = getTickCount();
+    vector<Rect> candidates = findSignCandidates(frame, nullptr, params.maskScale);
+    if (classifier && !candidates.empty()) {
+        vector<int> labels = classifySignCandidates(frame, candidates, *classifier);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (labels[i] != 0) result.candidates.push_back(candidates[i]);
+        }
+    } else {
+        result.candidates = candidates;
+    }
+    t.candidatesMs += msSince(start);
+    if (result.candidates.empty()) return result;
+
+    // 3. Máscara con la unión de los candidatos ampliados
+    Rect imageRect(0, 0, frame.cols, frame.rows);
+    Mat mask = Mat::zeros(frame.size(), CV_8U);
+    Rect crop;
+    for (const auto &c : result.candidates) {
+        Rect r = Rect(c.x - params.margin, c.y - params.margin, c.width + 2 * params.margin,
+                      c.height + 2 * params.margin) & imageRect;
+        mask(r).setTo(255);
+        crop = crop.area() == 0 ? r : (crop | r);
+    }
+
+    start = getTickCount();
+    Mat gray;
+    cvtColor(frame, gray, COLOR_BGR2GRAY);
+    vector<KeyPoint> keypoints;
+    Mat descriptors;
+    extractFeatures(gray, mask, crop, extractor, adaptive, keypoints, descriptors);
+    t.featuresMs += msSince(start);
+
+    // 4. Verificación dentro de los candidatos
+    start = getTickCount();
+    if (!descriptors.empty()) result.detections = verify(keypoints, descriptors);
+    t.verificationMs += msSince(start);
+    result.keypoints = (int)keypoints.size();
+    if (!result.detections.empty() || !params.fallbackFullFrame) return result;
+
+    // Respaldo: el candidato pudo recortar la señal o la detección de color falló en parte
+    result.usedFallback = true;
+    start = getTickCount();
+    extractFeatures(gray, Mat(), imageRect, extractor, adaptive, keypoints, descriptors);
+    t.featuresMs += msSince(start);
+
+    start = getTickCount();
+    if (!descriptors.empty()) result.detections = verify(keypoints, descriptors);
+    t.verificationMs += msSince(start);
+    result.keypoints = (int)keypoints.size();
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef CASCADE_HPP
+#define CASCADE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+#include "AdaptiveFeatures.hpp"
+#include "HomographyDetector.hpp"
+#include "lbp server/SignDetector.hpp"
+
+// Cascada color/LBP -> características:
+//
+//  1. Segmentación del rojo (findSignCandidates). Sin candidatos el frame se
+//     descarta aquí: es el caso más común y solo paga la etapa barata.
+//  2. Si hay clasificador, LBP + SVM sobre los candidatos; los que salen como
+//     clase 0 (no señal) se descartan.
+//  3. Extracción de características solo dentro de los candidatos (ampliados en
+//     margin píxeles): se recorta el rectángulo que los contiene y se aplica una
+//     máscara con su unión, así la pirámide del extractor también se reduce.
+//  4. Verificación (matching + homografía) con esas características. Si no hay
+//     ninguna detección y fallbackFullFrame está activo, se repite con el frame completo.
+struct CascadeParams {
+    int maskScale = 1;              // segmentación a 1/maskScale de resolución
+    int margin = 24;
+    bool fallbackFullFrame = true;
+};
+
+// Tiempo de cada etapa (ms)
+struct CascadeTiming {
+    double candidatesMs = 0;    // segmentación + LBP + SVM
+    double featuresMs = 0;      // extracción (enmascarada y, si hace falta, completa)
+    double verificationMs = 0;  // lo que tarde el verificador
+};
+
+struct CascadeResult {
+    std::vector<cv::Rect> candidates;       // candidatos que llegaron a la etapa de características
+    std::vector<RoiDetection> detections;
+    int keypoints = 0;                      // keypoints de la última extracción
+    bool usedFallback = false;
+};
+
+// Matching y verificación con los keypoints (coordenadas del frame) y descriptores
+// tal como salen del extractor; el llamador aplica su códec, preselección, etc.
+using CascadeVerifier =
+    std::function<std::vector<RoiDetection>(const std::vector<cv::KeyPoint> &, const cv::Mat &)>;
+
+// Ejecuta la cascada sobre un frame BGR. classifier puede ser nulo (solo color).
+CascadeResult runCascade(const cv::Mat &frame, const SignClassifier *classifier, cv::Feature2D &extractor,
+                         const AdaptiveParams &adaptive, const CascadeParams &params,
+                         const CascadeVerifier &verify, CascadeTiming *timing = nullptr);
+
+#endif
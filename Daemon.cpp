@@ -0,0 +1,487 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/xfeatures2d.hpp>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "AdaptiveFeatures.hpp"
+#include "Cascade.hpp"
+#include "DaemonProtocol.hpp"
+#include "DescriptorCodec.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "HomographyDetector.hpp"
+#include "Metrics.hpp"
+#include "Parallel.hpp"
+#include "Vocabulary.hpp"
+#include "lbp server/SignDetector.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+using namespace cv::xfeatures2d;
+
+// Demonio de detección: carga la base de descriptores y el SVM una sola vez y
+// atiende imágenes en memoria por un socket Unix (protocolo en DaemonProtocol.hpp).
+// Cada conexión tiene su hilo lector; las imágenes de todas las conexiones van
+// a una cola común que consumen los hilos de detección.
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+static string jsonEscape(const string &s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static const char *pipelineName(uint32_t pipeline) {
+    switch (pipeline) {
+        case PIPELINE_HOMOGRAPHY: return "homography";
+        case PIPELINE_LBP: return "lbp";
+        case PIPELINE_CASCADE: return "cascade";
+        default: return "unknown";
+    }
+}
+
+//----------------------------------------------------------
+// Modelos (solo lectura una vez cargados, compartidos por todos los hilos)
+//----------------------------------------------------------
+struct DaemonModels {
+    DescriptorDB db;                // debe seguir abierta: las ROIs son vistas sobre el archivo
+    vector<TrainROI> trainROIs;
+    FeatureBackend backend = FEATURE_SIFT;
+    DescriptorCodec codec;
+    VisualVocabulary vocabulary;
+    bool hasVocabulary = false;
+    int topK = 20;
+    AdaptiveParams adaptive;
+    DetectorParams params;
+    SignClassifier classifier;
+    bool hasClassifier = false;
+    CascadeParams cascadeParams;
+};
+
+// Detección homográfica de una ROI con el rectángulo que la contiene, para responder igual que el LBP
+static void writeRoiDetection(ostream &out, const RoiDetection &d) {
+    Rect box = d.corners.empty() ? Rect() : boundingRect(d.corners);
+    out << "{\"box\": [" << box.x << ", " << box.y << ", " << box.width << ", " << box.height << "], \"roi\": "
+        << d.roiIndex << ", \"good_matches\": " << d.goodMatches << ", \"inliers\": " << d.inliers << ", \"corners\": [";
+    for (size_t c = 0; c < d.corners.size(); c++) {
+        out << (c ? ", " : "") << "[" << d.corners[c].x << ", " << d.corners[c].y << "]";
+    }
+    out << "]}";
+}
+
+//----------------------------------------------------------
+// Cola de trabajo
+//----------------------------------------------------------
+
+// Petición de un cliente: el hilo de la conexión espera a que terminen todas sus imágenes
+struct PendingRequest {
+    uint32_t pipeline = PIPELINE_HOMOGRAPHY;
+    bool annotate = false;
+    vector<vector<uchar>> images;
+    vector<string> json;            // resultado de cada imagen
+    vector<vector<uchar>> annotated;
+
+    mutex lock;
+    condition_variable done;
+    size_t remaining = 0;
+};
+
+struct ImageJob {
+    PendingRequest *request;
+    size_t index;
+    int64 queuedAt;
+};
+
+class JobQueue {
+public:
+    void push(PendingRequest &request) {
+        int64 now = getTickCount();
+        {
+            lock_guard<mutex> guard(lock);
+            for (size_t i = 0; i < request.images.size(); i++) jobs.push_back({&request, i, now});
+        }
+        available.notify_all();
+    }
+
+    // false cuando la cola se cerró y ya no quedan trabajos
+    bool pop(ImageJob &job) {
+        unique_lock<mutex> guard(lock);
+        available.wait(guard, [this] { return closed || !jobs.empty(); });
+        if (jobs.empty()) return false;
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+        }
+        available.notify_all();
+    }
+
+private:
+    mutex lock;
+    condition_variable available;
+    deque<ImageJob> jobs;
+    bool closed = false;
+};
+
+//----------------------------------------------------------
+// Detección de una imagen (se llama desde los hilos de detección)
+//----------------------------------------------------------
+static string processImage(const DaemonModels &models, uint32_t pipeline, const vector<uchar> &bytes, bool annotate,
+                           double queueMs, vector<uchar> &jpeg) {
+    thread_local Ptr<Feature2D> extractor = createFeatureExtractor(models.backend);
+    thread_local Ptr<DescriptorMatcher> matcher = createFeatureMatcher(models.backend);
+
+    ostringstream out;
+    out << "{\"pipeline\": \"" << pipelineName(pipeline) << "\"";
+    // unavailable: el demonio no puede atender este pipeline (falta el modelo); el cliente
+    // debe usar su propio camino en vez de informar un error de la imagen
+    auto fail = [&](const string &error, bool unavailable = false) {
+        out << ", \"ok\": false, \"error\": \"" << jsonEscape(error) << "\"";
+        if (unavailable) out << ", \"unavailable\": true";
+        out << "}";
+        return out.str();
+    };
+
+    bool needsDb = pipeline == PIPELINE_HOMOGRAPHY || pipeline == PIPELINE_CASCADE;
+    if (pipeline > PIPELINE_CASCADE) return fail("Pipeline desconocido");
+    if (needsDb && models.trainROIs.empty()) return fail("El demonio no tiene base de descriptores cargada", true);
+    if (pipeline == PIPELINE_LBP && !models.hasClassifier) return fail("El demonio no tiene SVM cargado", true);
+
+    int64 start = getTickCount();
+    Mat frame = imdecode(bytes, IMREAD_COLOR);
+    double decodeMs = msSince(start);
+    recordStage(METRIC_DECODE, decodeMs);
+    if (frame.empty()) return fail("No se pudo decodificar la imagen");
+
+    // Matching, preselección y homografías sobre las características de la consulta
+    auto verify = [&](const vector<KeyPoint> &kp, const Mat &des) {
+        Mat testDes;
+        models.codec.encode(des, testDes);
+        vector<int> shortlist;
+        bool useShortlist = models.hasVocabulary && models.topK > 0;
+        if (useShortlist) shortlist = models.vocabulary.shortlist(testDes, models.topK);
+        return detectROIs(kp, testDes, frame.size(), models.trainROIs, models.params, *matcher, false, nullptr,
+                          useShortlist ? &shortlist : nullptr);
+    };
+
+    int64 t = getTickCount();
+    vector<RoiDetection> roiDetections;
+    vector<Detection> signs;
+    if (pipeline == PIPELINE_LBP) {
+        signs = detectSigns(frame, models.classifier, nullptr, models.cascadeParams.maskScale);
+    } else if (pipeline == PIPELINE_CASCADE) {
+        CascadeResult cascade = runCascade(frame, models.hasClassifier ? &models.classifier : nullptr, *extractor,
+                                           models.adaptive, models.cascadeParams, verify);
+        roiDetections = cascade.detections;
+        out << ", \"candidates\": " << cascade.candidates.size() << ", \"fallback\": "
+            << (cascade.usedFallback ? "true" : "false");
+    } else {
+        Mat gray;
+        cvtColor(frame, gray, COLOR_BGR2GRAY);
+        vector<KeyPoint> kp;
+        Mat des;
+        extractAdaptive(*extractor, gray, models.adaptive, kp, des);
+        if (!des.empty()) roiDetections = verify(kp, des);
+    }
+    double detectMs = msSince(t);
+    recordStage(METRIC_FRAME, decodeMs + detectMs);
+    addCounter(COUNTER_FRAMES);
+
+    out << ", \"ok\": true, \"width\": " << frame.cols << ", \"height\": " << frame.rows << ", \"timing_ms\": {\"queue\": "
+        << queueMs << ", \"decode\": " << decodeMs << ", \"detect\": " << detectMs << "}, \"detections\": [";
+    for (size_t k = 0; k < signs.size(); k++) {
+        const Rect &b = signs[k].box;
+        out << (k ? ", " : "") << "{\"box\": [" << b.x << ", " << b.y << ", " << b.width << ", " << b.height
+            << "], \"label\": " << signs[k].label << "}";
+    }
+    for (size_t k = 0; k < roiDetections.size(); k++) {
+        out << (k ? ", " : "");
+        writeRoiDetection(out, roiDetections[k]);
+    }
+    out << "]}";
+
+    if (annotate) {
+        if (pipeline == PIPELINE_LBP) drawSigns(frame, signs);
+        else drawDetections(frame, roiDetections);
+        imencode(".jpg", frame, jpeg);
+    }
+    return out.str();
+}
+
+static void detectionWorker(const DaemonModels &models, JobQueue &queue) {
+    ImageJob job;
+    while (queue.pop(job)) {
+        PendingRequest &request = *job.request;
+        double queueMs = msSince(job.queuedAt);
+        string json = processImage(models, request.pipeline, request.images[job.index], request.annotate, queueMs,
+                                   request.annotated[job.index]);
+        lock_guard<mutex> guard(request.lock);
+        request.json[job.index] = json;
+        if (--request.remaining == 0) request.done.notify_all();
+    }
+}
+
+//----------------------------------------------------------
+// Conexiones
+//----------------------------------------------------------
+static bool readAll(int fd, void *buffer, size_t size) {
+    char *p = (char *)buffer;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *buffer, size_t size) {
+    const char *p = (const char *)buffer;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Atiende las peticiones de un cliente hasta que cierre la conexión (el socket lo cierra el hilo principal)
+static void serveConnection(int fd, JobQueue &queue) {
+    for (;;) {
+        RequestHeader h;
+        if (!readAll(fd, &h, sizeof(h))) break;
+        if (memcmp(h.magic, DAEMON_REQUEST_MAGIC, sizeof(h.magic)) != 0 || h.version != DAEMON_VERSION ||
+            h.imageCount > DAEMON_MAX_IMAGES) {
+            cerr << "[ERROR] Petición inválida, se cierra la conexión." << endl;
+            break;
+        }
+
+        PendingRequest request;
+        request.pipeline = h.pipeline;
+        request.annotate = (h.flags & DAEMON_ANNOTATE) != 0;
+        request.images.resize(h.imageCount);
+        bool ok = true;
+        uint64_t requestBytes = 0;
+        for (auto &image : request.images) {
+            uint64_t size;
+            if (!readAll(fd, &size, sizeof(size)) || size > DAEMON_MAX_IMAGE_BYTES ||
+                size > DAEMON_MAX_REQUEST_BYTES - requestBytes) {
+                ok = false;
+                break;
+            }
+            requestBytes += size;
+            image.resize(size);
+            if (!readAll(fd, image.data(), size)) {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) {
+            cerr << "[ERROR] Petición incompleta o imagen demasiado grande, se cierra la conexión." << endl;
+            break;
+        }
+
+        request.json.resize(h.imageCount);
+        request.annotated.resize(h.imageCount);
+        request.remaining = h.imageCount;
+        if (h.imageCount > 0) {
+            queue.push(request);
+            unique_lock<mutex> guard(request.lock);
+            request.done.wait(guard, [&] { return request.remaining == 0; });
+        }
+
+        string json = "[";
+        for (size_t i = 0; i < request.json.size(); i++) json += (i ? ", " : "") + request.json[i];
+        json += "]";
+
+        ResponseHeader r;
+        memcpy(r.magic, DAEMON_RESPONSE_MAGIC, sizeof(r.magic));
+        r.version = DAEMON_VERSION;
+        r.imageCount = h.imageCount;
+        r.jsonLength = json.size();
+        ok = writeAll(fd, &r, sizeof(r)) && writeAll(fd, json.data(), json.size());
+        for (size_t i = 0; ok && i < request.annotated.size(); i++) {
+            uint64_t size = request.annotated[i].size();
+            ok = writeAll(fd, &size, sizeof(size)) && writeAll(fd, request.annotated[i].data(), size);
+        }
+        if (!ok) break;
+    }
+}
+
+struct Connection {
+    int fd;
+    thread worker;
+    atomic<bool> finished{false};
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+// Uso: ./daemon.bin [--socket RUTA] [--db BASE] [--svm MODELO] [-j N] [--shortlist K]
+//                   [--early-exit N] [--mask-scale N] [--max-side N] [--budget N]
+//                   [--metrics ARCHIVO [--metrics-interval S]]
+//   --socket     socket Unix donde escucha (por defecto /tmp/vision.sock, permisos 0660)
+//   --db         base de descriptores para homography y cascade ("" = solo lbp)
+//   --svm        modelo LBP + SVM para lbp y cascade ("" = cascade solo con color)
+//   -j N         hilos de detección (por defecto todos los núcleos)
+//   --shortlist  ROIs preseleccionadas con el vocabulario visual (0 = todas)
+//   --metrics    exporta tiempos por etapa y contadores (JSON si termina en .json, si no Prometheus)
+// Cada imagen se verifica en un solo hilo: el paralelismo está entre imágenes.
+int main(int argc, char *argv[]) {
+    string socketPath = "/tmp/vision.sock";
+    string dbPath = "train_sift_descriptors.vdb";
+    string svmPath = "lbp server/svm_limit.yml";
+    DaemonModels models;
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--socket") socketPath = argv[++i];
+        else if (arg == "--db") dbPath = argv[++i];
+        else if (arg == "--svm") svmPath = argv[++i];
+        else if (arg == "--shortlist") models.topK = max(0, atoi(argv[++i]));
+        else if (arg == "--early-exit") models.params.earlyExitInliers = max(0, atoi(argv[++i]));
+        else if (arg == "--mask-scale") models.cascadeParams.maskScale = max(1, atoi(argv[++i]));
+    }
+    initMetricsFromArgs(argc, argv, "daemon");
+    unsigned jobs = parseJobsArg(argc, argv);
+    models.adaptive = parseAdaptiveArgs(argc, argv);
+    models.params.threads = 1;
+
+    // Modelos: se cargan una vez y quedan en memoria mientras el demonio viva
+    if (!dbPath.empty()) {
+        models.trainROIs = loadTrainDescriptors(models.db, dbPath);
+        if (!models.trainROIs.empty()) {
+            models.backend = models.db.featureBackend();
+            models.params.norm = featureNorm(models.backend);
+            if (!loadCodecFor(models.db, dbPath, models.codec)) return -1;
+            if (models.topK > 0) models.hasVocabulary = models.vocabulary.load(models.db, vocabularyPathFor(dbPath));
+            cout << "[INFO] Base " << dbPath << ": " << models.trainROIs.size() << " ROIs ("
+                 << featureBackendName(models.backend) << ")"
+                 << (models.hasVocabulary ? ", con vocabulario visual" : "") << "." << endl;
+        }
+    }
+    if (!svmPath.empty()) {
+        models.hasClassifier = loadSignClassifier(svmPath, models.classifier);
+        if (models.hasClassifier) cout << "[INFO] Clasificador LBP + SVM: " << svmPath << endl;
+    }
+    if (models.trainROIs.empty() && !models.hasClassifier) {
+        cerr << "[ERROR] No se pudo cargar ni la base de descriptores ni el SVM." << endl;
+        return -1;
+    }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (listenFd < 0 || socketPath.size() >= sizeof(addr.sun_path)) {
+        cerr << "[ERROR] No se pudo crear el socket " << socketPath << endl;
+        return -1;
+    }
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    // Si otro demonio responde en la ruta no se le quita; solo se borra un socket huérfano
+    // de una ejecución anterior que no terminó limpia (la conexión se rechaza)
+    int probeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probeFd >= 0) {
+        bool answered = connect(probeFd, (sockaddr *)&addr, sizeof(addr)) == 0;
+        int probeError = errno;
+        close(probeFd);
+        struct stat st;
+        if (answered) {
+            cerr << "[ERROR] Ya hay un demonio escuchando en " << socketPath << endl;
+            close(listenFd);
+            return -1;
+        }
+        if (probeError == ECONNREFUSED && lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(socketPath.c_str());
+        }
+    }
+    // Solo el usuario del demonio y su grupo (p. ej. el del servidor Flask) pueden conectarse
+    mode_t previousMask = umask(0117);
+    bool bound = ::bind(listenFd, (sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(previousMask);
+    if (!bound || listen(listenFd, 64) != 0) {
+        cerr << "[ERROR] No se pudo escuchar en " << socketPath << ": " << strerror(errno) << endl;
+        close(listenFd);
+        return -1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // Los hilos de detección ya ocupan todos los núcleos, se evita el paralelismo interno de OpenCV
+    setNumThreads(1);
+    JobQueue queue;
+    vector<thread> workers;
+    for (unsigned t = 0; t < jobs; t++) workers.emplace_back(detectionWorker, cref(models), ref(queue));
+    cout << "[INFO] Escuchando en " << socketPath << " con " << jobs << " hilo(s) de detección." << endl;
+
+    list<Connection> connections;
+    while (!stopRequested) {
+        // Se liberan los hilos de las conexiones que ya cerraron
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->finished) {
+                it->worker.join();
+                close(it->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        pollfd p = {listenFd, POLLIN, 0};
+        if (poll(&p, 1, 500) <= 0) continue;  // timeout o señal: se vuelve a mirar stopRequested
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) continue;
+        connections.emplace_back();
+        Connection &c = connections.back();
+        c.fd = fd;
+        c.worker = thread([&c, &queue] {
+            serveConnection(c.fd, queue);
+            c.finished = true;
+        });
+    }
+
+    cout << "[INFO] Deteniendo el demonio..." << endl;
+    close(listenFd);
+    unlink(socketPath.c_str());
+    // Las peticiones en curso terminan; las conexiones dejan de leer
+    for (auto &c : connections) shutdown(c.fd, SHUT_RD);
+    for (auto &c : connections) {
+        c.worker.join();
+        close(c.fd);
+    }
+    queue.close();
+    for (auto &t : workers) t.join();
+    return 0;
+}
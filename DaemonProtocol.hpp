@@ -0,0 +1,59 @@
+#ifndef DAEMON_PROTOCOL_HPP
+#define DAEMON_PROTOCOL_HPP
+
+#include <cstdint>
+
+// Protocolo del demonio de detección (daemon.bin) sobre un socket Unix local.
+// Los clientes (app.py, "lbp server/app.py" vía detection_client.py) mantienen
+// la conexión abierta y envían una petición tras otra.
+//
+// Petición (little-endian):
+//   RequestHeader
+//   por cada imagen: uint64 tamaño + bytes del archivo (JPEG/PNG tal cual)
+//
+// Respuesta:
+//   ResponseHeader
+//   JSON con un objeto por imagen, en el orden de la petición; si el demonio no tiene
+//   el modelo del pipeline pedido el objeto lleva "unavailable": true
+//   por cada imagen: uint64 tamaño + JPEG anotado (tamaño 0 si no se pidió)
+//
+// Las imágenes de una petición y las de otras conexiones se reparten entre los
+// mismos hilos del demonio; nada pasa por disco.
+
+static const char DAEMON_REQUEST_MAGIC[4] = {'V', 'D', 'R', 'Q'};
+static const char DAEMON_RESPONSE_MAGIC[4] = {'V', 'D', 'R', 'S'};
+static const uint32_t DAEMON_VERSION = 1;
+
+// Límites para no reservar memoria a ciegas con una petición corrupta
+static const uint32_t DAEMON_MAX_IMAGES = 256;
+static const uint64_t DAEMON_MAX_IMAGE_BYTES = 64ull << 20;
+static const uint64_t DAEMON_MAX_REQUEST_BYTES = 256ull << 20;   // suma de las imágenes de una petición
+
+enum DaemonPipeline : uint32_t {
+    PIPELINE_HOMOGRAPHY = 0,    // características + knnMatch por ROI + homografía (Test3.cpp)
+    PIPELINE_LBP = 1,           // rojo + LBP + SVM ("lbp server")
+    PIPELINE_CASCADE = 2        // LBP propone candidatos y la homografía los verifica (Cascade.hpp)
+};
+
+enum DaemonFlags : uint32_t {
+    DAEMON_ANNOTATE = 1         // devolver el JPEG con las detecciones dibujadas
+};
+
+#pragma pack(push, 1)
+struct RequestHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t pipeline;          // DaemonPipeline
+    uint32_t flags;             // DaemonFlags
+    uint32_t imageCount;
+};
+
+struct ResponseHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t imageCount;
+    uint64_t jsonLength;
+};
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,125 @@
+#include "DatasetLoader.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include "Metrics.hpp"
+
+using namespace std;
+using namespace cv;
+namespace fs = std::filesystem;
+
+vector<string> listDatasetImages(const string &folder) {
+    vector<string> images;
+    if (!fs::is_directory(folder)) return images;
+    for (const auto &entry : fs::directory_iterator(folder)) {
+        if (entry.path().extension() == ".jpg" || entry.path().extension() == ".png") {
+            images.push_back(entry.path().string());
+        }
+    }
+    sort(images.begin(), images.end());
+    return images;
+}
+
+int reductionForRoi(const Rect &roi, const DecodeOptions &options) {
+    if (options.minRoiSide <= 0) return 1;
+    int side = min(roi.width, roi.height);
+    for (int f = 8; f > 1; f /= 2) {
+        if (side / f >= options.minRoiSide) return f;
+    }
+    return 1;
+}
+
+Mat decodeImage(const string &path, bool gray, int reduction) {
+    int flags;
+    switch (reduction) {
+        case 2: flags = gray ? IMREAD_REDUCED_GRAYSCALE_2 : IMREAD_REDUCED_COLOR_2; break;
+        case 4: flags = gray ? IMREAD_REDUCED_GRAYSCALE_4 : IMREAD_REDUCED_COLOR_4; break;
+        case 8: flags = gray ? IMREAD_REDUCED_GRAYSCALE_8 : IMREAD_REDUCED_COLOR_8; break;
+        default: flags = gray ? IMREAD_GRAYSCALE : IMREAD_COLOR; break;
+    }
+    ScopedTimer timer(METRIC_DECODE);
+    return imread(path, flags);
+}
+
+RoiSample loadGrayRoi(const string &imagePath, const Rect &bbox, int minSide, const DecodeOptions &options) {
+    RoiSample s;
+    s.reduction = reductionForRoi(bbox, options);
+    Mat img = decodeImage(imagePath, true, s.reduction);
+    if (img.empty()) return s;
+
+    // La ROI se ajusta en resolución completa (el tamaño decodificado por el factor)
+    int f = s.reduction;
+    Rect full = bbox & Rect(0, 0, img.cols * f, img.rows * f);
+    if (full.width < minSide || full.height < minSide) {
+        s.status = RoiSample::TOO_SMALL;
+        return s;
+    }
+    Rect reduced = Rect(full.x / f, full.y / f, max(1, full.width / f), max(1, full.height / f)) &
+                   Rect(0, 0, img.cols, img.rows);
+
+    s.roi = full;
+    s.pixels = img(reduced).clone();
+    s.status = RoiSample::OK;
+    return s;
+}
+
+void scaleKeypoints(vector<KeyPoint> &keypoints, int reduction) {
+    if (reduction == 1) return;
+    for (auto &kp : keypoints) {
+        kp.pt *= (float)reduction;
+        kp.size *= (float)reduction;
+    }
+}
+
+//----------------------------------------------------------
+// Lectura anticipada
+//----------------------------------------------------------
+ImagePrefetcher::ImagePrefetcher(const vector<string> &paths, int imreadFlags, unsigned threadCount, size_t depth)
+    : paths(paths), flags(imreadFlags), depth(max<size_t>(depth, 1)) {
+    unsigned count = (unsigned)min<size_t>(max(threadCount, 1u), max<size_t>(paths.size(), 1));
+    for (unsigned t = 0; t < count; t++) threads.emplace_back(&ImagePrefetcher::worker, this);
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto &t : threads) t.join();
+}
+
+void ImagePrefetcher::worker() {
+    for (;;) {
+        size_t i;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this] { return stopping || nextToRead >= paths.size() || nextToRead < consumed + depth; });
+            if (stopping || nextToRead >= paths.size()) return;
+            i = nextToRead++;
+        }
+        Mat image;
+        {
+            ScopedTimer timer(METRIC_DECODE);
+            image = imread(paths[i], flags);
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            ready[i] = image;
+        }
+        changed.notify_all();
+    }
+}
+
+bool ImagePrefetcher::next(string &path, Mat &image) {
+    unique_lock<mutex> guard(lock);
+    if (consumed >= paths.size()) return false;
+    changed.wait(guard, [this] { return ready.count(consumed) > 0; });
+    path = paths[consumed];
+    image = ready[consumed];
+    ready.erase(consumed);
+    consumed++;
+    guard.unlock();
+    changed.notify_all();
+    return true;
+}
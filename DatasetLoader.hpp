@@ -0,0 +1,79 @@
+#ifndef DATASET_LOADER_HPP
+#define DATASET_LOADER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lectura de las imágenes del dataset compartida por los programas de
+// entrenamiento y de prueba:
+//   - listado ordenado de las imágenes de una carpeta;
+//   - decodificación directa a gris de la ROI anotada, con decodificación
+//     reducida (1/2, 1/4, 1/8 de JPEG) cuando la ROI sigue siendo grande;
+//   - lectura anticipada en hilos de fondo para los consumidores secuenciales.
+
+// Imágenes .jpg y .png de una carpeta, en orden alfabético
+std::vector<std::string> listDatasetImages(const std::string &folder);
+
+// Con minRoiSide > 0 la imagen se decodifica al menor tamaño (1, 1/2, 1/4, 1/8)
+// en el que el lado menor de la ROI no baja de minRoiSide. 0 = resolución completa.
+struct DecodeOptions {
+    int minRoiSide = 0;
+};
+
+// Factor de reducción (1, 2, 4 u 8) para esa ROI
+int reductionForRoi(const cv::Rect &roi, const DecodeOptions &options);
+
+// imread en gris o color reducido por factor (1, 2, 4 u 8)
+cv::Mat decodeImage(const std::string &path, bool gray, int reduction = 1);
+
+// ROI de una imagen en gris, lista para el extractor
+struct RoiSample {
+    enum Status { OK, DECODE_FAILED, TOO_SMALL };
+    Status status = DECODE_FAILED;
+    cv::Rect roi;       // ROI en la resolución completa, ajustada a la imagen
+    cv::Mat pixels;     // píxeles de la ROI (a 1/reduction de resolución)
+    int reduction = 1;
+};
+
+// Decodifica la imagen en gris (reducida si la ROI lo permite), ajusta la ROI a la
+// imagen y la recorta. Si algún lado de la ROI ajustada es menor que minSide se
+// devuelve TOO_SMALL. Los píxeles son una copia propia.
+RoiSample loadGrayRoi(const std::string &imagePath, const cv::Rect &bbox, int minSide,
+                      const DecodeOptions &options);
+
+// Keypoints de una ROI decodificada con reducción -> coordenadas de la ROI a resolución completa
+void scaleKeypoints(std::vector<cv::KeyPoint> &keypoints, int reduction);
+
+// Lee las imágenes de la lista en hilos de fondo, hasta "depth" por delante del
+// consumidor, y las entrega en el orden de la lista.
+class ImagePrefetcher {
+public:
+    ImagePrefetcher(const std::vector<std::string> &paths, int imreadFlags, unsigned threads = 2, size_t depth = 8);
+    ~ImagePrefetcher();
+    ImagePrefetcher(const ImagePrefetcher &) = delete;
+    ImagePrefetcher &operator=(const ImagePrefetcher &) = delete;
+
+    // Siguiente imagen (vacía si no se pudo leer); false cuando ya no quedan
+    bool next(std::string &path, cv::Mat &image);
+
+private:
+    void worker();
+
+    std::vector<std::string> paths;
+    int flags;
+    size_t depth;
+    size_t nextToRead = 0;      // siguiente índice que toma un hilo
+    size_t consumed = 0;        // siguiente índice que entrega next()
+    bool stopping = false;
+    std::map<size_t, cv::Mat> ready;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> threads;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "DatasetPack.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+
+static const uint64_t PACK_ALIGN = 64;
+
+static uint64_t alignUp(uint64_t v) {
+    return (v + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+}
+
+// offset + count * itemSize <= limit, sin desbordar
+static bool fitsIn(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit) {
+    if (offset > limit) return false;
+    return count <= (limit - offset) / itemSize;
+}
+
+//----------------------------------------------------------
+// Escritura
+//----------------------------------------------------------
+void DatasetPackWriter::add(const string &imagePath, const FileStamp &image, const FileStamp &xml,
+                            const RoiSample &sample) {
+    PackEntry e;
+    memset(&e, 0, sizeof(e));
+    e.imageSize = image.size;
+    e.imageMtime = image.mtime;
+    e.imageHash = image.hash;
+    e.xmlSize = xml.size;
+    e.xmlMtime = xml.mtime;
+    e.xmlHash = xml.hash;
+    e.status = sample.status;
+    e.roi[0] = sample.roi.x;
+    e.roi[1] = sample.roi.y;
+    e.roi[2] = sample.roi.width;
+    e.roi[3] = sample.roi.height;
+    e.reduction = sample.reduction;
+    e.pathOffset = paths.size();
+    e.pathLength = (uint32_t)imagePath.size();
+
+    if (sample.status == RoiSample::OK && !sample.pixels.empty()) {
+        e.rows = sample.pixels.rows;
+        e.cols = sample.pixels.cols;
+        e.type = sample.pixels.type();
+        data.resize(alignUp(data.size()));
+        e.dataOffset = data.size();
+        size_t rowBytes = sample.pixels.cols * sample.pixels.elemSize();
+        for (int r = 0; r < sample.pixels.rows; r++) {
+            const uchar *row = sample.pixels.ptr(r);
+            data.insert(data.end(), row, row + rowBytes);
+        }
+    }
+    entries.push_back(e);
+    paths += imagePath;
+}
+
+void DatasetPackWriter::addFrom(const DatasetPack &pack, size_t i) {
+    add(pack.imagePath(i), pack.imageStamp(i), pack.xmlStamp(i), pack.sample(i));
+}
+
+bool DatasetPackWriter::save(const string &path, const string &params) const {
+    PackHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+    h.version = PACK_VERSION;
+    h.numEntries = entries.size();
+    h.entriesOffset = sizeof(PackHeader);
+    h.dataOffset = alignUp(h.entriesOffset + entries.size() * sizeof(PackEntry));
+    h.stringsOffset = h.dataOffset + data.size();
+    h.paramsLength = (uint32_t)params.size();
+    h.stringsSize = params.size() + paths.size();
+    h.fileSize = h.stringsOffset + h.stringsSize;
+
+    // Las rutas se desplazan detrás de los parámetros
+    vector<PackEntry> out = entries;
+    for (auto &e : out) e.pathOffset += params.size();
+
+    string tmpPath = path + ".tmp";
+    ofstream file(tmpPath, ios::binary | ios::trunc);
+    if (!file) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+    static const char zeros[PACK_ALIGN] = {0};
+    file.write((const char *)&h, sizeof(h));
+    file.write((const char *)out.data(), out.size() * sizeof(PackEntry));
+    uint64_t pos = (uint64_t)file.tellp();
+    if (h.dataOffset > pos) file.write(zeros, h.dataOffset - pos);
+    file.write((const char *)data.data(), data.size());
+    file.write(params.data(), params.size());
+    file.write(paths.data(), paths.size());
+    file.close();
+
+    if (!file) {
+        cerr << "[ERROR] Falló la escritura de " << tmpPath << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo renombrar " << tmpPath << " a " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// Lectura (mmap)
+//----------------------------------------------------------
+DatasetPack::~DatasetPack() {
+    close();
+}
+
+bool DatasetPack::open(const string &path, const string &params) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;  // sin paquete: se lee todo de las imágenes
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+        cerr << "[ERROR] Paquete de ROIs inválido: " << path << endl;
+        ::close(fd);
+        return false;
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        cerr << "[ERROR] Falló mmap sobre " << path << endl;
+        return false;
+    }
+
+    base = (const uchar *)mem;
+    mappedSize = st.st_size;
+    header = (const PackHeader *)base;
+
+    if (memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header->version != PACK_VERSION) {
+        cerr << "[ERROR] " << path << " no es un paquete de ROIs compatible." << endl;
+        close();
+        return false;
+    }
+    if (header->fileSize != mappedSize || !fitsIn(header->entriesOffset, header->numEntries, sizeof(PackEntry), mappedSize) ||
+        !fitsIn(header->stringsOffset, header->stringsSize, 1, mappedSize) || header->dataOffset > header->stringsOffset ||
+        header->paramsLength > header->stringsSize) {
+        cerr << "[ERROR] Paquete de ROIs truncado: " << path << endl;
+        close();
+        return false;
+    }
+
+    string packed((const char *)base + header->stringsOffset, header->paramsLength);
+    if (packed != params) {
+        cout << "[INFO] El paquete " << path << " se generó con otro preprocesado, se vuelve a crear." << endl;
+        close();
+        return false;
+    }
+
+    entries = (const PackEntry *)(base + header->entriesOffset);
+    if (!validEntries()) {
+        cerr << "[ERROR] Paquete de ROIs corrupto: " << path << endl;
+        close();
+        return false;
+    }
+    for (size_t i = 0; i < header->numEntries; i++) byPath[imagePath(i)].push_back(i);
+
+    // Las ROIs se leen una vez, en orden
+    madvise(mem, mappedSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+// Cada ruta debe caer dentro de las cadenas y los píxeles de cada ROI dentro del
+// bloque de píxeles; así imagePath() y sample() no leen fuera del archivo mapeado
+bool DatasetPack::validEntries() const {
+    uint64_t dataSize = header->stringsOffset - header->dataOffset;
+    for (uint64_t i = 0; i < header->numEntries; i++) {
+        const PackEntry &e = entries[i];
+        if (!fitsIn(e.pathOffset, e.pathLength, 1, header->stringsSize)) return false;
+        if (e.status < RoiSample::OK || e.status > RoiSample::TOO_SMALL) return false;
+        if (e.rows < 0 || e.cols < 0) return false;
+        if (e.rows == 0 || e.cols == 0) continue;  // sin píxeles
+        if (e.type != CV_8UC1 && e.type != CV_8UC3) return false;
+        uint64_t pixelBytes = (uint64_t)e.rows * e.cols * (e.type == CV_8UC3 ? 3 : 1);
+        if (!fitsIn(e.dataOffset, pixelBytes, 1, dataSize)) return false;
+    }
+    return true;
+}
+
+void DatasetPack::close() {
+    if (base) munmap((void *)base, mappedSize);
+    base = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    byPath.clear();
+}
+
+int DatasetPack::findFresh(const string &imagePath, const FileStamp &image, const FileStamp &xml,
+                           size_t object) const {
+    auto it = byPath.find(imagePath);
+    if (it == byPath.end() || object >= it->second.size()) return -1;
+    size_t i = it->second[object];
+    const PackEntry &e = entries[i];
+    bool same = e.imageSize == image.size && e.imageHash == image.hash &&
+                e.xmlSize == xml.size && e.xmlHash == xml.hash;
+    return same ? (int)i : -1;
+}
+
+RoiSample DatasetPack::sample(size_t i) const {
+    const PackEntry &e = entries[i];
+    RoiSample s;
+    s.status = (RoiSample::Status)e.status;
+    s.roi = Rect(e.roi[0], e.roi[1], e.roi[2], e.roi[3]);
+    s.reduction = e.reduction;
+    if (e.rows > 0 && e.cols > 0) {
+        s.pixels = Mat(e.rows, e.cols, e.type, (void *)(base + header->dataOffset + e.dataOffset));
+    }
+    return s;
+}
+
+string DatasetPack::imagePath(size_t i) const {
+    const PackEntry &e = entries[i];
+    return string((const char *)base + header->stringsOffset + e.pathOffset, e.pathLength);
+}
+
+FileStamp DatasetPack::imageStamp(size_t i) const {
+    const PackEntry &e = entries[i];
+    FileStamp s;
+    s.size = e.imageSize;
+    s.mtime = e.imageMtime;
+    s.hash = e.imageHash;
+    return s;
+}
+
+FileStamp DatasetPack::xmlStamp(size_t i) const {
+    const PackEntry &e = entries[i];
+    FileStamp s;
+    s.size = e.xmlSize;
+    s.mtime = e.xmlMtime;
+    s.hash = e.xmlHash;
+    return s;
+}
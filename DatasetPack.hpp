@@ -0,0 +1,111 @@
+#ifndef DATASET_PACK_HPP
+#define DATASET_PACK_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DatasetLoader.hpp"
+#include "Manifest.hpp"
+
+// Paquete con las ROIs del dataset ya recortadas y preprocesadas, para no
+// volver a decodificar miles de JPEG en cada experimento.
+//
+// Estructura del archivo (little-endian):
+//   PackHeader
+//   PackEntry[numEntries]   una por objeto anotado (las de una imagen van seguidas):
+//                           sellos de la imagen y del XML, ROI, formato
+//   píxeles                 bloque contiguo, cada ROI alineada a 64 bytes
+//   cadenas                 parámetros del preprocesado + rutas, sin terminador
+//
+// Cada entrada guarda el tamaño, la fecha y el hash de la imagen y de su XML
+// (los mismos sellos que el manifiesto): si alguno cambió, la ROI se vuelve a
+// leer de la imagen. El paquete entero se descarta si el preprocesado es otro.
+// El lector mapea el archivo y entrega los píxeles sin copiarlos.
+
+static const char PACK_MAGIC[4] = {'V', 'P', 'A', 'K'};
+static const uint32_t PACK_VERSION = 1;
+
+#pragma pack(push, 1)
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t numEntries;
+    uint64_t entriesOffset;
+    uint64_t dataOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint32_t paramsLength;      // los parámetros van al principio de las cadenas
+    uint64_t fileSize;
+};
+
+struct PackEntry {
+    uint64_t imageSize, xmlSize;
+    int64_t imageMtime, xmlMtime;
+    uint64_t imageHash, xmlHash;
+    int32_t status;             // RoiSample::Status
+    int32_t roi[4];             // x, y, width, height en resolución completa
+    int32_t reduction;
+    int32_t rows, cols, type;
+    uint64_t dataOffset;        // relativo al bloque de píxeles
+    uint64_t pathOffset;
+    uint32_t pathLength;
+};
+#pragma pack(pop)
+
+class DatasetPack;
+
+// Acumula las ROIs en memoria y escribe el paquete al final
+class DatasetPackWriter {
+public:
+    void add(const std::string &imagePath, const FileStamp &image, const FileStamp &xml, const RoiSample &sample);
+    // Copia tal cual la entrada i de otro paquete
+    void addFrom(const DatasetPack &pack, size_t i);
+
+    // Escribe a un archivo temporal y lo renombra
+    bool save(const std::string &path, const std::string &params) const;
+
+    size_t size() const { return entries.size(); }
+
+private:
+    std::vector<PackEntry> entries;
+    std::vector<uchar> data;
+    std::string paths;
+};
+
+// Lector de solo lectura sobre el archivo mapeado en memoria
+class DatasetPack {
+public:
+    DatasetPack() = default;
+    ~DatasetPack();
+    DatasetPack(const DatasetPack &) = delete;
+    DatasetPack &operator=(const DatasetPack &) = delete;
+
+    // Abre el paquete solo si fue generado con esos parámetros de preprocesado
+    bool open(const std::string &path, const std::string &params);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return isOpen() ? (size_t)header->numEntries : 0; }
+
+    // Entrada del objeto "object" de la imagen si ni ella ni su XML cambiaron desde que se
+    // empaquetó (-1 si no)
+    int findFresh(const std::string &imagePath, const FileStamp &image, const FileStamp &xml, size_t object = 0) const;
+
+    // ROI de la entrada i; los píxeles apuntan al archivo mapeado (no se deben modificar)
+    RoiSample sample(size_t i) const;
+    std::string imagePath(size_t i) const;
+    FileStamp imageStamp(size_t i) const;
+    FileStamp xmlStamp(size_t i) const;
+
+private:
+    bool validEntries() const;
+
+    const uchar *base = nullptr;
+    size_t mappedSize = 0;
+    const PackHeader *header = nullptr;
+    const PackEntry *entries = nullptr;
+    std::unordered_map<std::string, std::vector<size_t>> byPath;
+};
+
+#endif
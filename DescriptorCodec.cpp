@@ -0,0 +1,147 @@
+#include "DescriptorCodec.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+namespace fs = std::filesystem;
+
+bool DescriptorCodec::fit(const Mat &samples, int pcaDims, bool quantize) {
+    pca = PCA();
+    quantized = false;
+    offset = 0;
+    scale = 1;
+    if (samples.empty() || samples.type() != CV_32F) {
+        cerr << "[ERROR] El códec de descriptores requiere una muestra CV_32F." << endl;
+        return false;
+    }
+
+    Mat projected = samples;
+    if (pcaDims > 0) {
+        if (pcaDims >= samples.cols || samples.rows < pcaDims) {
+            cerr << "[ERROR] PCA a " << pcaDims << " dimensiones no es posible con " << samples.rows
+                 << " descriptores de " << samples.cols << " dimensiones." << endl;
+            return false;
+        }
+        pca = PCA(samples, noArray(), PCA::DATA_AS_ROW, pcaDims);
+        pca.project(samples, projected);
+    }
+
+    if (quantize) {
+        double minVal, maxVal;
+        minMaxLoc(projected, &minVal, &maxVal);
+        if (!usesPCA() && minVal >= 0 && maxVal <= 255) {
+            // Ya caben en un byte (SIFT): conversión exacta
+            offset = 0;
+            scale = 1;
+        } else {
+            offset = minVal;
+            scale = maxVal > minVal ? 255.0 / (maxVal - minVal) : 1.0;
+        }
+        quantized = true;
+    }
+    return true;
+}
+
+void DescriptorCodec::encode(const Mat &descriptors, Mat &encoded) const {
+    if (descriptors.empty() || identity()) {
+        encoded = descriptors;
+        return;
+    }
+    CV_Assert(descriptors.type() == CV_32F);
+
+    Mat projected = descriptors;
+    if (usesPCA()) pca.project(descriptors, projected);
+
+    if (quantized) {
+        // convertTo satura a [0, 255]: los valores fuera del rango de la muestra se recortan
+        projected.convertTo(encoded, CV_8U, scale, -offset * scale);
+    } else {
+        encoded = projected;
+    }
+}
+
+bool DescriptorCodec::save(const string &path) const {
+    string tmpPath = path + ".tmp";
+    {
+        FileStorage out(tmpPath, FileStorage::WRITE | FileStorage::FORMAT_YAML);
+        if (!out.isOpened()) {
+            cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+            return false;
+        }
+        out << "pca_dims" << (usesPCA() ? pca.eigenvectors.rows : 0);
+        if (usesPCA()) {
+            out << "pca_mean" << pca.mean;
+            out << "pca_eigenvectors" << pca.eigenvectors;
+        }
+        out << "quantized" << (int)quantized;
+        out << "offset" << offset;
+        out << "scale" << scale;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo renombrar " << tmpPath << " a " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool DescriptorCodec::load(const string &path) {
+    pca = PCA();
+    quantized = false;
+    offset = 0;
+    scale = 1;
+
+    FileStorage in(path, FileStorage::READ);
+    if (!in.isOpened()) {
+        cerr << "[ERROR] No se pudo leer el códec " << path << endl;
+        return false;
+    }
+    int pcaDims = 0, q = 0;
+    in["pca_dims"] >> pcaDims;
+    if (pcaDims > 0) {
+        in["pca_mean"] >> pca.mean;
+        in["pca_eigenvectors"] >> pca.eigenvectors;
+        if (pca.mean.empty() || pca.eigenvectors.rows != pcaDims || pca.eigenvectors.cols != pca.mean.cols) {
+            cerr << "[ERROR] Proyección PCA inválida en " << path << endl;
+            pca = PCA();
+            return false;
+        }
+    }
+    in["quantized"] >> q;
+    in["offset"] >> offset;
+    in["scale"] >> scale;
+    quantized = q != 0;
+    return true;
+}
+
+string codecOptions(int pcaDims, bool quantize) {
+    string options;
+    if (pcaDims > 0) options += "; pca=" + to_string(pcaDims);
+    if (quantize) options += "; uint8";
+    return options;
+}
+
+string codecPathFor(const string &dbPath) {
+    return dbPath + ".codec.yml";
+}
+
+bool loadCodecFor(const DescriptorDB &db, const string &dbPath, DescriptorCodec &codec) {
+    codec = DescriptorCodec();
+    string path = codecPathFor(dbPath);
+    if (!fs::exists(path)) {
+        if (db.descriptorType() == CV_32F || isBinaryBackend(db.featureBackend())) return true;
+        cerr << "[ERROR] La base " << dbPath << " tiene descriptores comprimidos pero falta " << path << endl;
+        return false;
+    }
+    if (!codec.load(path)) return false;
+
+    if (codec.outputType() != db.descriptorType() || codec.outputCols(db.descriptorCols()) != db.descriptorCols()) {
+        cerr << "[ERROR] El códec " << path << " no corresponde a la base de descriptores." << endl;
+        codec = DescriptorCodec();
+        return false;
+    }
+    return true;
+}
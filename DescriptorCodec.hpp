@@ -0,0 +1,55 @@
+#ifndef DESCRIPTOR_CODEC_HPP
+#define DESCRIPTOR_CODEC_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "DescriptorDB.hpp"
+
+// Formato compacto de los descriptores float (SIFT, SURF) dentro de la base.
+//
+//   cuantización  cada valor se guarda en un byte: q = round((x - offset) * scale).
+//                 La escala es la misma para todas las dimensiones, así las
+//                 distancias L2 solo cambian por un factor constante y el test de
+//                 Lowe no se ve afectado. SIFT ya entrega enteros de 0 a 255, con
+//                 lo que la conversión es exacta (offset 0, escala 1).
+//   PCA           proyección aprendida a pcaDims dimensiones (32 o 64) antes de
+//                 cuantizar.
+//
+// El códec se guarda junto a la base (<db>.codec.yml) y los programas de
+// consulta lo aplican a los descriptores de la imagen de test antes de compararlos.
+// Sin archivo de códec la base guarda los descriptores tal cual (CV_32F).
+class DescriptorCodec {
+public:
+    // Ajusta la proyección (pcaDims = 0: sin PCA) y la cuantización con una muestra CV_32F
+    bool fit(const cv::Mat &samples, int pcaDims, bool quantize);
+
+    // Descriptores del extractor (CV_32F) -> formato de la base. Sin códec es una copia superficial.
+    void encode(const cv::Mat &descriptors, cv::Mat &encoded) const;
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    bool identity() const { return pca.mean.empty() && !quantized; }
+    bool usesPCA() const { return !pca.mean.empty(); }
+    bool usesQuantization() const { return quantized; }
+    int outputCols(int inputCols) const { return usesPCA() ? pca.eigenvectors.rows : inputCols; }
+    int outputType() const { return quantized ? CV_8U : CV_32F; }
+
+private:
+    cv::PCA pca;                // mean vacío: sin proyección
+    bool quantized = false;
+    double offset = 0;
+    double scale = 1;
+};
+
+// Opciones del códec en texto (para el manifiesto del entrenamiento)
+std::string codecOptions(int pcaDims, bool quantize);
+
+// Ruta del códec que acompaña a una base de descriptores
+std::string codecPathFor(const std::string &dbPath);
+
+// Carga el códec de la base (identidad si no existe) y comprueba que el formato
+// que produce coincide con el de la base
+bool loadCodecFor(const DescriptorDB &db, const std::string &dbPath, DescriptorCodec &codec);
+
+#endif
@@ -0,0 +1,317 @@
+#include "DescriptorDB.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+
+static const uint64_t DB_ALIGN = 64;
+
+// Las cabeceras de las versiones 1 y 2 terminan antes de backend y contentHash
+static const size_t DB_HEADER_V1_SIZE = offsetof(DBHeader, backend);
+static const size_t DB_HEADER_V2_SIZE = offsetof(DBHeader, contentHash);
+
+static const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+
+static uint64_t fnv1a(const void *data, size_t size, uint64_t h = FNV_OFFSET) {
+    const uchar *p = (const uchar *)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t alignUp(uint64_t v) {
+    return (v + DB_ALIGN - 1) & ~(DB_ALIGN - 1);
+}
+
+// offset + count * itemSize <= limit, sin desbordar
+static bool fitsIn(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit) {
+    if (offset > limit) return false;
+    return itemSize == 0 || count <= (limit - offset) / itemSize;
+}
+
+//----------------------------------------------------------
+// Escritura
+//----------------------------------------------------------
+bool DescriptorDBWriter::add(const string &imagePath, const Rect &bbox,
+                             const vector<KeyPoint> &keypoints, const Mat &descriptors) {
+    if (descriptors.empty()) return false;
+    if (descriptors.type() != CV_32F && descriptors.type() != CV_8U) {
+        cerr << "[ERROR] Tipo de descriptor no soportado en " << imagePath << endl;
+        return false;
+    }
+    if (descType == -1) {
+        descType = descriptors.type();
+        descCols = descriptors.cols;
+    } else if (descType != descriptors.type() || descCols != descriptors.cols) {
+        cerr << "[ERROR] Los descriptores de " << imagePath << " no coinciden con el formato de la base." << endl;
+        return false;
+    }
+
+    DBEntry e;
+    e.descRow = descData.size() / (descCols * descriptors.elemSize());
+    e.descCount = (uint32_t)descriptors.rows;
+    e.bbox[0] = bbox.x;
+    e.bbox[1] = bbox.y;
+    e.bbox[2] = bbox.width;
+    e.bbox[3] = bbox.height;
+    e.kpFirst = keypointData.size();
+    e.kpCount = (uint32_t)keypoints.size();
+    e.pathOffset = strings.size();
+    e.pathLength = (uint32_t)imagePath.size();
+    entries.push_back(e);
+
+    size_t rowBytes = descCols * descriptors.elemSize();
+    for (int r = 0; r < descriptors.rows; r++) {
+        const uchar *row = descriptors.ptr(r);
+        descData.insert(descData.end(), row, row + rowBytes);
+    }
+
+    for (const auto &k : keypoints) {
+        keypointData.push_back({k.pt.x, k.pt.y, k.size, k.angle, k.response, k.octave});
+    }
+
+    strings += imagePath;
+    return true;
+}
+
+bool DescriptorDBWriter::addFrom(const DescriptorDB &db, size_t i) {
+    return add(db.imagePath(i), db.bbox(i), db.keyPointsOf(i), db.descriptors(i));
+}
+
+bool DescriptorDBWriter::save(const string &path) const {
+    DBHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DB_MAGIC, sizeof(h.magic));
+    h.version = DB_VERSION;
+    h.descType = descType == -1 ? CV_32F : descType;
+    h.descCols = descCols;
+    h.numEntries = entries.size();
+    h.numKeypoints = keypointData.size();
+    size_t rowBytes = descCols * (h.descType == CV_32F ? sizeof(float) : 1);
+    h.numRows = rowBytes ? descData.size() / rowBytes : 0;
+
+    h.entriesOffset = sizeof(DBHeader);
+    h.descOffset = alignUp(h.entriesOffset + entries.size() * sizeof(DBEntry));
+    h.kpOffset = alignUp(h.descOffset + descData.size());
+    h.stringsOffset = h.kpOffset + keypointData.size() * sizeof(DBKeypoint);
+    h.stringsSize = strings.size();
+    h.fileSize = h.stringsOffset + h.stringsSize;
+    h.backend = backend;
+    h.contentHash = fnv1a(entries.data(), entries.size() * sizeof(DBEntry));
+    h.contentHash = fnv1a(descData.data(), descData.size(), h.contentHash);
+    h.contentHash = fnv1a(keypointData.data(), keypointData.size() * sizeof(DBKeypoint), h.contentHash);
+    h.contentHash = fnv1a(strings.data(), strings.size(), h.contentHash);
+
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+
+    auto padTo = [&out](uint64_t offset) {
+        static const char zeros[DB_ALIGN] = {0};
+        uint64_t pos = (uint64_t)out.tellp();
+        if (offset > pos) out.write(zeros, offset - pos);
+    };
+
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)entries.data(), entries.size() * sizeof(DBEntry));
+    padTo(h.descOffset);
+    out.write((const char *)descData.data(), descData.size());
+    padTo(h.kpOffset);
+    out.write((const char *)keypointData.data(), keypointData.size() * sizeof(DBKeypoint));
+    out.write(strings.data(), strings.size());
+    out.close();
+
+    if (!out) {
+        cerr << "[ERROR] Falló la escritura de " << tmpPath << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo renombrar " << tmpPath << " a " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// Lectura (mmap)
+//----------------------------------------------------------
+DescriptorDB::~DescriptorDB() {
+    close();
+}
+
+bool DescriptorDB::open(const string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "[ERROR] No se pudo abrir " << path << endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < DB_HEADER_V1_SIZE) {
+        cerr << "[ERROR] Archivo de descriptores inválido: " << path << endl;
+        ::close(fd);
+        return false;
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        cerr << "[ERROR] Falló mmap sobre " << path << endl;
+        return false;
+    }
+
+    base = (const uchar *)mem;
+    mappedSize = st.st_size;
+    header = (const DBHeader *)base;
+
+    if (memcmp(header->magic, DB_MAGIC, sizeof(DB_MAGIC)) != 0 || header->version < 1 || header->version > DB_VERSION) {
+        cerr << "[ERROR] " << path << " no es una base de descriptores compatible (versión "
+             << header->version << ", se esperaba de 1 a " << DB_VERSION << ")." << endl;
+        close();
+        return false;
+    }
+    if (header->fileSize != mappedSize ||
+        (header->version == 2 && mappedSize < DB_HEADER_V2_SIZE) ||
+        (header->version >= 3 && mappedSize < sizeof(DBHeader)) ||
+        !fitsIn(header->entriesOffset, header->numEntries, sizeof(DBEntry), mappedSize)) {
+        cerr << "[ERROR] Archivo de descriptores truncado: " << path << endl;
+        close();
+        return false;
+    }
+
+    entries = (const DBEntry *)(base + header->entriesOffset);
+    if (!validate()) {
+        cerr << "[ERROR] Archivo de descriptores corrupto: " << path << endl;
+        close();
+        return false;
+    }
+
+    if (header->version >= 3) {
+        stamp = header->contentHash;
+    } else {
+        int64_t mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        stamp = fnv1a(&mtime, sizeof(mtime), fnv1a(&header->fileSize, sizeof(header->fileSize)));
+    }
+
+    // Se recorren los descriptores de forma secuencial al cargar el índice
+    madvise(mem, mappedSize, MADV_WILLNEED);
+    return true;
+}
+
+// Cada sección y cada ROI deben caer dentro del archivo mapeado; así descriptors(),
+// keypoints() e imagePath() no necesitan volver a comprobar nada
+bool DescriptorDB::validate() const {
+    const DBHeader &h = *header;
+    if (h.descType != CV_32F && h.descType != CV_8U) return false;
+    if (h.descCols < 0 || (h.descCols == 0 && h.numRows > 0)) return false;
+    if (h.numRows > (uint64_t)INT_MAX) return false;  // filas de un cv::Mat
+
+    uint64_t rowBytes = (uint64_t)h.descCols * (h.descType == CV_32F ? sizeof(float) : 1);
+    if (!fitsIn(h.descOffset, h.numRows, rowBytes, mappedSize) ||
+        !fitsIn(h.kpOffset, h.numKeypoints, sizeof(DBKeypoint), mappedSize) ||
+        !fitsIn(h.stringsOffset, h.stringsSize, 1, mappedSize)) {
+        return false;
+    }
+    if (h.descOffset % alignof(float) != 0 || h.kpOffset % alignof(float) != 0) return false;
+
+    uint64_t previousRow = 0;
+    for (uint64_t i = 0; i < h.numEntries; i++) {
+        const DBEntry &e = entries[i];
+        // entryForRow hace una búsqueda binaria: las filas deben estar en orden
+        if (e.descRow < previousRow || !fitsIn(e.descRow, e.descCount, 1, h.numRows) ||
+            !fitsIn(e.kpFirst, e.kpCount, 1, h.numKeypoints) ||
+            !fitsIn(e.pathOffset, e.pathLength, 1, h.stringsSize)) {
+            return false;
+        }
+        previousRow = e.descRow;
+    }
+    return true;
+}
+
+void DescriptorDB::close() {
+    if (base) munmap((void *)base, mappedSize);
+    base = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    stamp = 0;
+}
+
+FeatureBackend DescriptorDB::featureBackend() const {
+    return header->version >= 2 ? (FeatureBackend)header->backend : FEATURE_SIFT;
+}
+
+Mat DescriptorDB::descriptors(size_t i) const {
+    const DBEntry &e = entries[i];
+    size_t rowBytes = header->descCols * (header->descType == CV_32F ? sizeof(float) : 1);
+    const uchar *ptr = base + header->descOffset + e.descRow * rowBytes;
+    return Mat((int)e.descCount, header->descCols, header->descType, (void *)ptr);
+}
+
+Mat DescriptorDB::allDescriptors() const {
+    return Mat((int)header->numRows, header->descCols, header->descType,
+               (void *)(base + header->descOffset));
+}
+
+Rect DescriptorDB::bbox(size_t i) const {
+    const DBEntry &e = entries[i];
+    return Rect(e.bbox[0], e.bbox[1], e.bbox[2], e.bbox[3]);
+}
+
+string DescriptorDB::imagePath(size_t i) const {
+    const DBEntry &e = entries[i];
+    return string((const char *)base + header->stringsOffset + e.pathOffset, e.pathLength);
+}
+
+const DBKeypoint *DescriptorDB::keypoints(size_t i) const {
+    return (const DBKeypoint *)(base + header->kpOffset) + entries[i].kpFirst;
+}
+
+vector<KeyPoint> DescriptorDB::keyPointsOf(size_t i) const {
+    const DBKeypoint *kp = keypoints(i);
+    vector<KeyPoint> out;
+    out.reserve(entries[i].kpCount);
+    for (uint32_t k = 0; k < entries[i].kpCount; k++) {
+        out.push_back(KeyPoint(kp[k].x, kp[k].y, kp[k].size, kp[k].angle, kp[k].response, kp[k].octave));
+    }
+    return out;
+}
+
+vector<Point2f> DescriptorDB::keypointCoords(size_t i) const {
+    const DBKeypoint *kp = keypoints(i);
+    vector<Point2f> out;
+    out.reserve(entries[i].kpCount);
+    for (uint32_t k = 0; k < entries[i].kpCount; k++) {
+        out.push_back(Point2f(kp[k].x, kp[k].y));
+    }
+    return out;
+}
+
+size_t DescriptorDB::entryForRow(size_t row) const {
+    // Las ROIs están guardadas en orden de fila, basta una búsqueda binaria
+    const DBEntry *first = entries;
+    const DBEntry *last = entries + header->numEntries;
+    const DBEntry *it = upper_bound(first, last, (uint64_t)row,
+                                    [](uint64_t r, const DBEntry &e) { return r < e.descRow; });
+    return (size_t)(it - first) - 1;
+}
@@ -0,0 +1,146 @@
+#ifndef DESCRIPTOR_DB_HPP
+#define DESCRIPTOR_DB_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FeatureBackend.hpp"
+
+// Base de datos binaria de descriptores (reemplaza a los .yml de FileStorage).
+//
+// Estructura del archivo (little-endian, versión 3):
+//   DBHeader
+//   DBEntry[numEntries]         tabla de ROIs (offsets, bbox, ruta, keypoints)
+//   descriptores                bloque contiguo numRows x descCols (alineado a 64 bytes)
+//   DBKeypoint[numKeypoints]    keypoints de todas las ROIs, en orden
+//   cadenas                     rutas de las imágenes, sin terminador
+//
+// Al abrir se comprueba que cada sección y cada ROI caigan dentro del archivo;
+// una base truncada o corrupta no se abre.
+//
+// El lector mapea el archivo con mmap y entrega los descriptores como cv::Mat
+// que apuntan directamente a la memoria mapeada (sin copias). Varios procesos
+// que abren la misma base comparten las páginas en memoria.
+//
+// La versión 2 agrega al final de la cabecera el extractor con el que se
+// generaron los descriptores; las bases de la versión 1 se leen como SIFT.
+// La versión 3 agrega un hash del contenido, con el que el índice FLANN y el
+// vocabulario reconocen la base para la que se construyeron.
+
+static const char DB_MAGIC[4] = {'V', 'C', 'D', 'B'};
+static const uint32_t DB_VERSION = 3;
+
+#pragma pack(push, 1)
+struct DBHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t descType;       // CV_32F o CV_8U
+    int32_t descCols;
+    uint64_t numEntries;
+    uint64_t numRows;       // total de filas de descriptores
+    uint64_t numKeypoints;
+    uint64_t entriesOffset;
+    uint64_t descOffset;
+    uint64_t kpOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fileSize;
+    int32_t backend;        // FeatureBackend (desde la versión 2)
+    uint64_t contentHash;   // FNV-1a de entradas, descriptores, keypoints y rutas (desde la versión 3)
+};
+
+struct DBEntry {
+    uint64_t descRow;       // primera fila dentro del bloque de descriptores
+    uint32_t descCount;
+    int32_t bbox[4];        // x, y, width, height
+    uint64_t kpFirst;
+    uint32_t kpCount;
+    uint64_t pathOffset;
+    uint32_t pathLength;
+};
+
+struct DBKeypoint {
+    float x, y, size, angle, response;
+    int32_t octave;
+};
+#pragma pack(pop)
+
+class DescriptorDB;
+
+// Acumula las ROIs en memoria y escribe el archivo completo al final
+class DescriptorDBWriter {
+public:
+    // Agrega una ROI; los descriptores deben tener el mismo tipo y columnas que los anteriores
+    bool add(const std::string &imagePath, const cv::Rect &bbox,
+             const std::vector<cv::KeyPoint> &keypoints, const cv::Mat &descriptors);
+    // Copia tal cual la ROI i de otra base (entrenamiento incremental)
+    bool addFrom(const DescriptorDB &db, size_t i);
+
+    // Escribe a un archivo temporal y lo renombra, así los lectores nunca ven un archivo a medias
+    bool save(const std::string &path) const;
+
+    size_t size() const { return entries.size(); }
+
+    // Extractor con el que se generaron los descriptores (por defecto SIFT)
+    void setBackend(FeatureBackend b) { backend = b; }
+
+private:
+    FeatureBackend backend = FEATURE_SIFT;
+    int descType = -1;
+    int descCols = 0;
+    std::vector<DBEntry> entries;
+    std::vector<uchar> descData;
+    std::vector<DBKeypoint> keypointData;
+    std::string strings;
+};
+
+// Lector de solo lectura sobre el archivo mapeado en memoria
+class DescriptorDB {
+public:
+    DescriptorDB() = default;
+    ~DescriptorDB();
+    DescriptorDB(const DescriptorDB &) = delete;
+    DescriptorDB &operator=(const DescriptorDB &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    size_t size() const { return isOpen() ? (size_t)header->numEntries : 0; }
+    size_t totalRows() const { return isOpen() ? (size_t)header->numRows : 0; }
+    int descriptorType() const { return isOpen() ? header->descType : -1; }
+    int descriptorCols() const { return isOpen() ? header->descCols : 0; }
+    FeatureBackend featureBackend() const;
+    // Identifica el contenido de la base: el hash guardado o, en bases anteriores a
+    // la versión 3, tamaño y fecha de modificación del archivo
+    uint64_t fingerprint() const { return isOpen() ? stamp : 0; }
+
+    // Vista (sin copia) de los descriptores de la ROI i. No se debe escribir en ella.
+    cv::Mat descriptors(size_t i) const;
+    // Vista de todos los descriptores concatenados (numRows x descCols)
+    cv::Mat allDescriptors() const;
+
+    cv::Rect bbox(size_t i) const;
+    std::string imagePath(size_t i) const;
+    const DBKeypoint *keypoints(size_t i) const;
+    size_t keypointCount(size_t i) const { return entry(i).kpCount; }
+    std::vector<cv::KeyPoint> keyPointsOf(size_t i) const;
+    std::vector<cv::Point2f> keypointCoords(size_t i) const;
+
+    // Fila global del bloque de descriptores -> índice de la ROI a la que pertenece
+    size_t entryForRow(size_t row) const;
+
+    const DBEntry &entry(size_t i) const { return entries[i]; }
+
+private:
+    bool validate() const;
+
+    const uchar *base = nullptr;
+    size_t mappedSize = 0;
+    const DBHeader *header = nullptr;
+    const DBEntry *entries = nullptr;
+    uint64_t stamp = 0;
+};
+
+#endif
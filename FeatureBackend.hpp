@@ -0,0 +1,107 @@
+#ifndef FEATURE_BACKEND_HPP
+#define FEATURE_BACKEND_HPP
+
+#include <opencv2/features2d.hpp>
+#include <opencv2/xfeatures2d.hpp>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Extractor de características seleccionable al entrenar y al probar.
+//
+//   sift, surf           descriptores float (CV_32F): distancia L2, índice KD-tree
+//   orb, akaze, brisk    descriptores binarios (CV_8U): distancia de Hamming,
+//                        índice LSH multi-probe o fuerza bruta con popcount
+//
+// La base de descriptores guarda el extractor con el que se generó, así los
+// programas de consulta usan el mismo sin tener que indicarlo.
+enum FeatureBackend : int32_t {
+    FEATURE_SIFT = 0,
+    FEATURE_ORB = 1,
+    FEATURE_AKAZE = 2,
+    FEATURE_BRISK = 3,
+    FEATURE_SURF = 4,
+};
+
+inline const char *featureBackendName(FeatureBackend backend) {
+    switch (backend) {
+        case FEATURE_SIFT: return "sift";
+        case FEATURE_ORB: return "orb";
+        case FEATURE_AKAZE: return "akaze";
+        case FEATURE_BRISK: return "brisk";
+        case FEATURE_SURF: return "surf";
+    }
+    return "desconocido";
+}
+
+inline bool parseFeatureBackend(const std::string &name, FeatureBackend &backend) {
+    for (int b = FEATURE_SIFT; b <= FEATURE_SURF; b++) {
+        if (name == featureBackendName((FeatureBackend)b)) {
+            backend = (FeatureBackend)b;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parámetros con los que se crea cada extractor (se guardan en el manifiesto del entrenamiento)
+inline std::string featureBackendParams(FeatureBackend backend) {
+    switch (backend) {
+        case FEATURE_ORB: return "ORB nfeatures=2000";
+        case FEATURE_AKAZE: return "AKAZE defaults";
+        case FEATURE_BRISK: return "BRISK thresh=30 octaves=3";
+        case FEATURE_SURF: return "SURF hessianThreshold=100";
+        case FEATURE_SIFT: break;
+    }
+    return "SIFT nfeatures=0 nOctaveLayers=3 contrastThreshold=0.04 edgeThreshold=10 sigma=1.6";
+}
+
+inline bool isBinaryBackend(FeatureBackend backend) {
+    return backend == FEATURE_ORB || backend == FEATURE_AKAZE || backend == FEATURE_BRISK;
+}
+
+// Nombre por defecto de la base de descriptores: "<prefijo>sift_descriptors.vdb",
+// "<prefijo>orb_descriptors.vdb", ... así una base ORB no pisa a la de SIFT
+inline std::string defaultDescriptorDb(FeatureBackend backend, const std::string &prefix = "") {
+    return prefix + featureBackendName(backend) + "_descriptors.vdb";
+}
+
+// Norma con la que se comparan los descriptores del extractor
+inline int featureNorm(FeatureBackend backend) {
+    return isBinaryBackend(backend) ? cv::NORM_HAMMING : cv::NORM_L2;
+}
+
+// Crea el extractor. ORB se limita por defecto a 500 puntos; se sube para
+// acercarse a la cantidad que entrega SIFT sobre las ROIs del dataset.
+inline cv::Ptr<cv::Feature2D> createFeatureExtractor(FeatureBackend backend) {
+    using namespace cv;
+    using namespace cv::xfeatures2d;
+    switch (backend) {
+        case FEATURE_ORB: return ORB::create(2000);
+        case FEATURE_AKAZE: return AKAZE::create();
+        case FEATURE_BRISK: return BRISK::create();
+        case FEATURE_SURF: return SURF::create();
+        case FEATURE_SIFT: break;
+    }
+    return SIFT::create();
+}
+
+// Matcher de fuerza bruta con la norma del extractor (popcount para los binarios)
+inline cv::Ptr<cv::DescriptorMatcher> createFeatureMatcher(FeatureBackend backend) {
+    return cv::makePtr<cv::BFMatcher>(featureNorm(backend));
+}
+
+// Lee la opción "--features NOMBRE" de la línea de comandos; si falta o no es
+// válida se devuelve el extractor por defecto
+inline FeatureBackend parseFeaturesArg(int argc, char *argv[], FeatureBackend defaultBackend = FEATURE_SIFT) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) != "--features") continue;
+        FeatureBackend backend;
+        if (parseFeatureBackend(argv[i + 1], backend)) return backend;
+        std::cerr << "[ERROR] Extractor desconocido: " << argv[i + 1]
+                  << " (sift, surf, orb, akaze, brisk). Se usa " << featureBackendName(defaultBackend) << "." << std::endl;
+    }
+    return defaultBackend;
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include "GlobalIndex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "Metrics.hpp"
+
+using namespace std;
+using namespace cv;
+namespace fs = std::filesystem;
+
+// Mismos parámetros que el FlannBasedMatcher por defecto
+static const int KDTREE_TREES = 4;
+static const int SEARCH_CHECKS = 32;
+
+// LSH para descriptores binarios: tablas, bits de la clave y nivel de multi-probe
+static const int LSH_TABLES = 12;
+static const int LSH_KEY_SIZE = 20;
+static const int LSH_MULTI_PROBE = 2;
+
+// Base para la que se construyó un índice guardado
+static const char STAMP_MAGIC[4] = {'V', 'C', 'I', 'X'};
+
+#pragma pack(push, 1)
+struct IndexStamp {
+    char magic[4];
+    uint64_t rows;
+    uint64_t fingerprint;
+};
+#pragma pack(pop)
+
+static string stampPathFor(const string &indexPath) {
+    return indexPath + ".stamp";
+}
+
+static Ptr<flann::Index> createIndex(const Mat &data, bool binary) {
+    if (binary) {
+        return makePtr<flann::Index>(data, flann::LshIndexParams(LSH_TABLES, LSH_KEY_SIZE, LSH_MULTI_PROBE),
+                                     cvflann::FLANN_DIST_HAMMING);
+    }
+    return makePtr<flann::Index>(data, flann::KDTreeIndexParams(KDTREE_TREES));
+}
+
+// Datos del índice: vista directa sobre la base, salvo los descriptores float
+// cuantizados a CV_8U (DescriptorCodec), que el KD-tree necesita en CV_32F
+static Mat indexData(const DescriptorDB &db, bool binary) {
+    Mat all = db.allDescriptors();
+    if (binary || all.type() == CV_32F) return all;
+    Mat converted;
+    all.convertTo(converted, CV_32F);
+    return converted;
+}
+
+void GlobalIndex::setRowMapping(const vector<int> &rowsPerImage) {
+    rowStart.clear();
+    int row = 0;
+    for (int n : rowsPerImage) {
+        rowStart.push_back(row);
+        row += n;
+    }
+}
+
+int GlobalIndex::imageForRow(int row) const {
+    auto it = upper_bound(rowStart.begin(), rowStart.end(), row);
+    return (int)(it - rowStart.begin()) - 1;
+}
+
+bool GlobalIndex::build(const DescriptorDB &db) {
+    if (!db.isOpen() || db.totalRows() == 0) return false;
+
+    vector<int> rowsPerImage;
+    for (size_t i = 0; i < db.size(); i++) rowsPerImage.push_back(db.entry(i).descCount);
+    setRowMapping(rowsPerImage);
+
+    binary = isBinaryBackend(db.featureBackend());
+    data = indexData(db, binary);
+    index = createIndex(data, binary);
+    dbFingerprint = db.fingerprint();
+    return true;
+}
+
+bool GlobalIndex::build(const vector<Mat> &descriptorsPerImage) {
+    vector<int> rowsPerImage;
+    vector<Mat> nonEmpty;
+    for (const auto &d : descriptorsPerImage) {
+        rowsPerImage.push_back(d.rows);
+        if (!d.empty()) nonEmpty.push_back(d);
+    }
+    if (nonEmpty.empty()) return false;
+    setRowMapping(rowsPerImage);
+
+    vconcat(nonEmpty, data);
+    binary = data.type() == CV_8U;
+    index = createIndex(data, binary);
+    dbFingerprint = 0;
+    return true;
+}
+
+bool GlobalIndex::save(const string &path) const {
+    if (!index) return false;
+    index->save(path);
+
+    IndexStamp stamp;
+    memcpy(stamp.magic, STAMP_MAGIC, sizeof(stamp.magic));
+    stamp.rows = (uint64_t)data.rows;
+    stamp.fingerprint = dbFingerprint;
+    string stampPath = stampPathFor(path), tmpPath = stampPath + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    out.write((const char *)&stamp, sizeof(stamp));
+    out.close();
+    if (!out || rename(tmpPath.c_str(), stampPath.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo escribir " << stampPath << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool GlobalIndex::load(const DescriptorDB &db, const string &path) {
+    if (!db.isOpen()) return false;
+    if (!fs::exists(path)) return false;
+
+    // FLANN solo detecta otra cantidad de filas o columnas: la huella distingue una base
+    // distinta (o reentrenada) con las mismas dimensiones
+    IndexStamp stamp;
+    ifstream in(stampPathFor(path), ios::binary);
+    in.read((char *)&stamp, sizeof(stamp));
+    if (!in || memcmp(stamp.magic, STAMP_MAGIC, sizeof(stamp.magic)) != 0 || stamp.rows != db.totalRows() ||
+        stamp.fingerprint != db.fingerprint()) {
+        cerr << "[INFO] El índice " << path << " no corresponde a la base actual, se reconstruye." << endl;
+        return false;
+    }
+
+    vector<int> rowsPerImage;
+    for (size_t i = 0; i < db.size(); i++) rowsPerImage.push_back(db.entry(i).descCount);
+    setRowMapping(rowsPerImage);
+
+    binary = isBinaryBackend(db.featureBackend());
+    data = indexData(db, binary);
+    index = makePtr<flann::Index>();
+    try {
+        // El archivo guarda el tipo de índice y la distancia (KD-tree/L2 o LSH/Hamming)
+        if (!index->load(data, path)) {
+            index.release();
+            return false;
+        }
+    } catch (const cv::Exception &) {
+        // FLANN rechaza índices construidos sobre otra base
+        cerr << "[ERROR] El índice " << path << " no corresponde a la base de descriptores." << endl;
+        index.release();
+        return false;
+    }
+    dbFingerprint = db.fingerprint();
+    return true;
+}
+
+void GlobalIndex::match(const Mat &queryDescriptors, float ratio, vector<DMatch> &goodMatches) const {
+    ScopedTimer timer(METRIC_MATCHING);
+    goodMatches.clear();
+    if (!index || queryDescriptors.empty() || data.rows < 2) return;
+
+    // Las consultas cuantizadas se comparan en el mismo espacio que el índice
+    Mat query = queryDescriptors;
+    if (query.type() != data.type()) queryDescriptors.convertTo(query, data.type());
+
+    Mat indices, dists;
+    index->knnSearch(query, indices, dists, 2, flann::SearchParams(SEARCH_CHECKS));
+
+    // Con KD-tree FLANN devuelve distancias L2 al cuadrado y el test de Lowe se compara con
+    // la raíz; con LSH devuelve distancias de Hamming enteras, que se comparan tal cual
+    if (dists.type() != CV_32F) dists.convertTo(dists, CV_32F);
+    for (int q = 0; q < indices.rows; q++) {
+        int nn = indices.at<int>(q, 0);
+        // LSH puede no encontrar un segundo vecino: sin él no hay test de Lowe
+        if (nn < 0 || indices.at<int>(q, 1) < 0) continue;
+        float d0 = binary ? dists.at<float>(q, 0) : sqrt(dists.at<float>(q, 0));
+        float d1 = binary ? dists.at<float>(q, 1) : sqrt(dists.at<float>(q, 1));
+        if (d0 < ratio * d1) {
+            int img = imageForRow(nn);
+            goodMatches.push_back(DMatch(q, nn - rowStart[img], img, d0));
+        }
+    }
+}
+
+vector<int> GlobalIndex::votesPerImage(const vector<DMatch> &matches) const {
+    vector<int> votes(rowStart.size(), 0);
+    for (const auto &m : matches) votes[m.imgIdx]++;
+    return votes;
+}
+
+string indexPathFor(const string &dbPath) {
+    return dbPath + ".flann";
+}
+
+bool buildAndSaveIndex(const string &dbPath) {
+    DescriptorDB db;
+    if (!db.open(dbPath)) return false;
+
+    GlobalIndex index;
+    if (!index.build(db)) {
+        cerr << "[ERROR] No se pudo construir el índice global para " << dbPath << endl;
+        return false;
+    }
+    string path = indexPathFor(dbPath);
+    if (!index.save(path)) return false;
+    cout << "[INFO] Índice global (" << db.totalRows() << " descriptores) guardado en " << path << endl;
+    return true;
+}
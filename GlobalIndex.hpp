@@ -0,0 +1,63 @@
+#ifndef GLOBAL_INDEX_HPP
+#define GLOBAL_INDEX_HPP
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/flann.hpp>
+#include <string>
+#include <vector>
+#include "DescriptorDB.hpp"
+
+// Índice FLANN único sobre la concatenación de los descriptores de todas las
+// imágenes de referencia. Cada fila del índice se asocia a la imagen de la que
+// proviene, de modo que una sola consulta knn por imagen de test reemplaza el
+// knnMatch contra cada referencia por separado.
+//
+// Con descriptores float (SIFT, SURF) el índice es un bosque de KD-trees (L2);
+// con descriptores binarios (ORB, AKAZE, BRISK) es un LSH multi-probe con
+// distancia de Hamming. El tipo se toma del extractor registrado en la base.
+//
+// Los matches que devuelve match() usan:
+//   queryIdx -> índice del descriptor de la imagen de consulta
+//   trainIdx -> índice del descriptor dentro de su imagen de referencia
+//   imgIdx   -> índice de la imagen de referencia
+class GlobalIndex {
+public:
+    // Construye el índice sobre la base mapeada (sin copiar los descriptores).
+    // La base debe seguir abierta mientras se use el índice.
+    bool build(const DescriptorDB &db);
+    // Construye el índice sobre descriptores en memoria, uno por imagen de referencia
+    bool build(const std::vector<cv::Mat> &descriptorsPerImage);
+
+    // Junto al índice se escribe <path>.stamp con las filas y la huella de la base
+    bool save(const std::string &path) const;
+    // Carga un índice guardado; falla si <path>.stamp no corresponde a la base
+    // (otra base o la misma reentrenada), y entonces hay que reconstruirlo
+    bool load(const DescriptorDB &db, const std::string &path);
+
+    // knn (k = 2) contra todas las referencias y test de Lowe con los vecinos globales
+    void match(const cv::Mat &queryDescriptors, float ratio, std::vector<cv::DMatch> &goodMatches) const;
+
+    // Cuenta los votos de cada imagen de referencia
+    std::vector<int> votesPerImage(const std::vector<cv::DMatch> &matches) const;
+
+    size_t imageCount() const { return rowStart.size(); }
+    bool empty() const { return data.empty(); }
+
+private:
+    void setRowMapping(const std::vector<int> &rowsPerImage);
+    int imageForRow(int row) const;
+
+    cv::Mat data;                   // vista sobre la base, copia CV_32F o concatenación propia
+    bool binary = false;            // descriptores binarios: LSH + Hamming
+    std::vector<int> rowStart;      // primera fila de cada imagen dentro de data
+    uint64_t dbFingerprint = 0;     // huella de la base (0 si se construyó desde memoria)
+    cv::Ptr<cv::flann::Index> index;
+};
+
+// Ruta del índice que acompaña a una base de descriptores
+std::string indexPathFor(const std::string &dbPath);
+
+// Abre la base, construye el índice y lo guarda junto a ella (se usa al entrenar)
+bool buildAndSaveIndex(const std::string &dbPath);
+
+#endif
@@ -0,0 +1,202 @@
+#include "HomographyDetector.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include "Metrics.hpp"
+#include "Parallel.hpp"
+#include "RatioMatcher.hpp"
+
+using namespace std;
+using namespace cv;
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+vector<TrainROI> loadTrainDescriptors(DescriptorDB &db, const string &trainDb) {
+    vector<TrainROI> trainROIs;
+
+    if (!db.open(trainDb)) {
+        cerr << "[ERROR] No se pudo abrir " << trainDb << endl;
+        return trainROIs;
+    }
+
+    // verifyROI usa queryIdx (fila del descriptor) como índice del keypoint: una ROI con
+    // distinta cantidad de keypoints que de descriptores queda vacía (no se verifica) para
+    // no leer fuera de kpCoords. Se mantiene su posición porque el vocabulario usa los índices de la base.
+    trainROIs.reserve(db.size());
+    size_t inconsistent = 0;
+    for (size_t i = 0; i < db.size(); i++) {
+        if (db.keypointCount(i) != db.entry(i).descCount) {
+            trainROIs.push_back({Mat(), {}, db.bbox(i)});
+            inconsistent++;
+            continue;
+        }
+        trainROIs.push_back({db.descriptors(i), db.keypointCoords(i), db.bbox(i)});
+    }
+    if (inconsistent > 0) {
+        cerr << "[ERROR] " << inconsistent << " ROIs de " << trainDb
+             << " tienen distinta cantidad de keypoints que de descriptores y se omiten." << endl;
+    }
+    cout << "[INFO] Se cargaron " << trainROIs.size() - inconsistent << " ROIs del dataset." << endl;
+    return trainROIs;
+}
+
+// Verifica una ROI: dos vecinos más cercanos, filtro de Lowe, homografía y esquinas dentro de la imagen.
+// Los mensajes [DEBUG] van a log (nulo: sin mensajes).
+static bool verifyROI(size_t idx, const vector<KeyPoint> &testKp, const Mat &testDes, Size imageSize,
+                      const TrainROI &troi, const DetectorParams &params, DescriptorMatcher &matcher,
+                      ostream *log, DetectorTiming &timing, RoiDetection &detection) {
+    if (troi.descriptors.empty() || troi.kpCoords.empty()) {
+        if (log) *log << "[DEBUG] ROI " << idx << " - Sin descriptores ni keypoints." << endl;
+        return false;
+    }
+
+    addCounter(COUNTER_ROIS_VERIFIED);
+    int64 t = getTickCount();
+    // Buffer por hilo: con RatioMatcher la llamada no reserva memoria una vez que tiene capacidad
+    thread_local vector<DMatch> goodMatches;
+    if (params.norm >= 0 && ratioMatchSupported(troi.descriptors, testDes, params.norm)) {
+        ratioMatch(troi.descriptors, testDes, params.norm, params.ratioThresh, goodMatches);
+    } else {
+        vector<vector<DMatch>> knnMatches;
+        matcher.knnMatch(troi.descriptors, testDes, knnMatches, 2);
+
+        goodMatches.clear();
+        for (auto &km : knnMatches) {
+            if (km.size() < 2) continue;
+            if (km[0].distance < params.ratioThresh * km[1].distance) {
+                goodMatches.push_back(km[0]);
+            }
+        }
+    }
+    if (log) *log << "[DEBUG] Número de coincidencias encontradas: " << troi.descriptors.rows << endl;
+
+    double ms = msSince(t);
+    timing.matchingMs += ms;
+    recordStage(METRIC_MATCHING, ms);
+    addCounter(COUNTER_GOOD_MATCHES, goodMatches.size());
+    if (log) *log << "[DEBUG] ROI " << idx << " - Good matches: " << goodMatches.size() << endl;
+
+    if ((int)goodMatches.size() < params.minGoodMatches) return false;
+
+    t = getTickCount();
+    vector<Point2f> roiPoints, testPoints;
+    for (auto &gm : goodMatches) {
+        roiPoints.push_back(troi.kpCoords[gm.queryIdx]);
+        testPoints.push_back(testKp[gm.trainIdx].pt);
+    }
+
+    Mat maskInliers;
+    Mat H = findHomography(roiPoints, testPoints, RANSAC, params.ransacReprojThresh, maskInliers);
+    ms = msSince(t);
+    timing.verificationMs += ms;
+    recordStage(METRIC_RANSAC, ms);
+    if (H.empty() || maskInliers.empty()) {
+        if (log) *log << "[DEBUG] ROI " << idx << " - Homografía no encontrada." << endl;
+        return false;
+    }
+
+    int inliersCount = countNonZero(maskInliers);
+    if (log) *log << "[DEBUG] ROI " << idx << " - Inliers: " << inliersCount << endl;
+    if (inliersCount < params.minInliers) return false;
+
+    vector<Point2f> corners = {
+        Point2f(0, 0), Point2f((float)troi.bbox.width, 0),
+        Point2f((float)troi.bbox.width, (float)troi.bbox.height),
+        Point2f(0, (float)troi.bbox.height)
+    };
+    vector<Point2f> cornersTransformed(4);
+    perspectiveTransform(corners, cornersTransformed, H);
+
+    for (const auto &pt : cornersTransformed) {
+        if (pt.x < 0 || pt.y < 0 || pt.x >= imageSize.width || pt.y >= imageSize.height || isnan(pt.x) || isnan(pt.y)) {
+            if (log) *log << "[WARNING] ROI " << idx << " - Transformación no válida, no se dibujará el rectángulo." << endl;
+            return false;
+        }
+    }
+
+    detection = {(int)idx, (int)goodMatches.size(), inliersCount, cornersTransformed};
+    return true;
+}
+
+// Copia del matcher del llamador para un hilo auxiliar de parallelForStealing. Los auxiliares
+// persisten entre llamadas, así que la copia se hace una vez por hilo y se rehace solo si el
+// llamador pasa otro matcher.
+static DescriptorMatcher &workerMatcher(const DescriptorMatcher &source) {
+    thread_local const DescriptorMatcher *clonedFrom = nullptr;
+    thread_local Ptr<DescriptorMatcher> copy;
+    if (clonedFrom != &source || !copy) {
+        copy = source.clone(true);
+        clonedFrom = &source;
+    }
+    return *copy;
+}
+
+vector<RoiDetection> detectROIs(const vector<KeyPoint> &testKp, const Mat &testDes, Size imageSize,
+                                const vector<TrainROI> &trainROIs, const DetectorParams &params,
+                                DescriptorMatcher &matcher, bool verbose, DetectorTiming *timing,
+                                const vector<int> *shortlist) {
+    size_t count = shortlist ? shortlist->size() : trainROIs.size();
+    unsigned workers = (unsigned)min<size_t>(max(params.threads, 1u), max<size_t>(count, 1));
+    bool serial = workers == 1;
+
+    // Un resultado por candidata, en el orden de la lista: la unión no depende de qué hilo terminó primero.
+    // Los tiempos también van por candidata, así solo se suman los de las que entran en el resultado.
+    struct Slot {
+        bool found = false;
+        RoiDetection detection;
+        DetectorTiming timing;
+        string log;
+    };
+    vector<Slot> slots(count);
+
+    // Corte temprano: al confirmar una ROI con earlyExitInliers inliers se descartan las
+    // candidatas posteriores a ella; las anteriores se terminan, así el resultado es el
+    // mismo que recorriendo la lista en orden y parando en la primera con esos inliers.
+    atomic<size_t> stopAt(count);
+
+    parallelForStealing(count, workers, [&](size_t k, unsigned w) {
+        if (k > stopAt.load(memory_order_relaxed)) return;
+        size_t idx = shortlist ? (size_t)(*shortlist)[k] : k;
+        ostringstream buffer;
+        ostream *log = !verbose ? nullptr : serial ? &cout : &buffer;
+        DescriptorMatcher &m = w == 0 ? matcher : workerMatcher(matcher);
+
+        Slot &slot = slots[k];
+        slot.found = verifyROI(idx, testKp, testDes, imageSize, trainROIs[idx], params, m, log, slot.timing,
+                               slot.detection);
+        if (verbose && !serial) slot.log = buffer.str();
+
+        if (slot.found && params.earlyExitInliers > 0 && slot.detection.inliers >= params.earlyExitInliers) {
+            size_t current = stopAt.load();
+            while (k < current && !stopAt.compare_exchange_weak(current, k)) {}
+        }
+    });
+
+    // Las candidatas posteriores al corte que ya estaban en proceso se descartan con sus tiempos
+    vector<RoiDetection> detections;
+    size_t last = min(stopAt.load(), count == 0 ? 0 : count - 1);
+    for (size_t k = 0; k < count && k <= last; k++) {
+        if (!slots[k].log.empty()) cout << slots[k].log;
+        if (slots[k].found) detections.push_back(slots[k].detection);
+        if (timing) {
+            timing->matchingMs += slots[k].timing.matchingMs;
+            timing->verificationMs += slots[k].timing.verificationMs;
+        }
+    }
+    addCounter(COUNTER_DETECTIONS, detections.size());
+    return detections;
+}
+
+void drawDetections(Mat &img, const vector<RoiDetection> &detections) {
+    for (const auto &d : detections) {
+        vector<vector<Point>> polygon(1);
+        for (const auto &pt : d.corners) {
+            polygon[0].push_back(Point((int)pt.x, (int)pt.y));
+        }
+        polylines(img, polygon, true, Scalar(0, 255, 0), 2, LINE_AA);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef HOMOGRAPHY_DETECTOR_HPP
+#define HOMOGRAPHY_DETECTOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "DescriptorDB.hpp"
+
+// Detector de Test3.cpp: dos vecinos más cercanos contra cada ROI entrenada, filtro
+// de Lowe, homografía con RANSAC y proyección de las esquinas de la ROI en la imagen.
+
+// Estructura para almacenar los ROIs entrenados
+struct TrainROI {
+    cv::Mat descriptors;
+    std::vector<cv::Point2f> kpCoords;
+    cv::Rect bbox;
+};
+
+struct DetectorParams {
+    float ratioThresh = 0.75f;
+    int minGoodMatches = 10;
+    double ransacReprojThresh = 5.0;
+    int minInliers = 8;
+    unsigned threads = 1;       // hilos para verificar las ROIs candidatas de una imagen (robo de trabajo)
+    int earlyExitInliers = 0;   // > 0: se deja de buscar al confirmar una ROI con al menos estos inliers
+    int norm = -1;              // featureNorm del extractor: activa RatioMatcher; -1 usa siempre el matcher recibido
+};
+
+// Una ROI del dataset encontrada en la imagen de test
+struct RoiDetection {
+    int roiIndex;
+    int goodMatches;
+    int inliers;
+    std::vector<cv::Point2f> corners;  // esquinas de la ROI proyectadas en la imagen
+};
+
+// Tiempo de cada etapa (ms), acumulado sobre todas las ROIs
+struct DetectorTiming {
+    double matchingMs = 0;      // vecinos + filtro de Lowe
+    double verificationMs = 0;  // homografía + validación de esquinas
+};
+
+// Función para cargar los descriptores desde la base binaria.
+// Los descriptores son vistas sobre el archivo mapeado, así que la base debe seguir abierta.
+std::vector<TrainROI> loadTrainDescriptors(DescriptorDB &db, const std::string &trainDb);
+
+// Compara los descriptores de la imagen de test con cada ROI y devuelve las
+// detecciones válidas (homografía con suficientes inliers y esquinas dentro de la imagen).
+// Con verbose se imprimen los mensajes [DEBUG] por ROI; si timing no es nulo se rellenan los tiempos.
+// Si shortlist no es nulo solo se prueban esas ROIs (índices en trainROIs, p. ej. de VisualVocabulary).
+// Con params.norm definido y una norma soportada se usa ratioMatch (RatioMatcher.hpp) y el matcher
+// solo queda de respaldo para los demás tipos de descriptor.
+// Con params.threads > 1 las ROIs se reparten entre hilos, cada uno con su copia del matcher; las
+// detecciones y los mensajes salen en el orden de la lista y los tiempos suman las ROIs
+// verificadas hasta el corte temprano (las descartadas después del corte no cuentan).
+std::vector<RoiDetection> detectROIs(const std::vector<cv::KeyPoint> &testKp, const cv::Mat &testDes,
+                                     cv::Size imageSize, const std::vector<TrainROI> &trainROIs,
+                                     const DetectorParams &params, cv::DescriptorMatcher &matcher,
+                                     bool verbose, DetectorTiming *timing = nullptr,
+                                     const std::vector<int> *shortlist = nullptr);
+
+// Dibuja el polígono de cada detección
+void drawDetections(cv::Mat &img, const std::vector<RoiDetection> &detections);
+
+#endif
@@ -0,0 +1,143 @@
+#include "Manifest.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char *MANIFEST_HEADER = "# VCsift manifest v1";
+
+bool DatasetManifest::load(const string &path) {
+    records.clear();
+    byPath.clear();
+    params.clear();
+
+    ifstream in(path);
+    if (!in) return false;
+
+    string line;
+    if (!getline(in, line) || line != MANIFEST_HEADER) {
+        cerr << "[ERROR] Manifiesto inválido: " << path << endl;
+        return false;
+    }
+    if (!getline(in, line) || line.compare(0, 7, "params\t") != 0) {
+        cerr << "[ERROR] Manifiesto sin parámetros del extractor: " << path << endl;
+        return false;
+    }
+    params = line.substr(7);
+
+    // ruta \t tamaño \t mtime \t hash (imagen) \t tamaño \t mtime \t hash (xml) \t entradas
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        size_t tab = line.find('\t');
+        if (tab == string::npos) continue;
+
+        ManifestRecord r;
+        r.imagePath = line.substr(0, tab);
+        istringstream fields(line.substr(tab + 1));
+        fields >> r.image.size >> r.image.mtime >> hex >> r.image.hash >> dec
+               >> r.xml.size >> r.xml.mtime >> hex >> r.xml.hash >> dec >> r.entries;
+        if (fields.fail()) continue;
+        add(r);
+    }
+    return true;
+}
+
+bool DatasetManifest::save(const string &path) const {
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::trunc);
+    if (!out) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+
+    out << MANIFEST_HEADER << "\n";
+    out << "params\t" << params << "\n";
+    for (const auto &r : records) {
+        out << r.imagePath << "\t"
+            << r.image.size << "\t" << r.image.mtime << "\t" << hex << r.image.hash << dec << "\t"
+            << r.xml.size << "\t" << r.xml.mtime << "\t" << hex << r.xml.hash << dec << "\t"
+            << r.entries << "\n";
+    }
+    out.close();
+
+    if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo escribir el manifiesto " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+const ManifestRecord *DatasetManifest::find(const string &imagePath) const {
+    auto it = byPath.find(imagePath);
+    return it == byPath.end() ? nullptr : &records[it->second];
+}
+
+void DatasetManifest::add(const ManifestRecord &record) {
+    auto it = byPath.find(record.imagePath);
+    if (it != byPath.end()) {
+        records[it->second] = record;
+        return;
+    }
+    byPath[record.imagePath] = records.size();
+    records.push_back(record);
+}
+
+uint64_t hashFile(const string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return 0;
+
+    uint64_t h = 1469598103934665603ULL;
+    unsigned char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= buffer[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(f);
+    return h;
+}
+
+bool fileUnchanged(const string &path, const FileStamp *previous, FileStamp &current) {
+    current = FileStamp();
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        // Un archivo ausente queda registrado con todo en cero
+        return previous && previous->size == 0 && previous->mtime == 0;
+    }
+
+    current.size = (uint64_t)st.st_size;
+    current.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    if (previous && previous->size == current.size && previous->mtime == current.mtime) {
+        current.hash = previous->hash;
+        return true;
+    }
+
+    current.hash = hashFile(path);
+    return previous && previous->size == current.size && previous->hash == current.hash;
+}
+
+unordered_map<string, vector<size_t>> entriesByPath(const DescriptorDB &db) {
+    unordered_map<string, vector<size_t>> out;
+    for (size_t i = 0; i < db.size(); i++) out[db.imagePath(i)].push_back(i);
+    return out;
+}
+
+size_t countRemoved(const DatasetManifest &previous, const DatasetManifest &current) {
+    size_t removed = 0;
+    for (const auto &r : previous.all()) {
+        if (!current.find(r.imagePath)) removed++;
+    }
+    return removed;
+}
+
+string manifestPathFor(const string &dbPath) {
+    return dbPath + ".manifest";
+}
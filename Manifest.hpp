@@ -0,0 +1,63 @@
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DescriptorDB.hpp"
+
+// Manifiesto del entrenamiento incremental. Se guarda junto a la base de
+// descriptores (<db>.manifest) y registra, por cada imagen procesada, el
+// tamaño, la fecha de modificación y un hash del contenido de la imagen y de
+// su XML, además de los parámetros del extractor con los que se generó.
+// Al reentrenar solo se extraen las imágenes nuevas o modificadas; el resto se
+// copia tal cual desde la base anterior.
+
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+};
+
+struct ManifestRecord {
+    std::string imagePath;
+    FileStamp image;
+    FileStamp xml;
+    int entries = 0;    // ROIs que aportó a la base (0 si se descartó)
+};
+
+class DatasetManifest {
+public:
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    const ManifestRecord *find(const std::string &imagePath) const;
+    void add(const ManifestRecord &record);
+    size_t size() const { return records.size(); }
+    const std::vector<ManifestRecord> &all() const { return records; }
+
+    std::string params;  // parámetros del extractor
+
+private:
+    std::vector<ManifestRecord> records;
+    std::unordered_map<std::string, size_t> byPath;
+};
+
+// Hash FNV-1a de 64 bits del contenido del archivo
+uint64_t hashFile(const std::string &path);
+
+// Compara un archivo con su registro previo. Si tamaño y fecha coinciden se
+// reutiliza el hash guardado; si no, se calcula el hash y se compara el contenido.
+// "current" queda con los datos actuales del archivo.
+bool fileUnchanged(const std::string &path, const FileStamp *previous, FileStamp &current);
+
+// Índices de las ROIs de la base agrupados por ruta de imagen
+std::unordered_map<std::string, std::vector<size_t>> entriesByPath(const DescriptorDB &db);
+
+// Imágenes del manifiesto anterior que ya no están en el actual
+size_t countRemoved(const DatasetManifest &previous, const DatasetManifest &current);
+
+std::string manifestPathFor(const std::string &dbPath);
+
+#endif
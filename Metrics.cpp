@@ -0,0 +1,280 @@
+#include "Metrics.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> metricsActive(false);
+
+static const char *STAGE_NAMES[METRIC_STAGE_COUNT] = {"decode",  "segmentation", "features", "lbp",
+                                                      "matching", "ransac",      "classify", "frame"};
+static const char *COUNTER_NAMES[METRIC_COUNTER_COUNT] = {"frames",         "dropped_frames", "keypoints",
+                                                          "candidates",     "rois_verified",  "good_matches",
+                                                          "detections"};
+
+//----------------------------------------------------------
+// Bloques por hilo
+//----------------------------------------------------------
+
+// Solo el hilo dueño escribe (load + store relajados, sin lock); el exportador lee
+struct MetricsBlock {
+    atomic<uint64_t> buckets[METRIC_STAGE_COUNT][METRIC_BUCKETS];
+    atomic<uint64_t> sumNs[METRIC_STAGE_COUNT];
+    atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+
+    MetricsBlock() { reset(); }
+
+    void reset() {
+        for (auto &stage : buckets)
+            for (auto &b : stage) b.store(0, memory_order_relaxed);
+        for (auto &s : sumNs) s.store(0, memory_order_relaxed);
+        for (auto &c : counters) c.store(0, memory_order_relaxed);
+    }
+
+    void addTo(MetricsSnapshot &out) const {
+        for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+            for (int b = 0; b < METRIC_BUCKETS; b++) out.buckets[s][b] += buckets[s][b].load(memory_order_relaxed);
+            out.sumMs[s] += sumNs[s].load(memory_order_relaxed) / 1e6;
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) out.counters[c] += counters[c].load(memory_order_relaxed);
+    }
+};
+
+static inline void bump(atomic<uint64_t> &v, uint64_t n) {
+    v.store(v.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Registro de bloques: los de hilos terminados se suman a "retired" y se reutilizan,
+// así los pools que se crean por imagen (parallelFor) no hacen crecer la lista
+struct MetricsRegistry {
+    mutex lock;
+    vector<MetricsBlock *> active;
+    vector<MetricsBlock *> free;
+    MetricsSnapshot retired;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+};
+
+static MetricsRegistry &registry() {
+    static MetricsRegistry *r = new MetricsRegistry();  // nunca se destruye: hay hilos que terminan después de main
+    return *r;
+}
+
+struct ThreadMetrics {
+    MetricsBlock *block = nullptr;
+
+    MetricsBlock &get() {
+        if (!block) {
+            MetricsRegistry &r = registry();
+            lock_guard<mutex> guard(r.lock);
+            if (r.free.empty()) {
+                block = new MetricsBlock();
+            } else {
+                block = r.free.back();
+                r.free.pop_back();
+            }
+            r.active.push_back(block);
+        }
+        return *block;
+    }
+
+    ~ThreadMetrics() {
+        if (!block) return;
+        MetricsRegistry &r = registry();
+        lock_guard<mutex> guard(r.lock);
+        block->addTo(r.retired);
+        block->reset();
+        for (size_t i = 0; i < r.active.size(); i++) {
+            if (r.active[i] == block) {
+                r.active.erase(r.active.begin() + i);
+                break;
+            }
+        }
+        r.free.push_back(block);
+    }
+};
+
+static thread_local ThreadMetrics threadMetrics;
+
+void recordStage(MetricStage stage, double ms) {
+    if (!metricsEnabled()) return;
+    int b = 0;
+    while (b < METRIC_BUCKETS - 1 && ms > METRIC_BUCKET_BOUNDS_MS[b]) b++;
+    MetricsBlock &block = threadMetrics.get();
+    bump(block.buckets[stage][b], 1);
+    bump(block.sumNs[stage], (uint64_t)(ms * 1e6));
+}
+
+void addCounter(MetricCounter counter, uint64_t n) {
+    if (!metricsEnabled()) return;
+    bump(threadMetrics.get().counters[counter], n);
+}
+
+//----------------------------------------------------------
+// Lectura y formato
+//----------------------------------------------------------
+uint64_t MetricsSnapshot::count(MetricStage stage) const {
+    uint64_t n = 0;
+    for (int b = 0; b < METRIC_BUCKETS; b++) n += buckets[stage][b];
+    return n;
+}
+
+double MetricsSnapshot::percentileMs(MetricStage stage, double q) const {
+    uint64_t total = count(stage);
+    if (total == 0) return 0;
+    uint64_t target = (uint64_t)(q * total + 0.5);
+    uint64_t seen = 0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += buckets[stage][b];
+        if (seen >= target) return METRIC_BUCKET_BOUNDS_MS[b];
+    }
+    return METRIC_BUCKET_BOUNDS_MS[METRIC_BUCKETS - 2];  // bucket +Inf: se informa el último límite
+}
+
+MetricsSnapshot snapshotMetrics() {
+    MetricsRegistry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    MetricsSnapshot s = r.retired;
+    for (const MetricsBlock *block : r.active) block->addTo(s);
+    s.uptimeSeconds = chrono::duration<double>(chrono::steady_clock::now() - r.start).count();
+    return s;
+}
+
+string metricsJSON(const MetricsSnapshot &s, const string &binary) {
+    ostringstream out;
+    out << "{\"binary\": \"" << binary << "\", \"uptime_s\": " << s.uptimeSeconds << ", \"stages\": {";
+    for (int st = 0; st < METRIC_STAGE_COUNT; st++) {
+        MetricStage stage = (MetricStage)st;
+        uint64_t n = s.count(stage);
+        out << (st ? ", " : "") << "\"" << STAGE_NAMES[st] << "\": {\"count\": " << n << ", \"sum_ms\": " << s.sumMs[st]
+            << ", \"mean_ms\": " << (n ? s.sumMs[st] / n : 0.0) << ", \"p50_ms\": " << s.percentileMs(stage, 0.5)
+            << ", \"p95_ms\": " << s.percentileMs(stage, 0.95) << ", \"p99_ms\": " << s.percentileMs(stage, 0.99)
+            << ", \"buckets\": [";
+        for (int b = 0; b < METRIC_BUCKETS; b++) {
+            out << (b ? ", " : "") << "[";
+            if (b < METRIC_BUCKETS - 1) out << METRIC_BUCKET_BOUNDS_MS[b];
+            else out << "\"+Inf\"";
+            out << ", " << s.buckets[st][b] << "]";
+        }
+        out << "]}";
+    }
+    out << "}, \"counters\": {";
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        out << (c ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << s.counters[c];
+    }
+    out << "}}\n";
+    return out.str();
+}
+
+string metricsPrometheus(const MetricsSnapshot &s, const string &binary) {
+    ostringstream out;
+    out << "# HELP vision_stage_duration_milliseconds Duración de cada etapa del detector.\n"
+        << "# TYPE vision_stage_duration_milliseconds histogram\n";
+    for (int st = 0; st < METRIC_STAGE_COUNT; st++) {
+        string labels = "binary=\"" + binary + "\",stage=\"" + STAGE_NAMES[st] + "\"";
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKETS; b++) {
+            cumulative += s.buckets[st][b];
+            out << "vision_stage_duration_milliseconds_bucket{" << labels << ",le=\"";
+            if (b < METRIC_BUCKETS - 1) out << METRIC_BUCKET_BOUNDS_MS[b];
+            else out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "vision_stage_duration_milliseconds_sum{" << labels << "} " << s.sumMs[st] << "\n"
+            << "vision_stage_duration_milliseconds_count{" << labels << "} " << cumulative << "\n";
+    }
+    out << "# HELP vision_events_total Eventos contados por el detector.\n"
+        << "# TYPE vision_events_total counter\n";
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        out << "vision_events_total{binary=\"" << binary << "\",event=\"" << COUNTER_NAMES[c] << "\"} "
+            << s.counters[c] << "\n";
+    }
+    out << "# HELP vision_uptime_seconds Segundos desde que arrancó el proceso.\n"
+        << "# TYPE vision_uptime_seconds gauge\n"
+        << "vision_uptime_seconds{binary=\"" << binary << "\"} " << s.uptimeSeconds << "\n";
+    return out.str();
+}
+
+bool writeMetrics(const string &path, const string &binary) {
+    MetricsSnapshot s = snapshotMetrics();
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    string text = json ? metricsJSON(s, binary) : metricsPrometheus(s, binary);
+
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::trunc);
+    if (!out) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+    out << text;
+    out.close();
+    if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudieron escribir las métricas en " << path << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// Exportador periódico
+//----------------------------------------------------------
+class MetricsExporter {
+public:
+    void start(const string &exportPath, const string &binaryName, double intervalSeconds) {
+        path = exportPath;
+        binary = binaryName;
+        interval = intervalSeconds;
+        worker = thread([this] {
+            unique_lock<mutex> guard(lock);
+            while (!stopping) {
+                wake.wait_for(guard, chrono::duration<double>(interval), [this] { return stopping; });
+                writeMetrics(path, binary);
+            }
+        });
+    }
+
+    // La última escritura incluye todo lo medido hasta el final de main
+    ~MetricsExporter() {
+        if (!worker.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+private:
+    string path, binary;
+    double interval = 5;
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    bool stopping = false;
+};
+
+static MetricsExporter exporter;
+
+bool initMetricsFromArgs(int argc, char *argv[], const string &binary) {
+    string path;
+    double interval = 5;
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--metrics") path = argv[++i];
+        else if (arg == "--metrics-interval") interval = max(0.1, atof(argv[++i]));
+    }
+    if (path.empty()) return false;
+
+    metricsActive = true;
+    exporter.start(path, binary, interval);
+    cout << "[INFO] Métricas en " << path << " cada " << interval << " s." << endl;
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Instrumentación de los detectores: histogramas de latencia por etapa y contadores.
+//
+// Cada hilo escribe en su propio bloque (thread_local), sin locks ni operaciones
+// atómicas con bloqueo del bus; el exportador suma los bloques de todos los hilos
+// (y los de los hilos que ya terminaron) al escribir el archivo. Mientras no se
+// active con --metrics, ScopedTimer no lee el reloj y recordStage/addCounter
+// vuelven sin hacer nada.
+//
+// Exportación: --metrics ARCHIVO escribe cada --metrics-interval segundos (5 por
+// defecto) y al terminar. Si el archivo termina en .json se escribe en JSON; si
+// no, en el formato de texto de Prometheus (node_exporter --collector.textfile).
+
+enum MetricStage {
+    METRIC_DECODE,          // imread / imdecode
+    METRIC_SEGMENTATION,    // máscara del rojo + morfología + contornos
+    METRIC_FEATURES,        // detección y descripción de keypoints
+    METRIC_LBP,             // LBP de los candidatos
+    METRIC_MATCHING,        // RatioMatcher / knnMatch / FLANN + filtro de Lowe
+    METRIC_RANSAC,          // homografía con RANSAC + validación
+    METRIC_CLASSIFY,        // predicción del SVM
+    METRIC_FRAME,           // frame o imagen completa
+    METRIC_STAGE_COUNT
+};
+
+enum MetricCounter {
+    COUNTER_FRAMES,
+    COUNTER_DROPPED_FRAMES,     // frames que el detector nunca llegó a ver (Pipeline.hpp)
+    COUNTER_KEYPOINTS,
+    COUNTER_CANDIDATES,         // candidatos de la segmentación del rojo
+    COUNTER_ROIS_VERIFIED,
+    COUNTER_GOOD_MATCHES,
+    COUNTER_DETECTIONS,
+    METRIC_COUNTER_COUNT
+};
+
+// Límites superiores (ms) de los buckets del histograma; el último es +Inf
+static const int METRIC_BUCKETS = 14;
+static const double METRIC_BUCKET_BOUNDS_MS[METRIC_BUCKETS - 1] = {0.1, 0.25, 0.5, 1,   2.5, 5,   10,
+                                                                   25,  50,   100, 250, 500, 1000};
+
+extern std::atomic<bool> metricsActive;
+
+inline bool metricsEnabled() {
+    return metricsActive.load(std::memory_order_relaxed);
+}
+
+void recordStage(MetricStage stage, double ms);
+void addCounter(MetricCounter counter, uint64_t n = 1);
+
+// Mide el tiempo hasta el final del bloque
+class ScopedTimer {
+public:
+    explicit ScopedTimer(MetricStage stage) : stage(stage), active(metricsEnabled()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+    ~ScopedTimer() {
+        if (active) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            recordStage(stage, elapsed.count());
+        }
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    MetricStage stage;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Suma de todos los hilos en un instante
+struct MetricsSnapshot {
+    uint64_t buckets[METRIC_STAGE_COUNT][METRIC_BUCKETS] = {};
+    double sumMs[METRIC_STAGE_COUNT] = {};
+    uint64_t counters[METRIC_COUNTER_COUNT] = {};
+    double uptimeSeconds = 0;
+
+    uint64_t count(MetricStage stage) const;
+    // Percentil estimado con el límite superior del bucket (q en [0, 1])
+    double percentileMs(MetricStage stage, double q) const;
+};
+
+MetricsSnapshot snapshotMetrics();
+std::string metricsJSON(const MetricsSnapshot &snapshot, const std::string &binary);
+std::string metricsPrometheus(const MetricsSnapshot &snapshot, const std::string &binary);
+
+// Escribe el estado actual (formato según la extensión) a un temporal y lo renombra
+bool writeMetrics(const std::string &path, const std::string &binary);
+
+// Lee --metrics ARCHIVO y --metrics-interval S. Si se pidió, activa la instrumentación
+// y arranca el hilo exportador, que escribe una última vez al terminar el programa.
+bool initMetricsFromArgs(int argc, char *argv[], const std::string &binary);
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Número de hilos por defecto: todos los núcleos disponibles
+inline unsigned defaultThreadCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Lee la opción "-j N" de la línea de comandos (0 o ausente = todos los núcleos)
+inline unsigned parseJobsArg(int argc, char *argv[]) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "-j") {
+            int n = std::atoi(argv[i + 1]);
+            return n > 0 ? (unsigned)n : defaultThreadCount();
+        }
+    }
+    return defaultThreadCount();
+}
+
+// Ejecuta body(i) para cada i en [0, n) repartiendo los índices entre "threads" hilos.
+// Cada hilo toma el siguiente índice libre, así las imágenes lentas no bloquean a las demás.
+// Con threads == 1 se ejecuta en el hilo actual, en orden.
+template <typename Body>
+void parallelFor(size_t n, unsigned threads, Body body) {
+    if (threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; i++) body(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < n; i = next++) body(i);
+    };
+
+    std::vector<std::thread> pool;
+    unsigned count = (unsigned)std::min<size_t>(threads, n);
+    for (unsigned t = 1; t < count; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+}
+
+// Hilos auxiliares persistentes de parallelForStealing: run(count, task) ejecuta task(0) en el
+// hilo actual y task(1..count-1) en los auxiliares, y espera a que terminen todos. Los hilos se
+// crean la primera vez que hacen falta y se reutilizan en las llamadas siguientes.
+class HelperPool {
+public:
+    HelperPool() = default;
+    HelperPool(const HelperPool &) = delete;
+    HelperPool &operator=(const HelperPool &) = delete;
+
+    ~HelperPool() {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &t : helpers) t.join();
+    }
+
+    void run(unsigned count, const std::function<void(unsigned)> &task) {
+        while (helpers.size() + 1 < count) {
+            unsigned self = (unsigned)helpers.size() + 1;
+            helpers.emplace_back([this, self]() { loop(self); });
+        }
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            job = &task;
+            jobCount = count;
+            pending = count - 1;
+            generation++;
+        }
+        wake.notify_all();
+        task(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    // Un auxiliar solo toma las tandas con count > self; la siguiente tanda no empieza
+    // hasta que terminaron todos los que participan en la actual.
+    void loop(unsigned self) {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&]() { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+            if (self >= jobCount) continue;
+            const std::function<void(unsigned)> *task = job;
+            lock.unlock();
+            (*task)(self);
+            lock.lock();
+            if (--pending == 0) done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> helpers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(unsigned)> *job = nullptr;
+    unsigned jobCount = 0, pending = 0;
+    size_t generation = 0;
+    bool stop = false;
+};
+
+// Variante con robo de trabajo para lotes cortos de tareas desiguales (p. ej. las
+// ROIs candidatas de una imagen): cada hilo empieza con un bloque contiguo de
+// índices y, cuando lo termina, roba la mitad final del bloque más grande que
+// quede. body(i, worker) recibe además el número de hilo (0..threads-1) para que
+// pueda usar su propio estado (matchers, acumuladores) sin bloqueos. Los hilos
+// auxiliares son de un HelperPool propio del hilo llamador: se reutilizan entre
+// llamadas (y con ellos su estado thread_local) en vez de crearse en cada una.
+template <typename Body>
+void parallelForStealing(size_t n, unsigned threads, Body body) {
+    unsigned count = (unsigned)std::min<size_t>(std::max(threads, 1u), n);
+    if (count <= 1) {
+        for (size_t i = 0; i < n; i++) body(i, 0u);
+        return;
+    }
+
+    struct Range {
+        std::mutex lock;
+        size_t begin = 0, end = 0;
+    };
+    std::vector<Range> ranges(count);
+    for (unsigned t = 0; t < count; t++) {
+        ranges[t].begin = n * t / count;
+        ranges[t].end = n * (t + 1) / count;
+    }
+
+    // Siguiente índice del bloque propio (false si está vacío)
+    auto take = [&](unsigned self, size_t &i) {
+        std::lock_guard<std::mutex> guard(ranges[self].lock);
+        if (ranges[self].begin >= ranges[self].end) return false;
+        i = ranges[self].begin++;
+        return true;
+    };
+
+    // Sin trabajo propio: se roba la mitad final del bloque con más índices pendientes.
+    // Nunca se sostienen dos bloqueos a la vez.
+    auto steal = [&](unsigned self) {
+        for (;;) {
+            unsigned victim = self;
+            size_t most = 0;
+            for (unsigned t = 0; t < count; t++) {
+                if (t == self) continue;
+                std::lock_guard<std::mutex> guard(ranges[t].lock);
+                if (ranges[t].end - ranges[t].begin > most) {
+                    most = ranges[t].end - ranges[t].begin;
+                    victim = t;
+                }
+            }
+            if (most == 0) return false;
+
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> guard(ranges[victim].lock);
+                size_t left = ranges[victim].end - ranges[victim].begin;
+                if (left == 0) continue;  // otro hilo se adelantó
+                end = ranges[victim].end;
+                begin = end - (left + 1) / 2;
+                ranges[victim].end = begin;
+            }
+            std::lock_guard<std::mutex> guard(ranges[self].lock);
+            ranges[self].begin = begin;
+            ranges[self].end = end;
+            return true;
+        }
+    };
+
+    auto worker = [&](unsigned self) {
+        size_t i;
+        for (;;) {
+            if (take(self, i)) body(i, self);
+            else if (!steal(self)) return;
+        }
+    };
+
+    thread_local HelperPool pool;
+    pool.run(count, worker);
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "Metrics.hpp"
+
+// Pipeline de tres etapas para los bucles de cámara:
+//
+//   captura (hilo) --> [LatestSlot] --> detección (hilo) --> [LatestSlot] --> render (hilo principal)
+//
+// Las etapas se comunican con buzones de una sola posición sin locks: si el
+// consumidor todavía no tomó el elemento anterior, el nuevo lo reemplaza y el
+// viejo se descarta ("gana el último frame"). Así el detector siempre trabaja
+// sobre el frame más reciente y la latencia queda acotada por la etapa más
+// lenta en lugar de la suma de todas. El render se queda en el hilo principal
+// porque imshow/waitKey deben llamarse desde ahí.
+
+// Buzón lock-free de capacidad 1 con política "gana el último"
+template <typename T>
+class LatestSlot {
+public:
+    ~LatestSlot() { delete slot.exchange(nullptr); }
+
+    // Publica un elemento; devuelve true si reemplazó uno que nadie llegó a tomar
+    bool put(std::unique_ptr<T> item) {
+        T *old = slot.exchange(item.release(), std::memory_order_acq_rel);
+        delete old;
+        return old != nullptr;
+    }
+
+    // Toma el elemento más reciente (nullptr si no hay ninguno nuevo)
+    std::unique_ptr<T> take() {
+        return std::unique_ptr<T>(slot.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+private:
+    std::atomic<T *> slot{nullptr};
+};
+
+// Elemento con la marca de tiempo de captura, para medir la latencia de punta a punta
+template <typename T>
+struct Stamped {
+    T value;
+    int64 captureTick;
+};
+
+struct PipelineStats {
+    long captured = 0;
+    long processed = 0;
+    long rendered = 0;
+    long droppedFrames = 0;   // frames que el detector nunca llegó a ver
+    long droppedResults = 0;  // resultados que el render nunca llegó a mostrar
+    double totalLatencyMs = 0;
+};
+
+// Ejecuta el pipeline hasta que la captura termine o se presione ESC.
+//   capture(Mat &frame)             -> false cuando no hay más frames
+//   detect(Mat &frame)              -> Result (se ejecuta en el hilo de detección)
+//   render(Result &result)          -> dibuja/muestra (hilo principal)
+template <typename Result, typename Capture, typename Detect, typename Render>
+PipelineStats runPipeline(Capture capture, Detect detect, Render render, int waitMs = 1) {
+    LatestSlot<Stamped<cv::Mat>> frames;
+    LatestSlot<Stamped<Result>> results;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> captureDone{false};
+    std::atomic<bool> detectDone{false};
+    PipelineStats stats;
+    std::atomic<long> dropped{0}, droppedResults{0}, captured{0}, processed{0};
+
+    std::thread captureThread([&]() {
+        while (!stop) {
+            cv::Mat frame;  // Mat nuevo en cada iteración: VideoCapture reutiliza el buffer si no
+            if (!capture(frame) || frame.empty()) break;
+            captured++;
+            std::unique_ptr<Stamped<cv::Mat>> item(new Stamped<cv::Mat>{frame, cv::getTickCount()});
+            if (frames.put(std::move(item))) {
+                dropped++;
+                addCounter(COUNTER_DROPPED_FRAMES);
+            }
+        }
+        captureDone = true;
+    });
+
+    std::thread detectThread([&]() {
+        while (!stop) {
+            // captureDone se lee antes de take(): si ya era true, el último frame ya estaba
+            // publicado y take() lo devuelve; leído después podría perderse
+            bool finished = captureDone;
+            std::unique_ptr<Stamped<cv::Mat>> item = frames.take();
+            if (!item) {
+                if (finished) break;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            std::unique_ptr<Stamped<Result>> out;
+            {
+                ScopedTimer timer(METRIC_FRAME);
+                out.reset(new Stamped<Result>{detect(item->value), item->captureTick});
+            }
+            processed++;
+            addCounter(COUNTER_FRAMES);
+            if (results.put(std::move(out))) droppedResults++;
+        }
+        detectDone = true;
+    });
+
+    while (true) {
+        bool finished = detectDone;  // mismo orden que en la detección: el último resultado no se pierde
+        std::unique_ptr<Stamped<Result>> r = results.take();
+        if (r) {
+            render(r->value);
+            stats.rendered++;
+            stats.totalLatencyMs += (cv::getTickCount() - r->captureTick) * 1000.0 / cv::getTickFrequency();
+        } else if (finished) {
+            break;
+        }
+        if (cv::waitKey(waitMs) == 27) break; // ESC para salir
+    }
+
+    stop = true;
+    captureThread.join();
+    detectThread.join();
+
+    stats.captured = captured;
+    stats.processed = processed;
+    stats.droppedFrames = dropped;
+    stats.droppedResults = droppedResults;
+    return stats;
+}
+
+inline void printPipelineStats(const PipelineStats &s) {
+    std::cout << "[INFO] Frames capturados: " << s.captured << ", procesados: " << s.processed
+              << ", descartados: " << s.droppedFrames << ", mostrados: " << s.rendered
+              << ", resultados sin mostrar: " << s.droppedResults;
+    if (s.rendered > 0) std::cout << ", latencia media: " << s.totalLatencyMs / s.rendered << " ms";
+    std::cout << std::endl;
+}
+
+#endif
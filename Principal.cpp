@@ -27,96 +27,311 @@
 #include <opencv2/video/video.hpp> // Manejo de vídeo
 #include <opencv2/videoio/videoio.hpp> // Lectura y escritura de vídeo
 #include <opencv2/features2d/features2d.hpp>  // Librería que incluye el método SIFT
+#include <opencv2/video/tracking.hpp> // Flujo óptico de Lucas-Kanade (KLT)
 
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
+// Pipeline de captura / detección / render en hilos separados
+#include "Pipeline.hpp"
+// Extractor seleccionable (SURF por defecto) y su norma de matching
+#include "FeatureBackend.hpp"
+// Resolución de trabajo según el tamaño de la cámara y presupuesto de keypoints
+#include "AdaptiveFeatures.hpp"
+// Tiempos por etapa y contadores exportados con --metrics
+#include "Metrics.hpp"
+// Dos vecinos + filtro de Lowe en un solo recorrido (AVX2/AVX-512 si la CPU lo permite)
+#include "RatioMatcher.hpp"
+#include <opencv2/calib3d/calib3d.hpp> // Homografía con RANSAC
+
 //#include <opencv2/opencv.hpp>
 
 
 using namespace std;
 using namespace cv; // Espacio de nombres de OpenCV
 
+// Con --verbose se imprime el conteo de matches de cada keyframe (cuesta tiempo en el bucle)
+bool verbose = false;
+
+// Parámetros del modo de seguimiento (--track)
+const int INTERVALO_KEYFRAME = 30;      // Frames máximos entre detecciones completas
+const int MIN_PUNTOS_SEGUIDOS = 15;     // Si quedan menos puntos se vuelve a detectar
+const double MIN_RATIO_INLIERS = 0.6;   // Fracción mínima de inliers de la homografía
+const float MAX_ERROR_IDA_VUELTA = 1.0f; // Error máximo (px) del flujo óptico hacia adelante y atrás
+
+// Estado del seguimiento entre frames
+struct EstadoSeguimiento {
+    bool activo = false;
+    int framesDesdeKeyframe = 0;
+    Mat grisAnterior;
+    vector<Point2f> puntosFrame;  // Posición actual de los puntos seguidos
+    vector<Point2f> puntosLogo;   // Punto correspondiente en el logo
+    Mat H;                        // Homografía logo -> frame
+};
+
+// Lo que la etapa de detección entrega al hilo principal para mostrar
+struct ResultadoFrame {
+    Mat frame;
+    Mat frameKeyPoints;  // solo en keyframes
+    Mat imgMatches;      // solo si hubo suficientes coincidencias
+};
+
+// Dibuja el contorno del logo proyectado con la homografía
+void dibujarLogo(Mat &img, const Mat &H, Size tamLogo){
+    vector<Point2f> esquinas = { Point2f(0, 0), Point2f((float)tamLogo.width, 0),
+                                 Point2f((float)tamLogo.width, (float)tamLogo.height),
+                                 Point2f(0, (float)tamLogo.height) };
+    vector<Point2f> proyectadas;
+    perspectiveTransform(esquinas, proyectadas, H);
+    vector<vector<Point> > poligono(1);
+    for(const auto &p : proyectadas){
+        poligono[0].push_back(Point((int)p.x, (int)p.y));
+    }
+    polylines(img, poligono, true, Scalar(0, 255, 0), 2, LINE_AA);
+}
+
+// Detección completa (keyframe): extractor + dos vecinos (RatioMatcher, L2 o Hamming) + filtro de Lowe.
+// Si hay suficientes coincidencias inicializa los puntos a seguir con los inliers de la homografía.
+// El frame ya llega a la resolución de trabajo: aquí solo se aplica el presupuesto de keypoints.
+bool detectarKeyframe(const Mat &frame, const Mat &gris, Ptr<Feature2D> detector, int norma,
+                      const AdaptiveParams &presupuesto,
+                      const vector<KeyPoint> &keyPointsLogo, const Mat &descriptorLogo,
+                      EstadoSeguimiento &estado, vector<KeyPoint> &keyPoints, vector<DMatch> &matchesFiltrados){
+    Mat descriptorVideo;
+    extractAdaptive(*detector, frame, presupuesto, keyPoints, descriptorVideo);
+
+    matchesFiltrados.clear();
+    estado.activo = false;
+    if(descriptorVideo.empty() || descriptorLogo.empty()){
+        return false;
+    }
+
+    {
+        ScopedTimer timer(METRIC_MATCHING);
+        float ratio = 0.67;
+        if(ratioMatchSupported(descriptorLogo, descriptorVideo, norma)){
+            ratioMatch(descriptorLogo, descriptorVideo, norma, ratio, matchesFiltrados);
+        } else {
+            vector<vector<DMatch> > matches;
+            BFMatcher matcher(norma);
+            matcher.knnMatch(descriptorLogo, descriptorVideo, matches, 2);
+            for(size_t i=0;i<matches.size();i++){
+                if(matches[i].size() == 2 && matches[i][0].distance < ratio*matches[i][1].distance){
+                    matchesFiltrados.push_back(matches[i][0]);
+                }
+            }
+        }
+    }
+    addCounter(COUNTER_GOOD_MATCHES, matchesFiltrados.size());
+    if(verbose){
+        cout << "Matches => Sin Filtrar = " << descriptorLogo.rows << " Filtrados = " << matchesFiltrados.size() << endl;
+    }
+
+    if(matchesFiltrados.size() <= 50){
+        return false;
+    }
+
+    vector<Point2f> ptsLogo, ptsFrame;
+    for(const auto &m : matchesFiltrados){
+        ptsLogo.push_back(keyPointsLogo[m.queryIdx].pt);
+        ptsFrame.push_back(keyPoints[m.trainIdx].pt);
+    }
+    Mat mascara;
+    Mat H;
+    {
+        ScopedTimer timer(METRIC_RANSAC);
+        H = findHomography(ptsLogo, ptsFrame, RANSAC, 5.0, mascara);
+    }
+    if(H.empty()){
+        return false;
+    }
+    addCounter(COUNTER_DETECTIONS);
+
+    estado.puntosLogo.clear();
+    estado.puntosFrame.clear();
+    for(int i=0;i<mascara.rows;i++){
+        if(mascara.at<uchar>(i)){
+            estado.puntosLogo.push_back(ptsLogo[i]);
+            estado.puntosFrame.push_back(ptsFrame[i]);
+        }
+    }
+    estado.H = H;
+    estado.activo = (int)estado.puntosFrame.size() >= MIN_PUNTOS_SEGUIDOS;
+    estado.framesDesdeKeyframe = 0;
+    estado.grisAnterior = gris.clone();
+    return true;
+}
+
+// Propaga los puntos del frame anterior con flujo óptico piramidal (KLT) y
+// reestima la homografía. Devuelve false si la calidad del seguimiento cae.
+bool seguirPuntos(const Mat &gris, EstadoSeguimiento &estado){
+    vector<Point2f> siguientes, regreso;
+    vector<uchar> estadoIda, estadoVuelta;
+    vector<float> error;
+    calcOpticalFlowPyrLK(estado.grisAnterior, gris, estado.puntosFrame, siguientes, estadoIda, error);
+    calcOpticalFlowPyrLK(gris, estado.grisAnterior, siguientes, regreso, estadoVuelta, error);
+
+    // Se conservan solo los puntos consistentes hacia adelante y hacia atrás
+    vector<Point2f> ptsLogo, ptsFrame;
+    for(size_t i=0;i<siguientes.size();i++){
+        if(!estadoIda[i] || !estadoVuelta[i]) continue;
+        Point2f d = regreso[i] - estado.puntosFrame[i];
+        if(d.x*d.x + d.y*d.y > MAX_ERROR_IDA_VUELTA*MAX_ERROR_IDA_VUELTA) continue;
+        ptsLogo.push_back(estado.puntosLogo[i]);
+        ptsFrame.push_back(siguientes[i]);
+    }
+    estado.grisAnterior = gris.clone();
+    estado.framesDesdeKeyframe++;
+
+    if((int)ptsFrame.size() < MIN_PUNTOS_SEGUIDOS){
+        estado.activo = false;
+        return false;
+    }
+
+    Mat mascara;
+    Mat H;
+    {
+        ScopedTimer timer(METRIC_RANSAC);
+        H = findHomography(ptsLogo, ptsFrame, RANSAC, 5.0, mascara);
+    }
+    int inliers = H.empty() ? 0 : countNonZero(mascara);
+    if(inliers < MIN_PUNTOS_SEGUIDOS || inliers < MIN_RATIO_INLIERS*ptsFrame.size()){
+        estado.activo = false;
+        return false;
+    }
+
+    estado.puntosLogo.clear();
+    estado.puntosFrame.clear();
+    for(int i=0;i<mascara.rows;i++){
+        if(mascara.at<uchar>(i)){
+            estado.puntosLogo.push_back(ptsLogo[i]);
+            estado.puntosFrame.push_back(ptsFrame[i]);
+        }
+    }
+    estado.H = H;
+    return true;
+}
+
+// Uso: ./principal [--track] [--features surf|sift|orb|akaze|brisk] [--max-side N] [--budget N] [--verbose]
+//                   [--metrics ARCHIVO [--metrics-interval S]]
+//   --track     detección completa solo en keyframes y seguimiento KLT de los inliers entre ellos
+//   --features  extractor del logo y de los keyframes (por defecto surf)
+//   --max-side  lado mayor al que se reduce cada frame (por defecto 448, el 0.7 de una cámara de 640)
+//   --budget    máximo de keypoints por keyframe (por defecto 1000, 0 = sin límite)
+//   --verbose   imprime los matches de cada keyframe
+//   --metrics   exporta tiempos por etapa y contadores (JSON si termina en .json, si no Prometheus)
 int main(int argc, char *argv[]){
 
+    bool modoSeguimiento = false;
+    for(int i=1;i<argc;i++){
+        if(string(argv[i]) == "--track") modoSeguimiento = true;
+        else if(string(argv[i]) == "--verbose") verbose = true;
+    }
+    initMetricsFromArgs(argc, argv, "principal");
+
+    // El logo ocupa buena parte del frame: no hace falta proteger señales pequeñas
+    AdaptiveParams resolucion;
+    resolucion.maxSide = 448;
+    resolucion.minSignPixels = 0;
+    resolucion.keypointBudget = 1000;
+    resolucion = parseAdaptiveArgs(argc, argv, resolucion);
+    AdaptiveParams presupuesto = resolucion;
+    presupuesto.maxSide = 0;
+
     VideoCapture video("/dev/video0");
                            //VideoCapture video("/home/video.mp4");
     if(video.isOpened()){
         namedWindow("Video", WINDOW_AUTOSIZE);
         namedWindow("KeyPoints", WINDOW_AUTOSIZE);
 
-        Mat frame;
-        Mat frameKeyPoints;
         Mat logoKeyPoints;
-        Mat frameResultado;
         Mat logo = imread("logoCatedra2025.jpg");
 
         
 
-        Ptr<cv::xfeatures2d::SURF> detector = cv::xfeatures2d::SURF::create();
+        FeatureBackend backend = parseFeaturesArg(argc, argv, FEATURE_SURF);
+        Ptr<Feature2D> detector = createFeatureExtractor(backend);
+        int norma = featureNorm(backend);
         
-        // Key Points del vídeo y del logo
-        vector<KeyPoint> keyPoints;
+        // Key Points del logo
         vector<KeyPoint> keyPointsLogo;
 
-        // Descriptores del vídeo y del logo
-        Mat descriptorVideo, descriptorLogo;
-
-        while(3==3){
-            video >> frame;
-            //flip(frame, frame, 1);
-            resize(frame, frame, Size(), 0.7, 0.7);
+        // Descriptores del logo: el logo no cambia, se calculan una sola vez
+        Mat descriptorLogo;
+        detector->detectAndCompute(logo, noArray(), keyPointsLogo, descriptorLogo);
+        drawKeypoints(logo, keyPointsLogo, logoKeyPoints);
 
-            // Detección de los KeyPoints
-            detector->detect(frame, keyPoints);
-            detector->detect(logo, keyPointsLogo);
+        // El estado del seguimiento solo lo toca el hilo de detección
+        EstadoSeguimiento estado;
 
-            // Cálculo del descriptor
-            detector->compute(frame, keyPoints,descriptorVideo);
-            detector->compute(logo, keyPointsLogo, descriptorLogo);
+        // Etapa de detección: recibe siempre el frame más reciente de la cámara
+        auto procesarFrame = [&](Mat &frame){
+            ResultadoFrame r;
+            //flip(frame, frame, 1);
+            double escala = adaptiveScale(frame.size(), resolucion);
+            if(escala < 1.0){
+                resize(frame, frame, Size(), escala, escala, INTER_AREA);
+            }
 
-            // Búsqueda del logo en el vídeo usando el BFMatcher
-            BFMatcher matcher;
-            Mat img_matches;
+            Mat gris;
+            cvtColor(frame, gris, COLOR_BGR2GRAY);
 
-            // Vector de coincidencias (matches)
-            vector<vector<DMatch> > matches;
-            matcher.knnMatch(descriptorLogo, descriptorVideo, matches, 2);
-
-            // Matches o coincidencias que cumplen con el valor del umbral propuesto por el 
-            // Prof. David Lowe
+            // Key Points del vídeo y matches o coincidencias que cumplen con el valor
+            // del umbral propuesto por el Prof. David Lowe
+            vector<KeyPoint> keyPoints;
             vector<DMatch> matchesFiltrados;
-            float ratio = 0.67;
-            for(int i=0;i<matches.size();i++){
-                if(matches[i][0].distance < ratio*matches[i][1].distance){
-                    matchesFiltrados.push_back(matches[i][0]);
+            bool keyframe = false;
+
+            if(modoSeguimiento && estado.activo && estado.framesDesdeKeyframe < INTERVALO_KEYFRAME){
+                // Entre keyframes solo se propagan los puntos; si el seguimiento falla se detecta de nuevo
+                if(!seguirPuntos(gris, estado)){
+                    keyframe = true;
                 }
+            } else {
+                keyframe = true;
             }
-            cout << "Matches => Sin Filtrar = " << matches.size() << " Filtrados = " << matchesFiltrados.size() << endl;
 
+            if(keyframe){
+                detectarKeyframe(frame, gris, detector, norma, presupuesto, keyPointsLogo, descriptorLogo, estado, keyPoints, matchesFiltrados);
 
+                r.frameKeyPoints = frame.clone();
+                drawKeypoints(frame, keyPoints, r.frameKeyPoints);
 
-            frameKeyPoints = frame.clone();
-
-            drawKeypoints(frame, keyPoints, frameKeyPoints);
-            drawKeypoints(logo, keyPointsLogo, logoKeyPoints);
+                // Búsqueda del logo en el vídeo usando el BFMatcher
+                if(matchesFiltrados.size()>50){
+                    drawMatches(logo, keyPointsLogo, frame, keyPoints, matchesFiltrados, r.imgMatches);
+                }
+            }
 
-            if(matchesFiltrados.size()>50){
-                drawMatches(logo, keyPointsLogo, frame, keyPoints, matchesFiltrados, img_matches);
-                imshow("Matches", img_matches);
+            if(modoSeguimiento && estado.activo){
+                dibujarLogo(frame, estado.H, logo.size());
+                for(const auto &p : estado.puntosFrame){
+                    circle(frame, Point((int)p.x, (int)p.y), 2, Scalar(0, 0, 255), -1);
+                }
             }
+            r.frame = frame;
+            return r;
+        };
 
-            imshow("Video", frame);            
-            imshow("KeyPoints", frameKeyPoints);
+        // Render en el hilo principal (imshow/waitKey); ESC para salir
+        auto mostrar = [&](ResultadoFrame &r){
+            if(!r.imgMatches.empty()){
+                imshow("Matches", r.imgMatches);
+            }
+            if(!r.frameKeyPoints.empty()){
+                imshow("KeyPoints", r.frameKeyPoints);
+            }
+            imshow("Video", r.frame);            
             imshow("KeyPointsLogo", logoKeyPoints);
-            
+        };
 
-            if(waitKey(23)==27)
-                break;
-        }
+        PipelineStats stats = runPipeline<ResultadoFrame>(
+            [&](Mat &frame){ video >> frame; return !frame.empty(); },
+            procesarFrame, mostrar);
+        printPipelineStats(stats);
 
         video.release();
         destroyAllWindows();
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,370 @@
+#include "RatioMatcher.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATCH_X86 1
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// Los dos mejores candidatos de una consulta. Con L2 las distancias van al cuadrado
+// (la raíz se saca solo para los matches que se emiten).
+struct Top2 {
+    float d0, d1;
+    int i0;
+};
+
+inline void pushCandidate(Top2 &b, float d, int idx) {
+    if (d < b.d0) {
+        b.d1 = b.d0;
+        b.d0 = d;
+        b.i0 = idx;
+    } else if (d < b.d1) {
+        b.d1 = d;
+    }
+}
+
+// Filas de train por bloque: 64 descriptores SIFT float ocupan 32 KB
+const int TRAIN_TILE = 64;
+
+// Recorre train por bloques contra grupos de 4 consultas. Kernel::dist4 calcula la
+// distancia de 4 consultas a una fila de train (la fila se carga una vez) y
+// Kernel::dist1 la de una consulta suelta. Se inyecta en cada variante con su
+// target, así las distancias se generan con las instrucciones de esa variante.
+template <typename Kernel>
+inline __attribute__((always_inline)) void top2Tiles(const Mat &query, const Mat &train, Top2 *best) {
+    int cols = query.cols;
+    for (int q = 0; q < query.rows; q++) best[q] = {FLT_MAX, FLT_MAX, -1};
+
+    for (int t0 = 0; t0 < train.rows; t0 += TRAIN_TILE) {
+        int t1 = min(train.rows, t0 + TRAIN_TILE);
+        int q = 0;
+        for (; q + 4 <= query.rows; q += 4) {
+            const uchar *qp[4] = {query.ptr(q), query.ptr(q + 1), query.ptr(q + 2), query.ptr(q + 3)};
+            Top2 b0 = best[q], b1 = best[q + 1], b2 = best[q + 2], b3 = best[q + 3];
+            for (int t = t0; t < t1; t++) {
+                float d[4];
+                Kernel::dist4(qp, train.ptr(t), cols, d);
+                pushCandidate(b0, d[0], t);
+                pushCandidate(b1, d[1], t);
+                pushCandidate(b2, d[2], t);
+                pushCandidate(b3, d[3], t);
+            }
+            best[q] = b0;
+            best[q + 1] = b1;
+            best[q + 2] = b2;
+            best[q + 3] = b3;
+        }
+        for (; q < query.rows; q++) {
+            const uchar *qp = query.ptr(q);
+            Top2 b = best[q];
+            for (int t = t0; t < t1; t++) pushCandidate(b, Kernel::dist1(qp, train.ptr(t), cols), t);
+            best[q] = b;
+        }
+    }
+}
+
+//----------------------------------------------------------
+// Kernels escalares
+//----------------------------------------------------------
+struct L2FloatScalar {
+    static inline float dist1(const uchar *q, const uchar *t, int cols) {
+        const float *a = (const float *)q, *b = (const float *)t;
+        float s = 0;
+        for (int k = 0; k < cols; k++) {
+            float d = a[k] - b[k];
+            s += d * d;
+        }
+        return s;
+    }
+    static inline void dist4(const uchar *const *q, const uchar *t, int cols, float *out) {
+        for (int j = 0; j < 4; j++) out[j] = dist1(q[j], t, cols);
+    }
+};
+
+struct L2ByteScalar {
+    static inline float dist1(const uchar *a, const uchar *b, int cols) {
+        int s = 0;
+        for (int k = 0; k < cols; k++) {
+            int d = (int)a[k] - (int)b[k];
+            s += d * d;
+        }
+        return (float)s;
+    }
+    static inline void dist4(const uchar *const *q, const uchar *t, int cols, float *out) {
+        for (int j = 0; j < 4; j++) out[j] = dist1(q[j], t, cols);
+    }
+};
+
+// Con target("popcnt") __builtin_popcountll pasa a ser una sola instrucción
+#define HAMMING_KERNEL(NAME, TARGET)                                                         \
+    struct NAME {                                                                            \
+        TARGET static inline float dist1(const uchar *a, const uchar *b, int cols) {         \
+            int s = 0, k = 0;                                                                \
+            for (; k + 8 <= cols; k += 8) {                                                  \
+                uint64_t x, y;                                                               \
+                memcpy(&x, a + k, 8);                                                        \
+                memcpy(&y, b + k, 8);                                                        \
+                s += __builtin_popcountll(x ^ y);                                            \
+            }                                                                                \
+            for (; k < cols; k++) s += __builtin_popcount((unsigned)(a[k] ^ b[k]));          \
+            return (float)s;                                                                 \
+        }                                                                                    \
+        TARGET static inline void dist4(const uchar *const *q, const uchar *t, int cols, float *out) { \
+            for (int j = 0; j < 4; j++) out[j] = dist1(q[j], t, cols);                       \
+        }                                                                                    \
+    };
+
+HAMMING_KERNEL(HammingScalar, )
+
+typedef void (*Top2Fn)(const Mat &, const Mat &, Top2 *);
+
+void top2L2FloatScalar(const Mat &q, const Mat &t, Top2 *best) { top2Tiles<L2FloatScalar>(q, t, best); }
+void top2L2ByteScalar(const Mat &q, const Mat &t, Top2 *best) { top2Tiles<L2ByteScalar>(q, t, best); }
+void top2HammingScalar(const Mat &q, const Mat &t, Top2 *best) { top2Tiles<HammingScalar>(q, t, best); }
+
+#ifdef MATCH_X86
+//----------------------------------------------------------
+// AVX2 + FMA: 8 floats (o 16 bytes) por iteración
+//----------------------------------------------------------
+__attribute__((target("avx2,fma"))) inline float horizontalSum(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma"))) inline int horizontalSum(__m256i v) {
+    __m128i lo = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    lo = _mm_add_epi32(lo, _mm_unpackhi_epi64(lo, lo));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 1));
+    return _mm_cvtsi128_si32(lo);
+}
+
+struct L2FloatAVX2 {
+    __attribute__((target("avx2,fma"))) static inline float dist1(const uchar *q, const uchar *t, int cols) {
+        const float *a = (const float *)q, *b = (const float *)t;
+        __m256 acc = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k));
+            acc = _mm256_fmadd_ps(d, d, acc);
+        }
+        float s = horizontalSum(acc);
+        for (; k < cols; k++) s += (a[k] - b[k]) * (a[k] - b[k]);
+        return s;
+    }
+    __attribute__((target("avx2,fma"))) static inline void dist4(const uchar *const *q, const uchar *t, int cols,
+                                                                  float *out) {
+        const float *q0 = (const float *)q[0], *q1 = (const float *)q[1], *q2 = (const float *)q[2],
+                    *q3 = (const float *)q[3], *b = (const float *)t;
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            __m256 tv = _mm256_loadu_ps(b + k);
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(q0 + k), tv);
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(q1 + k), tv);
+            __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(q2 + k), tv);
+            __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(q3 + k), tv);
+            a0 = _mm256_fmadd_ps(d0, d0, a0);
+            a1 = _mm256_fmadd_ps(d1, d1, a1);
+            a2 = _mm256_fmadd_ps(d2, d2, a2);
+            a3 = _mm256_fmadd_ps(d3, d3, a3);
+        }
+        out[0] = horizontalSum(a0);
+        out[1] = horizontalSum(a1);
+        out[2] = horizontalSum(a2);
+        out[3] = horizontalSum(a3);
+        for (; k < cols; k++) {
+            out[0] += (q0[k] - b[k]) * (q0[k] - b[k]);
+            out[1] += (q1[k] - b[k]) * (q1[k] - b[k]);
+            out[2] += (q2[k] - b[k]) * (q2[k] - b[k]);
+            out[3] += (q3[k] - b[k]) * (q3[k] - b[k]);
+        }
+    }
+};
+
+// uint8 -> int16, diferencia y madd (cuadrados sumados de a pares en int32)
+struct L2ByteAVX2 {
+    __attribute__((target("avx2,fma"))) static inline __m256i widen(const uchar *p) {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+    }
+    __attribute__((target("avx2,fma"))) static inline float dist1(const uchar *a, const uchar *b, int cols) {
+        __m256i acc = _mm256_setzero_si256();
+        int k = 0;
+        for (; k + 16 <= cols; k += 16) {
+            __m256i d = _mm256_sub_epi16(widen(a + k), widen(b + k));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+        }
+        int s = horizontalSum(acc);
+        for (; k < cols; k++) s += ((int)a[k] - (int)b[k]) * ((int)a[k] - (int)b[k]);
+        return (float)s;
+    }
+    __attribute__((target("avx2,fma"))) static inline void dist4(const uchar *const *q, const uchar *t, int cols,
+                                                                  float *out) {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256(), a2 = _mm256_setzero_si256(),
+                a3 = _mm256_setzero_si256();
+        int k = 0;
+        for (; k + 16 <= cols; k += 16) {
+            __m256i tv = widen(t + k);
+            __m256i d0 = _mm256_sub_epi16(widen(q[0] + k), tv);
+            __m256i d1 = _mm256_sub_epi16(widen(q[1] + k), tv);
+            __m256i d2 = _mm256_sub_epi16(widen(q[2] + k), tv);
+            __m256i d3 = _mm256_sub_epi16(widen(q[3] + k), tv);
+            a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(d0, d0));
+            a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(d1, d1));
+            a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(d2, d2));
+            a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(d3, d3));
+        }
+        int s[4] = {horizontalSum(a0), horizontalSum(a1), horizontalSum(a2), horizontalSum(a3)};
+        for (int j = 0; j < 4; j++) {
+            for (int r = k; r < cols; r++) s[j] += ((int)q[j][r] - (int)t[r]) * ((int)q[j][r] - (int)t[r]);
+            out[j] = (float)s[j];
+        }
+    }
+};
+
+//----------------------------------------------------------
+// AVX-512: 16 floats por iteración; la cola se lee con máscara
+//----------------------------------------------------------
+struct L2FloatAVX512 {
+    __attribute__((target("avx512f"))) static inline float dist1(const uchar *q, const uchar *t, int cols) {
+        const float *a = (const float *)q, *b = (const float *)t;
+        __m512 acc = _mm512_setzero_ps();
+        for (int k = 0; k < cols; k += 16) {
+            __mmask16 m = cols - k >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (cols - k)) - 1);
+            __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + k), _mm512_maskz_loadu_ps(m, b + k));
+            acc = _mm512_fmadd_ps(d, d, acc);
+        }
+        return _mm512_reduce_add_ps(acc);
+    }
+    __attribute__((target("avx512f"))) static inline void dist4(const uchar *const *q, const uchar *t, int cols,
+                                                                 float *out) {
+        const float *q0 = (const float *)q[0], *q1 = (const float *)q[1], *q2 = (const float *)q[2],
+                    *q3 = (const float *)q[3], *b = (const float *)t;
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        for (int k = 0; k < cols; k += 16) {
+            __mmask16 m = cols - k >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (cols - k)) - 1);
+            __m512 tv = _mm512_maskz_loadu_ps(m, b + k);
+            __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, q0 + k), tv);
+            __m512 d1 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, q1 + k), tv);
+            __m512 d2 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, q2 + k), tv);
+            __m512 d3 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, q3 + k), tv);
+            a0 = _mm512_fmadd_ps(d0, d0, a0);
+            a1 = _mm512_fmadd_ps(d1, d1, a1);
+            a2 = _mm512_fmadd_ps(d2, d2, a2);
+            a3 = _mm512_fmadd_ps(d3, d3, a3);
+        }
+        out[0] = _mm512_reduce_add_ps(a0);
+        out[1] = _mm512_reduce_add_ps(a1);
+        out[2] = _mm512_reduce_add_ps(a2);
+        out[3] = _mm512_reduce_add_ps(a3);
+    }
+};
+
+HAMMING_KERNEL(HammingPopcnt, __attribute__((target("popcnt"))))
+
+__attribute__((target("avx2,fma"))) void top2L2FloatAVX2(const Mat &q, const Mat &t, Top2 *best) {
+    top2Tiles<L2FloatAVX2>(q, t, best);
+}
+__attribute__((target("avx2,fma"))) void top2L2ByteAVX2(const Mat &q, const Mat &t, Top2 *best) {
+    top2Tiles<L2ByteAVX2>(q, t, best);
+}
+__attribute__((target("avx512f"))) void top2L2FloatAVX512(const Mat &q, const Mat &t, Top2 *best) {
+    top2Tiles<L2FloatAVX512>(q, t, best);
+}
+__attribute__((target("popcnt"))) void top2HammingPopcnt(const Mat &q, const Mat &t, Top2 *best) {
+    top2Tiles<HammingPopcnt>(q, t, best);
+}
+#endif
+
+enum SimdLevel { SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512 };
+
+SimdLevel detectSimd() {
+#ifdef MATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+const SimdLevel simdLevel = detectSimd();
+
+bool hasPopcnt() {
+#ifdef MATCH_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt");
+#else
+    return false;
+#endif
+}
+
+const bool usePopcnt = hasPopcnt();
+
+Top2Fn kernelFor(int type, int normType) {
+    if (normType == NORM_L2 && type == CV_32F) {
+#ifdef MATCH_X86
+        if (simdLevel == SIMD_AVX512) return top2L2FloatAVX512;
+        if (simdLevel == SIMD_AVX2) return top2L2FloatAVX2;
+#endif
+        return top2L2FloatScalar;
+    }
+    if (normType == NORM_L2 && type == CV_8U) {
+#ifdef MATCH_X86
+        if (simdLevel != SIMD_SCALAR) return top2L2ByteAVX2;
+#endif
+        return top2L2ByteScalar;
+    }
+    if (normType == NORM_HAMMING && type == CV_8U) {
+#ifdef MATCH_X86
+        if (usePopcnt) return top2HammingPopcnt;
+#endif
+        return top2HammingScalar;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool ratioMatchSupported(const Mat &query, const Mat &train, int normType) {
+    return query.type() == train.type() && query.cols == train.cols && kernelFor(query.type(), normType) != nullptr;
+}
+
+void ratioMatch(const Mat &query, const Mat &train, int normType, float ratio, vector<DMatch> &matches) {
+    matches.clear();
+    if (query.empty() || train.rows < 2) return;  // knnMatch tampoco da segundo vecino
+    Top2Fn top2 = kernelFor(query.type(), normType);
+    if (!top2) return;
+
+    // Estado por consulta reutilizado entre llamadas del mismo hilo
+    thread_local vector<Top2> best;
+    if (best.size() < (size_t)query.rows) best.resize(query.rows);
+    top2(query, train, best.data());
+
+    bool l2 = normType == NORM_L2;
+    float threshold = l2 ? ratio * ratio : ratio;  // con L2 se comparan distancias al cuadrado
+    matches.reserve(query.rows);
+    for (int q = 0; q < query.rows; q++) {
+        const Top2 &b = best[q];
+        if (b.d0 < threshold * b.d1) matches.push_back(DMatch(q, b.i0, l2 ? sqrt(b.d0) : b.d0));
+    }
+}
+
+const char *ratioMatchBackend(int type, int normType) {
+    Top2Fn top2 = kernelFor(type, normType);
+    if (top2 == nullptr) return "DescriptorMatcher";
+#ifdef MATCH_X86
+    if (top2 == top2L2FloatAVX512) return "avx512";
+    if (top2 == top2L2FloatAVX2 || top2 == top2L2ByteAVX2) return "avx2";
+    if (top2 == top2HammingPopcnt) return "popcnt";
+#endif
+    return "escalar";
+}
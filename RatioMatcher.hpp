@@ -0,0 +1,32 @@
+#ifndef RATIO_MATCHER_HPP
+#define RATIO_MATCHER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Matching por fuerza bruta con los dos vecinos más cercanos y el test de Lowe
+// en un solo recorrido, sin pasar por knnMatch ni vector<vector<DMatch>>.
+//
+// Las distancias se calculan por bloques: un bloque de filas de train (que queda
+// en la caché L1) contra grupos de 4 consultas, así cada fila de train se carga
+// una vez para las 4. Los dos mejores de cada consulta viven en variables locales
+// durante el bloque y al final solo se emiten los matches que pasan el test.
+//
+// Normas soportadas (el resto debe seguir usando un DescriptorMatcher):
+//   NORM_L2 con CV_32F      AVX-512 o AVX2 + FMA si la CPU lo permite
+//   NORM_L2 con CV_8U       descriptores float cuantizados (DescriptorCodec), AVX2
+//   NORM_HAMMING con CV_8U  ORB, AKAZE, BRISK; popcount de 64 bits
+bool ratioMatchSupported(const cv::Mat &query, const cv::Mat &train, int normType);
+
+// Para cada fila de query busca las dos filas más cercanas de train y emite
+// DMatch(query, mejor, distancia) si d1 < ratio * d2, igual que knnMatch(k = 2)
+// seguido del filtro de Lowe. Con menos de 2 filas en train no hay matches.
+// matches se vacía y se reutiliza: una vez que tiene capacidad, la llamada no reserva memoria.
+void ratioMatch(const cv::Mat &query, const cv::Mat &train, int normType, float ratio,
+                std::vector<cv::DMatch> &matches);
+
+// Nombre del kernel que usa ratioMatch en esta CPU para ese tipo y norma ("avx512", "avx2",
+// "popcnt" o "escalar"; "DescriptorMatcher" si no está soportado), para los logs
+const char *ratioMatchBackend(int type, int normType);
+
+#endif
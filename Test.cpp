@@ -3,6 +3,10 @@
 #include <opencv2/features2d.hpp>
 #include <filesystem>
 #include <iostream>
+#include "FeatureBackend.hpp"
+#include "GlobalIndex.hpp"
+#include "Metrics.hpp"
+#include "Pipeline.hpp"
 
 using namespace std;
 using namespace cv;
@@ -16,9 +20,9 @@ vector<string> reference_names;
 vector<vector<KeyPoint>> ref_keypoints;
 vector<Mat> ref_descriptors;
 
-// Inicializar SIFT y FLANN Matcher
-Ptr<SIFT> sift = SIFT::create();
-Ptr<FlannBasedMatcher> flannMatcher = FlannBasedMatcher::create();
+// Extractor (SIFT por defecto, --features para cambiarlo) y el índice FLANN global sobre todas las referencias
+Ptr<Feature2D> extractor;
+GlobalIndex refIndex;
 
 void cargarReferencias() {
     for (const auto& entry : fs::directory_iterator(REFERENCE_FOLDER)) {
@@ -29,7 +33,7 @@ void cargarReferencias() {
 
             vector<KeyPoint> kp;
             Mat des;
-            sift->detectAndCompute(img, noArray(), kp, des);
+            extractor->detectAndCompute(img, noArray(), kp, des);
 
             if (!des.empty()) {
                 reference_images.push_back(img);
@@ -40,54 +44,71 @@ void cargarReferencias() {
         }
     }
     cout << "[INFO] Se cargaron " << ref_descriptors.size() << " imágenes de referencia con descriptores." << endl;
+
+    // El índice se construye una sola vez; cada frame hace una única consulta
+    refIndex.build(ref_descriptors);
 }
 
-void detectarObjetos(Mat& frame) {
+// Resultado de la etapa de detección que se muestra en el hilo principal
+struct ResultadoFrame {
+    Mat frame;
+    Mat match_img; // vacío si no hubo detección
+};
+
+// Se ejecuta en el hilo de detección: no llama a imshow
+Mat detectarObjetos(Mat& frame) {
     Mat gray;
     cvtColor(frame, gray, COLOR_BGR2GRAY);
 
     vector<KeyPoint> kp;
     Mat des;
-    sift->detectAndCompute(gray, noArray(), kp, des);
+    {
+        ScopedTimer timer(METRIC_FEATURES);
+        extractor->detectAndCompute(gray, noArray(), kp, des);
+    }
+    addCounter(COUNTER_KEYPOINTS, kp.size());
 
     if (des.empty()) {
         cout << "[ERROR] No se encontraron descriptores en el frame." << endl;
-        return;
+        return Mat();
     }
 
+    vector<DMatch> global_matches;
+    refIndex.match(des, 0.6f, global_matches); // Filtro de Lowe (ajustado a 0.6)
+    vector<int> votes = refIndex.votesPerImage(global_matches);
+
     int best_match = -1;
-    vector<DMatch> best_matches;
     int max_matches = 0;
-
-    for (size_t i = 0; i < ref_descriptors.size(); i++) {
-        vector<vector<DMatch>> matches;
-        flannMatcher->knnMatch(ref_descriptors[i], des, matches, 2);
-
-
-        vector<DMatch> good_matches;
-        for (const auto& m : matches) {
-            if (m[0].distance < 0.6 * m[1].distance) { // Filtro de Lowe (ajustado a 0.6)
-                good_matches.push_back(m[0]);
-            }
+    for (size_t i = 0; i < votes.size(); i++) {
+        if (votes[i] > max_matches) {
+            max_matches = votes[i];
+            best_match = i;
         }
+    }
 
-        if (good_matches.size() > max_matches) {
-            max_matches = good_matches.size();
-            best_match = i;
-            best_matches = good_matches;
+    // drawMatches espera query = referencia, train = frame
+    vector<DMatch> best_matches;
+    for (const auto& m : global_matches) {
+        if (m.imgIdx == best_match) {
+            best_matches.push_back(DMatch(m.trainIdx, m.queryIdx, m.distance));
         }
     }
 
+    Mat match_img;
     if (best_match != -1 && best_matches.size() > 30) { // Se requieren al menos 30 matches
-        Mat match_img;
         drawMatches(reference_images[best_match], ref_keypoints[best_match], frame, kp, best_matches, match_img,
                     Scalar::all(-1), Scalar::all(-1), vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
-
-        imshow("Matches", match_img);
     }
+    return match_img;
 }
 
-int main() {
+// Uso: ./vision.bin [--features sift|surf|orb|akaze|brisk] [--metrics ARCHIVO [--metrics-interval S]]
+//   --metrics  exporta tiempos por etapa y contadores (JSON si termina en .json, si no Prometheus)
+int main(int argc, char *argv[]) {
+    initMetricsFromArgs(argc, argv, "vision");
+    FeatureBackend backend = parseFeaturesArg(argc, argv);
+    extractor = createFeatureExtractor(backend);
+    cout << "[INFO] Extractor: " << featureBackendName(backend) << endl;
     cargarReferencias();
 
     VideoCapture cap(0);  // Abre la cámara (0 para cámara predeterminada)
@@ -96,16 +117,15 @@ int main() {
         return -1;
     }
 
-    Mat frame;
-    while (true) {
-        cap >> frame;
-        if (frame.empty()) break;
-
-        detectarObjetos(frame);
-        imshow("Cámara", frame);
-
-        if (waitKey(1) == 27) break; // Presionar 'ESC' para salir
-    }
+    // Captura, detección y render en hilos separados; el detector siempre toma el frame más reciente
+    PipelineStats stats = runPipeline<ResultadoFrame>(
+        [&](Mat& frame) { cap >> frame; return !frame.empty(); },
+        [](Mat& frame) { return ResultadoFrame{frame, detectarObjetos(frame)}; },
+        [](ResultadoFrame& r) {
+            if (!r.match_img.empty()) imshow("Matches", r.match_img);
+            imshow("Cámara", r.frame);
+        }); // Presionar 'ESC' para salir
+    printPipelineStats(stats);
 
     cap.release();
     destroyAllWindows();
@@ -2,45 +2,60 @@
 #include <opencv2/xfeatures2d.hpp>
 #include <iostream>
 #include <filesystem>
+#include "AdaptiveFeatures.hpp"
+#include "DatasetLoader.hpp"
+#include "DescriptorCodec.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "GlobalIndex.hpp"
+#include "Metrics.hpp"
 
 using namespace cv;
 using namespace std;
 namespace fs = std::filesystem;
 
 // Variables globales
+DescriptorDB dataset_db; // 🔹 Base mapeada en memoria; los descriptores apuntan a ella
 vector<Mat> dataset_descriptors;
 vector<Rect> dataset_bboxes;
-Ptr<SIFT> sift = SIFT::create();
+GlobalIndex dataset_index; // 🔹 Índice FLANN único sobre todos los descriptores del dataset
+Ptr<Feature2D> extractor; // 🔹 El mismo extractor con el que se generó la base
+DescriptorCodec dataset_codec; // 🔹 Cuantización / PCA de la base, se aplica también a las consultas
+AdaptiveParams test_adaptive; // 🔹 Resolución de trabajo y presupuesto de keypoints de las imágenes de test
 
-// 🔹 Cargar los descriptores SIFT y bounding boxes desde YAML
+// 🔹 Cargar los descriptores SIFT y bounding boxes desde la base binaria (mmap, sin copias)
 void loadSIFTDescriptors(const string &filename)
 {
-    FileStorage fs(filename, FileStorage::READ);
-    if (!fs.isOpened())
+    if (!dataset_db.open(filename))
     {
         cerr << "Error al abrir el archivo de descriptores SIFT." << endl;
         return;
     }
 
-    int i = 0;
-    while (true)
+    for (size_t i = 0; i < dataset_db.size(); i++)
     {
-        Mat descriptors;
-        Rect bbox;
-        string key = "image_" + to_string(i);
-        fs[key] >> descriptors;
-        fs["bbox_" + to_string(i)] >> bbox;
-
-        if (descriptors.empty())
-            break;
-
-        dataset_descriptors.push_back(descriptors);
-        dataset_bboxes.push_back(bbox);
-        i++;
+        dataset_descriptors.push_back(dataset_db.descriptors(i));
+        dataset_bboxes.push_back(dataset_db.bbox(i));
     }
 
-    fs.release();
     cout << "✅ Descriptores de SIFT y bounding boxes cargados desde " << filename << " (" << dataset_descriptors.size() << " imágenes, " << dataset_bboxes.size() << " bounding boxes)" << endl;
+
+    if (!loadCodecFor(dataset_db, filename, dataset_codec))
+    {
+        dataset_db.close();
+        return;
+    }
+
+    FeatureBackend backend = dataset_db.featureBackend();
+    extractor = createFeatureExtractor(backend);
+    cout << "🔹 Extractor de la base: " << featureBackendName(backend) << endl;
+
+    // 🔹 El índice se construye al entrenar; si falta o no corresponde a la base se reconstruye aquí
+    if (!dataset_index.load(dataset_db, indexPathFor(filename)))
+    {
+        cerr << "⚠️ No se encontró un índice válido junto a " << filename << ", se construye en memoria." << endl;
+        dataset_index.build(dataset_db);
+    }
 }
 
 // 🔹 Detección del ROI basado en la densidad de matches SIFT
@@ -52,7 +67,7 @@ Rect detectROIFromMatches(const vector<DMatch> &matches, const vector<KeyPoint>
     vector<Point2f> matched_points;
     for (const auto &match : matches)
     {
-        matched_points.push_back(keypoints[match.trainIdx].pt);
+        matched_points.push_back(keypoints[match.queryIdx].pt);
     }
 
     // 🔹 Encontrar un rectángulo que encierre la mayoría de los keypoints coincidentes
@@ -60,9 +75,8 @@ Rect detectROIFromMatches(const vector<DMatch> &matches, const vector<KeyPoint>
 }
 
 // 🔹 Proceso de prueba con detección de SIFT
-void processTestImage(const string &image_path)
+void processTestImage(const string &image_path, const Mat &img)
 {
-    Mat img = imread(image_path, IMREAD_GRAYSCALE);
     if (img.empty())
     {
         cerr << "Error al cargar la imagen de test: " << image_path << endl;
@@ -70,11 +84,13 @@ void processTestImage(const string &image_path)
     }
 
     cout << "🔍 Procesando imagen de test: " << image_path << " Tamaño: " << img.cols << "x" << img.rows << endl;
+    int64 start = getTickCount();
 
     // 🔹 Extraer descriptores SIFT de la imagen de test
     vector<KeyPoint> keypoints_test;
     Mat descriptors_test;
-    sift->detectAndCompute(img, noArray(), keypoints_test, descriptors_test);
+    double scale = extractAdaptive(*extractor, img, test_adaptive, keypoints_test, descriptors_test);
+    dataset_codec.encode(descriptors_test, descriptors_test);
 
     if (descriptors_test.empty())
     {
@@ -82,34 +98,31 @@ void processTestImage(const string &image_path)
         return;
     }
 
-    cout << "✅ Descriptores detectados en la imagen de test: " << descriptors_test.rows << endl;
+    cout << "✅ Descriptores detectados en la imagen de test: " << descriptors_test.rows << " (escala " << scale << ")" << endl;
+
+    // 🔹 Comparación con el dataset: una sola consulta al índice global y votos por imagen
+    vector<DMatch> global_matches;
+    dataset_index.match(descriptors_test, 0.75f, global_matches);
+    vector<int> votes = dataset_index.votesPerImage(global_matches);
 
-    // 🔹 Comparación con el dataset
-    FlannBasedMatcher matcher;
     int best_match_idx = -1;
-    vector<DMatch> best_matches;
     int max_matches = 0;
-
-    for (size_t i = 0; i < dataset_descriptors.size(); ++i)
+    for (size_t i = 0; i < votes.size(); ++i)
     {
-        vector<vector<DMatch>> knn_matches;
-        matcher.knnMatch(dataset_descriptors[i], descriptors_test, knn_matches, 2);
-
-        vector<DMatch> good_matches;
-        for (const auto &m : knn_matches)
+        if (votes[i] > max_matches)
         {
-            if (m[0].distance < 0.75 * m[1].distance)
-                good_matches.push_back(m[0]);
-        }
-
-        if (good_matches.size() > max_matches)
-        {
-            max_matches = good_matches.size();
+            max_matches = votes[i];
             best_match_idx = i;
-            best_matches = good_matches;
         }
     }
 
+    vector<DMatch> best_matches;
+    for (const auto &m : global_matches)
+    {
+        if (m.imgIdx == best_match_idx)
+            best_matches.push_back(m);
+    }
+
     if (best_match_idx == -1)
     {
         cerr << "⚠️ No se encontró un match significativo con el dataset." << endl;
@@ -127,6 +140,11 @@ void processTestImage(const string &image_path)
         return;
     }
 
+    // 🔹 Tiempo de detección sin contar la ventana
+    recordStage(METRIC_FRAME, (getTickCount() - start) * 1000.0 / getTickFrequency());
+    addCounter(COUNTER_FRAMES);
+    addCounter(COUNTER_DETECTIONS);
+
     // 🔹 Dibujar el ROI en la imagen original
     Mat img_result;
     cvtColor(img, img_result, COLOR_GRAY2BGR);
@@ -139,22 +157,34 @@ void processTestImage(const string &image_path)
 }
 
 // Main
-int main()
+// Opciones: --db ARCHIVO (base de train.bin, p. ej. orb_descriptors.vdb; por defecto sift_descriptors.vdb)
+// --max-side N (lado mayor de trabajo, 0 = original) y --budget N (máximo de keypoints, 0 = sin límite)
+// --metrics ARCHIVO [--metrics-interval S]: tiempos por etapa y contadores (JSON si termina en .json, si no Prometheus)
+int main(int argc, char *argv[])
 {
-    string sift_file = "sift_descriptors.yml"; // Archivo con los descriptores guardados
+    initMetricsFromArgs(argc, argv, "test2");
+    string sift_file = "sift_descriptors.vdb"; // Archivo con los descriptores guardados (--db para otro extractor)
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (string(argv[i]) == "--db")
+            sift_file = argv[++i];
+    }
     string test_folder = "test/"; // Carpeta donde están las imágenes de prueba
+    test_adaptive = parseAdaptiveArgs(argc, argv);
 
     // 🔹 Cargar los descriptores SIFT del dataset
     loadSIFTDescriptors(sift_file);
-
-    // 🔹 Iterar sobre todas las imágenes en la carpeta de test
-    for (const auto &entry : fs::directory_iterator(test_folder))
+    if (!dataset_db.isOpen())
+        return -1;
+
+    // 🔹 Iterar sobre todas las imágenes en la carpeta de test; la siguiente se decodifica
+    // en segundo plano mientras se procesa o se muestra la actual
+    ImagePrefetcher prefetcher(listDatasetImages(test_folder), IMREAD_GRAYSCALE);
+    string test_image;
+    Mat img;
+    while (prefetcher.next(test_image, img))
     {
-        if (entry.path().extension() == ".jpg" || entry.path().extension() == ".png")
-        {
-            string test_image = entry.path().string();
-            processTestImage(test_image); // Probar imagen
-        }
+        processTestImage(test_image, img); // Probar imagen
     }
 
     return 0;
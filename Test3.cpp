@@ -1,176 +1,450 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/xfeatures2d.hpp>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include "AdaptiveFeatures.hpp"
+#include "Cascade.hpp"
+#include "DatasetLoader.hpp"
+#include "DescriptorCodec.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "HomographyDetector.hpp"
+#include "Metrics.hpp"
+#include "Parallel.hpp"
+#include "RatioMatcher.hpp"
+#include "Vocabulary.hpp"
 
 using namespace std;
 using namespace cv;
 using namespace cv::xfeatures2d;
 namespace fs = std::filesystem;
 
-// Estructura para almacenar los ROIs entrenados
-struct TrainROI {
-    Mat descriptors;
-    vector<Point2f> kpCoords;
-    Rect bbox;
+// Tiempos de cada etapa para una imagen (ms)
+struct ImageTiming {
+    double decodeMs = 0;
+    double candidatesMs = 0;    // cascada: segmentación del rojo + LBP/SVM
+    double featuresMs = 0;
+    double retrievalMs = 0;     // preselección con el vocabulario visual
+    double matchingMs = 0;
+    double totalMs = 0;
 };
 
-// Función para cargar los descriptores desde el archivo YML
-vector<TrainROI> loadTrainDescriptors(const string &trainYml) {
-    FileStorage fsIn(trainYml, FileStorage::READ);
-    vector<TrainROI> trainROIs;
+// Resultado de una imagen en modo batch
+struct BatchResult {
+    string imagePath;
+    bool ok = false;
+    string error;
+    vector<RoiDetection> detections;
+    ImageTiming timing;
+    int candidates = -1;        // cascada: candidatos que pasaron a SIFT (-1 sin cascada)
+    bool usedFallback = false;  // cascada: se repitió con el frame completo
+};
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+// Lista de imágenes a procesar: una carpeta o un archivo de texto con una ruta por línea
+vector<string> collectImages(const string &input) {
+    vector<string> images;
+    if (fs::is_directory(input)) {
+        images = listDatasetImages(input);
+    } else {
+        ifstream list(input);
+        string line;
+        while (getline(list, line)) {
+            if (!line.empty()) images.push_back(line);
+        }
+    }
+    return images;
+}
+
+// Todo lo que hace falta para tratar una consulta igual que la base
+struct QuerySetup {
+    FeatureBackend backend = FEATURE_SIFT;          // extractor con el que se generó la base
+    DescriptorCodec codec;                          // cuantización / PCA de la base
+    const VisualVocabulary *vocabulary = nullptr;   // preselección (nulo: todas las ROIs)
+    int topK = 0;
+    AdaptiveParams adaptive;                        // resolución de trabajo y presupuesto de keypoints
+    bool cascade = false;                           // color/LBP antes de las características
+    const SignClassifier *classifier = nullptr;     // cascada: LBP + SVM (nulo: solo color)
+    CascadeParams cascadeParams;
+};
+
+// Preselección: las topK ROIs más parecidas según el vocabulario visual.
+// Sin vocabulario (o con topK = 0) devuelve false y se prueban todas las ROIs.
+bool shortlistROIs(const QuerySetup &setup, const Mat &testDes, vector<int> &shortlist) {
+    if (!setup.vocabulary || setup.topK <= 0) return false;
+    shortlist = setup.vocabulary->shortlist(testDes, setup.topK);
+    return true;
+}
+
+// Procesa una imagen sin interfaz gráfica (se llama desde varios hilos)
+BatchResult processBatchImage(const string &imagePath, const vector<TrainROI> &trainROIs,
+                              const DetectorParams &params, const string &annotateDir, const QuerySetup &setup) {
+    thread_local Ptr<Feature2D> extractor = createFeatureExtractor(setup.backend);
+    thread_local Ptr<DescriptorMatcher> matcher = createFeatureMatcher(setup.backend);
+
+    BatchResult r;
+    r.imagePath = imagePath;
+    int64 start = getTickCount();
+
+    Mat testImg = imread(imagePath, IMREAD_COLOR);
+    r.timing.decodeMs = msSince(start);
+    recordStage(METRIC_DECODE, r.timing.decodeMs);
+    if (testImg.empty()) {
+        r.error = "No se pudo cargar la imagen";
+        return r;
+    }
+
+    // Códec, preselección y homografías sobre las características de la consulta
+    auto verify = [&](const vector<KeyPoint> &testKp, const Mat &des) {
+        int64 tv = getTickCount();
+        Mat testDes;
+        setup.codec.encode(des, testDes);
+        r.timing.featuresMs += msSince(tv);
+
+        tv = getTickCount();
+        vector<int> shortlist;
+        bool useShortlist = shortlistROIs(setup, testDes, shortlist);
+        r.timing.retrievalMs += msSince(tv);
+
+        tv = getTickCount();
+        vector<RoiDetection> detections = detectROIs(testKp, testDes, testImg.size(), trainROIs, params, *matcher,
+                                                     false, nullptr, useShortlist ? &shortlist : nullptr);
+        r.timing.matchingMs += msSince(tv);
+        return detections;
+    };
 
-    if (!fsIn.isOpened()) {
-        cerr << "[ERROR] No se pudo abrir " << trainYml << endl;
-        return trainROIs;
+    if (setup.cascade) {
+        CascadeTiming ct;
+        CascadeResult cascade = runCascade(testImg, setup.classifier, *extractor, setup.adaptive,
+                                           setup.cascadeParams, verify, &ct);
+        r.timing.candidatesMs = ct.candidatesMs;
+        r.timing.featuresMs += ct.featuresMs;
+        r.detections = cascade.detections;
+        r.candidates = (int)cascade.candidates.size();
+        r.usedFallback = cascade.usedFallback;
+    } else {
+        int64 t = getTickCount();
+        Mat testGray;
+        cvtColor(testImg, testGray, COLOR_BGR2GRAY);
+        vector<KeyPoint> testKp;
+        Mat testDes;
+        extractAdaptive(*extractor, testGray, setup.adaptive, testKp, testDes);
+        r.timing.featuresMs += msSince(t);
+        if (testDes.empty()) {
+            r.error = "No se detectaron descriptores";
+            return r;
+        }
+        r.detections = verify(testKp, testDes);
     }
+    r.timing.totalMs = msSince(start);
+    r.ok = true;
+    recordStage(METRIC_FRAME, r.timing.totalMs);
+    addCounter(COUNTER_FRAMES);
 
-    int i = 0;
-    while (true) {
-        string descriptorKey = "descriptor_" + to_string(i);
-        FileNode descNode = fsIn[descriptorKey];
-        if (descNode.empty()) break;
+    if (!annotateDir.empty()) {
+        drawDetections(testImg, r.detections);
+        imwrite((fs::path(annotateDir) / fs::path(imagePath).filename()).string(), testImg);
+    }
+    return r;
+}
+
+static string jsonEscape(const string &s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Campo CSV entre comillas: las comillas internas se duplican (RFC 4180)
+static string csvQuote(const string &s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
 
-        Mat des;
-        descNode >> des;
+void writeCSV(const string &path, const vector<BatchResult> &results) {
+    ofstream out(path);
+    out << "image,status,roi,good_matches,inliers,x0,y0,x1,y1,x2,y2,x3,y3,decode_ms,candidates_ms,features_ms,retrieval_ms,matching_ms,total_ms\n";
+    for (const auto &r : results) {
+        string timing = to_string(r.timing.decodeMs) + "," + to_string(r.timing.candidatesMs) + "," + to_string(r.timing.featuresMs) + "," +
+                        to_string(r.timing.retrievalMs) + "," + to_string(r.timing.matchingMs) + "," + to_string(r.timing.totalMs);
+        string status = r.ok ? "ok" : csvQuote(r.error);
+        // Una fila por detección; las imágenes sin detecciones quedan con roi = -1
+        if (r.detections.empty()) {
+            out << csvQuote(r.imagePath) << "," << status << ",-1,0,0,,,,,,,,," << timing << "\n";
+            continue;
+        }
+        for (const auto &d : r.detections) {
+            out << csvQuote(r.imagePath) << "," << status << "," << d.roiIndex << "," << d.goodMatches << "," << d.inliers;
+            for (const auto &pt : d.corners) out << "," << pt.x << "," << pt.y;
+            out << "," << timing << "\n";
+        }
+    }
+}
 
-        string bboxKey = "bbox_" + to_string(i);
-        FileNode bboxNode = fsIn[bboxKey];
-        Rect roiRect(0, 0, 0, 0);
-        if (!bboxNode.empty() && bboxNode.size() == 4) {
-            roiRect = Rect((int)bboxNode[0], (int)bboxNode[1], 
-                           (int)bboxNode[2] - (int)bboxNode[0], 
-                           (int)bboxNode[3] - (int)bboxNode[1]);
+void writeJSON(const string &path, const vector<BatchResult> &results) {
+    ofstream out(path);
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BatchResult &r = results[i];
+        out << "  {\"image\": \"" << jsonEscape(r.imagePath) << "\", \"ok\": " << (r.ok ? "true" : "false");
+        if (!r.ok) out << ", \"error\": \"" << jsonEscape(r.error) << "\"";
+        if (r.candidates >= 0) {
+            out << ", \"candidates\": " << r.candidates << ", \"fallback\": " << (r.usedFallback ? "true" : "false");
         }
+        out << ", \"timing_ms\": {\"decode\": " << r.timing.decodeMs << ", \"candidates\": " << r.timing.candidatesMs
+            << ", \"features\": " << r.timing.featuresMs
+            << ", \"retrieval\": " << r.timing.retrievalMs << ", \"matching\": " << r.timing.matchingMs << ", \"total\": " << r.timing.totalMs << "}";
+        out << ", \"detections\": [";
+        for (size_t k = 0; k < r.detections.size(); k++) {
+            const RoiDetection &d = r.detections[k];
+            out << (k ? ", " : "") << "{\"roi\": " << d.roiIndex << ", \"good_matches\": " << d.goodMatches
+                << ", \"inliers\": " << d.inliers << ", \"corners\": [";
+            for (size_t c = 0; c < d.corners.size(); c++) {
+                out << (c ? ", " : "") << "[" << d.corners[c].x << ", " << d.corners[c].y << "]";
+            }
+            out << "]}";
+        }
+        out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+// Modo batch: procesa todas las imágenes en paralelo y escribe un archivo de resultados
+int runBatch(const string &input, const string &outputPath, const string &annotateDir, unsigned jobs,
+             const vector<TrainROI> &trainROIs, const DetectorParams &params,
+             const QuerySetup &setup) {
+    vector<string> images = collectImages(input);
+    if (images.empty()) {
+        cerr << "[ERROR] No se encontraron imágenes en " << input << endl;
+        return -1;
+    }
+    if (!annotateDir.empty()) fs::create_directories(annotateDir);
+
+    cout << "[INFO] Modo batch: " << images.size() << " imágenes con " << jobs << " hilo(s)." << endl;
+
+    // Los hilos del pool ya ocupan todos los núcleos, se evita el paralelismo interno de OpenCV
+    int cvThreads = getNumThreads();
+    if (jobs > 1 || params.threads > 1) setNumThreads(1);
+
+    int64 start = getTickCount();
+    vector<BatchResult> results(images.size());
+    parallelFor(images.size(), jobs, [&](size_t i) {
+        results[i] = processBatchImage(images[i], trainROIs, params, annotateDir, setup);
+    });
+    double elapsed = msSince(start);
 
-        string kpKey = "keypoints_" + to_string(i);
-        FileNode kpNode = fsIn[kpKey];
-        vector<Point2f> roiKpCoords;
-        for (FileNodeIterator it = kpNode.begin(); it != kpNode.end(); ++it) {
-            float x = (float)(*it); ++it;
-            float y = (float)(*it);
-            roiKpCoords.push_back(Point2f(x, y));
+    setNumThreads(cvThreads);
+
+    size_t failed = 0, detected = 0, cheapOnly = 0, fallbacks = 0;
+    for (const auto &r : results) {
+        if (r.candidates == 0) cheapOnly++;
+        if (r.usedFallback) fallbacks++;
+        if (!r.ok) {
+            cerr << "[ERROR] " << r.imagePath << ": " << r.error << endl;
+            failed++;
+        } else if (!r.detections.empty()) {
+            detected++;
         }
+    }
+
+    if (fs::path(outputPath).extension() == ".json") {
+        writeJSON(outputPath, results);
+    } else {
+        writeCSV(outputPath, results);
+    }
 
-        trainROIs.push_back({des, roiKpCoords, roiRect});
-        i++;
+    cout << "[INFO] " << detected << " imágenes con detecciones, " << failed << " con errores. Tiempo total: "
+         << elapsed / 1000.0 << " s (" << elapsed / images.size() << " ms/imagen)." << endl;
+    if (setup.cascade) {
+        cout << "[INFO] Cascada: " << cheapOnly << " imágenes sin candidatos (solo etapa de color), " << fallbacks
+             << " con respaldo de frame completo." << endl;
     }
-    fsIn.release();
-    cout << "[INFO] Se cargaron " << trainROIs.size() << " ROIs del dataset." << endl;
-    return trainROIs;
+    cout << "[INFO] Resultados guardados en " << outputPath << endl;
+    return 0;
 }
 
-int main() {
-    string trainYml = "train_sift_descriptors.yml";
-    vector<TrainROI> trainROIs = loadTrainDescriptors(trainYml);
+// Uso:
+//   ./test3.bin                         recorre test/ mostrando cada imagen (ESC/tecla para avanzar)
+//   ./test3.bin --batch <carpeta|lista.txt> [--out resultados.csv|.json] [--annotate carpeta] [-j N]
+//   --shortlist K   solo se verifican las K ROIs mejor puntuadas por el vocabulario visual
+//                   (<base>.bovw, lo genera train2.bin); 0 = probar todas. Por defecto 20.
+//   --max-side N    lado mayor de la resolución de trabajo (0 = original). Por defecto 1280.
+//   --budget N      máximo de keypoints por imagen, repartidos en rejilla (0 = sin límite). Por defecto 2000.
+//   --cascade       segmentación del rojo + LBP/SVM primero; SIFT solo dentro de los candidatos y,
+//                   si ahí no se confirma nada, en el frame completo (--no-fallback lo desactiva).
+//                   Las imágenes sin candidatos no llegan a SIFT.
+//   --svm MODELO    SVM de la cascada (por defecto "lbp server/svm_limit.yml"); sin él solo se usa el color
+//   --roi-jobs N    hilos para verificar las ROIs de cada imagen. Por defecto todos los núcleos, salvo en
+//                   batch con -j > 1, donde ya hay una imagen por hilo.
+//   --db ARCHIVO    base de train2.bin (por defecto train_sift_descriptors.vdb; con otro extractor,
+//                   train_<extractor>_descriptors.vdb)
+//   --early-exit N  deja de verificar ROIs al confirmar una con al menos N inliers (0 = probar todas)
+//   --metrics ARCHIVO [--metrics-interval S]
+//                   exporta tiempos por etapa y contadores (JSON si termina en .json, si no Prometheus)
+int main(int argc, char *argv[]) {
+    initMetricsFromArgs(argc, argv, "test3");
+    string batchInput, outputPath = "resultados.csv", annotateDir;
+    string svmPath = "lbp server/svm_limit.yml";
+    string trainDb = "train_sift_descriptors.vdb";
+    int topK = 20, roiJobs = 0, earlyExit = 0;
+    bool cascade = false, fallback = true;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--cascade") cascade = true;
+        else if (arg == "--no-fallback") fallback = false;
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--batch") batchInput = argv[++i];
+        else if (arg == "--out") outputPath = argv[++i];
+        else if (arg == "--annotate") annotateDir = argv[++i];
+        else if (arg == "--shortlist") topK = max(0, atoi(argv[++i]));
+        else if (arg == "--svm") svmPath = argv[++i];
+        else if (arg == "--roi-jobs") roiJobs = max(0, atoi(argv[++i]));
+        else if (arg == "--early-exit") earlyExit = max(0, atoi(argv[++i]));
+        else if (arg == "--db") trainDb = argv[++i];
+    }
+
+    DescriptorDB db;
+    vector<TrainROI> trainROIs = loadTrainDescriptors(db, trainDb);
     if (trainROIs.empty()) {
         cerr << "[ERROR] No se encontraron descriptores de entrenamiento." << endl;
         return -1;
     }
 
-    Ptr<SIFT> sift = SIFT::create();
-    BFMatcher matcher(NORM_L2);
-    float ratioThresh = 0.75f;
-    int minGoodMatches = 10;
-    double ransacReprojThresh = 5.0;
+    // Mismo extractor que al entrenar; el matcher usa su norma (L2 o Hamming)
+    QuerySetup setup;
+    setup.backend = db.featureBackend();
+    setup.topK = topK;
+    setup.adaptive = parseAdaptiveArgs(argc, argv);
+    cout << "[INFO] Extractor de la base: " << featureBackendName(setup.backend) << endl;
+    cout << "[INFO] Resolución de trabajo: lado mayor " << setup.adaptive.maxSide << " px, presupuesto de "
+         << setup.adaptive.keypointBudget << " keypoints (0 = sin límite)." << endl;
+
+    // Las consultas se codifican igual que la base (uint8 / PCA)
+    if (!loadCodecFor(db, trainDb, setup.codec)) return -1;
+    if (setup.codec.usesPCA() || setup.codec.usesQuantization()) {
+        cout << "[INFO] Descriptores de la base: " << db.descriptorCols() << " dimensiones"
+             << (setup.codec.usesQuantization() ? " en uint8" : "") << "." << endl;
+    }
+
+    // Vocabulario visual para preseleccionar ROIs; sin él se prueban todas
+    VisualVocabulary vocabulary;
+    if (topK > 0) {
+        if (vocabulary.load(db, vocabularyPathFor(trainDb))) {
+            setup.vocabulary = &vocabulary;
+            cout << "[INFO] Vocabulario visual con " << vocabulary.words() << " palabras, se verifican las "
+                 << topK << " ROIs más parecidas." << endl;
+        } else {
+            cout << "[INFO] Sin vocabulario visual, se prueban todas las ROIs." << endl;
+        }
+    }
+
+    // Cascada: candidatos baratos antes de las características
+    SignClassifier classifier;
+    if (cascade) {
+        setup.cascade = true;
+        setup.cascadeParams.fallbackFullFrame = fallback;
+        if (loadSignClassifier(svmPath, classifier)) {
+            setup.classifier = &classifier;
+            cout << "[INFO] Cascada: color + LBP/SVM (" << svmPath << ") antes de " << featureBackendName(setup.backend)
+                 << "." << endl;
+        } else {
+            cout << "[INFO] Cascada: sin SVM, los candidatos salen solo de la segmentación del rojo." << endl;
+        }
+    }
+
+    // Con varias imágenes en paralelo cada una verifica sus ROIs en un solo hilo para no sobresuscribir
+    unsigned jobs = parseJobsArg(argc, argv);
+    DetectorParams params;
+    params.threads = roiJobs > 0 ? (unsigned)roiJobs : (!batchInput.empty() && jobs > 1) ? 1 : defaultThreadCount();
+    params.earlyExitInliers = earlyExit;
+    params.norm = featureNorm(setup.backend);
+    int descType = CV_32F;
+    for (const auto &troi : trainROIs) {
+        if (!troi.descriptors.empty()) {
+            descType = troi.descriptors.type();
+            break;
+        }
+    }
+    cout << "[INFO] Verificación de ROIs con " << params.threads << " hilo(s), matching "
+         << ratioMatchBackend(descType, params.norm);
+    if (earlyExit > 0) cout << ", corte temprano con " << earlyExit << " inliers";
+    cout << "." << endl;
+
+    if (!batchInput.empty()) {
+        return runBatch(batchInput, outputPath, annotateDir, jobs, trainROIs, params, setup);
+    }
+    if (params.threads > 1) setNumThreads(1);
+
+    Ptr<Feature2D> extractor = createFeatureExtractor(setup.backend);
+    Ptr<DescriptorMatcher> matcher = createFeatureMatcher(setup.backend);
 
     string testFolder = "test";
 
-    for (const auto &entry : fs::directory_iterator(testFolder)) {
-        if (entry.path().extension() == ".jpg" || entry.path().extension() == ".png") {
-            string testImagePath = entry.path().string();
-            cout << "[DEBUG] Procesando imagen de test: " << testImagePath << endl;
+    // La siguiente imagen se decodifica en segundo plano mientras se muestra la actual
+    ImagePrefetcher prefetcher(listDatasetImages(testFolder), IMREAD_COLOR);
+    string testImagePath;
+    Mat testImg;
+    while (prefetcher.next(testImagePath, testImg)) {
+        cout << "[DEBUG] Procesando imagen de test: " << testImagePath << endl;
 
-            Mat testImg = imread(testImagePath, IMREAD_COLOR);
-            if (testImg.empty()) {
-                cerr << "[ERROR] No se pudo cargar la imagen de test." << endl;
-                continue;
-            }
+        if (testImg.empty()) {
+            cerr << "[ERROR] No se pudo cargar la imagen de test." << endl;
+            continue;
+        }
+
+        // Códec, preselección y homografías sobre las características de la consulta
+        auto verify = [&](const vector<KeyPoint> &testKp, const Mat &des) {
+            Mat testDes;
+            setup.codec.encode(des, testDes);
+            vector<int> shortlist;
+            bool useShortlist = shortlistROIs(setup, testDes, shortlist);
+            if (useShortlist) cout << "[DEBUG] ROIs preseleccionadas: " << shortlist.size() << endl;
+            return detectROIs(testKp, testDes, testImg.size(), trainROIs, params, *matcher, true, nullptr,
+                              useShortlist ? &shortlist : nullptr);
+        };
 
+        int64 frameStart = getTickCount();
+        Mat frameMatches = testImg.clone();
+        vector<RoiDetection> detections;
+        if (setup.cascade) {
+            CascadeResult result = runCascade(testImg, setup.classifier, *extractor, setup.adaptive,
+                                              setup.cascadeParams, verify);
+            cout << "[INFO] Candidatos de la cascada: " << result.candidates.size() << ", keypoints: "
+                 << result.keypoints << (result.usedFallback ? " (frame completo)" : "") << endl;
+            for (const auto &c : result.candidates) rectangle(frameMatches, c, Scalar(255, 0, 0), 1);
+            detections = result.detections;
+        } else {
             Mat testGray;
             cvtColor(testImg, testGray, COLOR_BGR2GRAY);
             vector<KeyPoint> testKp;
             Mat testDes;
-            sift->detectAndCompute(testGray, noArray(), testKp, testDes);
-
+            double scale = extractAdaptive(*extractor, testGray, setup.adaptive, testKp, testDes);
             if (testDes.empty()) {
                 cerr << "[ERROR] No se detectaron descriptores en la imagen de test." << endl;
                 continue;
             }
-            cout << "[INFO] Se detectaron " << testKp.size() << " keypoints en la imagen de prueba." << endl;
-
-            Mat frameMatches = testImg.clone();
-
-            for (size_t idx = 0; idx < trainROIs.size(); idx++) {
-                const TrainROI &troi = trainROIs[idx];
-                if (troi.descriptors.empty() || troi.kpCoords.empty()) {
-                    cout << "[DEBUG] ROI " << idx << " - Sin descriptores ni keypoints." << endl;
-                    continue;
-                }
-
-                vector<vector<DMatch>> knnMatches;
-                matcher.knnMatch(troi.descriptors, testDes, knnMatches, 2);
-                cout << "[DEBUG] Número de coincidencias encontradas: " << knnMatches.size() << endl;
-
-                vector<DMatch> goodMatches;
-                for (auto &km : knnMatches) {
-                    if (km.size() < 2) continue;
-                    if (km[0].distance < ratioThresh * km[1].distance) {
-                        goodMatches.push_back(km[0]);
-                    }
-                }
-
-                cout << "[DEBUG] ROI " << idx << " - Good matches: " << goodMatches.size() << endl;
-
-                if ((int)goodMatches.size() >= minGoodMatches) {
-                    vector<Point2f> roiPoints, testPoints;
-                    for (auto &gm : goodMatches) {
-                        roiPoints.push_back(troi.kpCoords[gm.queryIdx]);
-                        testPoints.push_back(testKp[gm.trainIdx].pt);
-                    }
-
-                    Mat maskInliers;
-                    Mat H = findHomography(roiPoints, testPoints, RANSAC, ransacReprojThresh, maskInliers);
-                    if (!H.empty() && !maskInliers.empty()) {
-                        int inliersCount = countNonZero(maskInliers);
-                        cout << "[DEBUG] ROI " << idx << " - Inliers: " << inliersCount << endl;
-
-                        if (inliersCount >= 8) {
-                            vector<Point2f> corners = {
-                                Point2f(0, 0), Point2f((float)troi.bbox.width, 0),
-                                Point2f((float)troi.bbox.width, (float)troi.bbox.height),
-                                Point2f(0, (float)troi.bbox.height)
-                            };
-                            vector<Point2f> cornersTransformed(4);
-                            perspectiveTransform(corners, cornersTransformed, H);
-
-                            bool valid = true;
-                            for (const auto &pt : cornersTransformed) {
-                                if (pt.x < 0 || pt.y < 0 || pt.x >= testImg.cols || pt.y >= testImg.rows || isnan(pt.x) || isnan(pt.y)) {
-                                    valid = false;
-                                    break;
-                                }
-                            }
-
-                            if (valid) {
-                                vector<vector<Point>> polygon(1);
-                                for (const auto &pt : cornersTransformed) {
-                                    polygon[0].push_back(Point((int)pt.x, (int)pt.y));
-                                }
-                                polylines(frameMatches, polygon, true, Scalar(0, 255, 0), 2, LINE_AA);
-                            } else {
-                                cout << "[WARNING] ROI " << idx << " - Transformación no válida, no se dibujará el rectángulo." << endl;
-                            }
-                        }
-                    } else {
-                        cout << "[DEBUG] ROI " << idx << " - Homografía no encontrada." << endl;
-                    }
-                }
-            }
-
-            imshow("Matches", frameMatches);
-            waitKey(0);
+            cout << "[INFO] Se detectaron " << testKp.size() << " keypoints en la imagen de prueba (escala "
+                 << scale << ")." << endl;
+            detections = verify(testKp, testDes);
         }
+        recordStage(METRIC_FRAME, msSince(frameStart));
+        addCounter(COUNTER_FRAMES);
+        drawDetections(frameMatches, detections);
+
+        imshow("Matches", frameMatches);
+        waitKey(0);
     }
 
     return 0;
@@ -1,177 +1,386 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/xfeatures2d.hpp>
-#include <tinyxml2.h>
 #include <iostream>
 #include <vector>
 #include <filesystem>
+#include "AnnotationIndex.hpp"
+#include "DatasetLoader.hpp"
+#include "DatasetPack.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "GlobalIndex.hpp"
+#include "Manifest.hpp"
+#include "Parallel.hpp"
 
 using namespace cv;
 using namespace std;
-using namespace tinyxml2;
 namespace fs = std::filesystem;
 
+// Extractor elegido con --features (SIFT por defecto); queda registrado en la base
+FeatureBackend featureBackend = FEATURE_SIFT;
+
+// Lectura de las imágenes (--decode-min-roi) y paquete de ROIs preprocesadas (--pack)
+DecodeOptions decodeOptions;
+string packPath;
+DatasetPack oldPack;
+
+// Preprocesado de las ROIs: si cambia, el paquete de ROIs anterior deja de servir
+string roiParams()
+{
+    string params = "gray equalizeHist; minBox=20";
+    if (decodeOptions.minRoiSide > 0)
+        params += "; decodeMinRoi=" + to_string(decodeOptions.minRoiSide);
+    return params;
+}
+
+// Parámetros del extractor: si cambian, el manifiesto anterior deja de servir
+string extractorParams()
+{
+    return featureBackendParams(featureBackend) + "; " + roiParams();
+}
+
 // Variables globales
 vector<string> imagePaths;
-vector<Rect> boundingBoxes;
-Ptr<SIFT> sift = SIFT::create();
-
-// 🔹 Función para leer bounding boxes desde archivos XML (VOC)
-Rect parseVOCBoundingBox(const string &xml_path)
+vector<vector<Rect>> boundingBoxes;   // 🔹 Todos los objetos anotados de cada imagen
+vector<ManifestRecord> imageRecords;  // 🔹 Registro del manifiesto de cada imagen de imagePaths
+vector<char> reuseEntry;              // 🔹 1 si las ROIs se copian de la base anterior sin volver a extraer
+DatasetManifest oldManifest, newManifest;
+DescriptorDB oldDb;
+
+// 🔹 Función para cargar imágenes y bounding boxes desde el dataset. Las anotaciones salen del
+// índice compilado (solo se parsean los XML modificados) e incluyen todos los objetos de cada imagen.
+// Las imágenes que no cambiaron desde el último entrenamiento no se vuelven a procesar.
+void loadDataset(const string &dataset_path, unsigned jobs, bool incremental)
 {
-    XMLDocument doc;
-    if (doc.LoadFile(xml_path.c_str()) != XML_SUCCESS)
+    AnnotationIndex annotations = compileAnnotations(dataset_path, jobs);
+    vector<const AnnotatedImage *> candidates;
+    for (const auto &image : annotations.images())
     {
-        cerr << "❌ Error al cargar XML: " << xml_path << endl;
-        return Rect();
+        if (fs::path(image.imagePath).extension() == ".jpg")
+            candidates.push_back(&image);
     }
 
-    XMLElement *annotation = doc.FirstChildElement("annotation");
-    if (!annotation)
-        return Rect();
+    vector<ManifestRecord> records(candidates.size());
+    vector<char> unchanged(candidates.size(), 0);
+    parallelFor(candidates.size(), jobs, [&](size_t i)
+    {
+        const string &image_path = candidates[i]->imagePath;
+        const ManifestRecord *prev = incremental ? oldManifest.find(image_path) : nullptr;
+        records[i].imagePath = image_path;
+        bool same_image = fileUnchanged(image_path, prev ? &prev->image : nullptr, records[i].image);
+        // 🔹 El índice de anotaciones ya tiene el sello actual del XML
+        records[i].xml = candidates[i]->xml;
+        bool same_xml = prev && prev->xml.size == records[i].xml.size && prev->xml.hash == records[i].xml.hash;
+        if (prev && same_image && same_xml)
+        {
+            unchanged[i] = 1;
+            records[i].entries = prev->entries;
+        }
+    });
+
+    // 🔹 Se conserva el orden del directorio, igual que en una ejecución secuencial
+    auto previous_entries = entriesByPath(oldDb);
+    size_t multi_object = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const AnnotatedImage &annotated = *candidates[i];
+        if (unchanged[i])
+        {
+            // 🔹 Solo se reutiliza si la base anterior tiene las ROIs que indica el manifiesto
+            auto it = previous_entries.find(annotated.imagePath);
+            size_t available = it == previous_entries.end() ? 0 : it->second.size();
+            if (records[i].entries == 0)
+            {
+                newManifest.add(records[i]);
+                continue;
+            }
+            if ((int)available == records[i].entries)
+            {
+                vector<Rect> boxes;
+                for (size_t idx : it->second)
+                    boxes.push_back(oldDb.bbox(idx));
+                imagePaths.push_back(annotated.imagePath);
+                boundingBoxes.push_back(boxes);
+                imageRecords.push_back(records[i]);
+                reuseEntry.push_back(1);
+                continue;
+            }
+            // 🔹 La base no coincide con el manifiesto: se vuelve a procesar la imagen
+        }
 
-    XMLElement *object = annotation->FirstChildElement("object");
-    if (!object)
-        return Rect();
+        if (!annotated.valid)
+            cerr << "❌ Error al cargar XML: " << fs::path(annotated.imagePath).replace_extension(".xml").string() << endl;
 
-    XMLElement *bndbox = object->FirstChildElement("bndbox");
-    if (!bndbox)
-        return Rect();
+        vector<Rect> boxes;
+        for (const auto &object : annotated.objects)
+        {
+            if (object.box.width > 0 && object.box.height > 0)
+                boxes.push_back(object.box);
+        }
 
-    int xmin, ymin, xmax, ymax;
-    bndbox->FirstChildElement("xmin")->QueryIntText(&xmin);
-    bndbox->FirstChildElement("ymin")->QueryIntText(&ymin);
-    bndbox->FirstChildElement("xmax")->QueryIntText(&xmax);
-    bndbox->FirstChildElement("ymax")->QueryIntText(&ymax);
+        if (!boxes.empty())
+        {
+            multi_object += boxes.size() > 1;
+            imagePaths.push_back(annotated.imagePath);
+            boundingBoxes.push_back(boxes);
+            imageRecords.push_back(records[i]);
+            reuseEntry.push_back(0);
+        }
+        else
+        {
+            records[i].entries = 0;
+            newManifest.add(records[i]);
+        }
+    }
 
-    return Rect(xmin, ymin, xmax - xmin, ymax - ymin);
+    cout << "✅ Total de imágenes cargadas: " << imagePaths.size() << " (" << multi_object << " con varios objetos)" << endl;
 }
 
-// 🔹 Función para cargar imágenes y bounding boxes desde el dataset
-void loadDataset(const string &dataset_path)
+// 🔹 Resultado de procesar una imagen: se calcula en paralelo y se escribe en orden
+struct SIFTResult
 {
-    for (const auto &entry : fs::directory_iterator(dataset_path))
+    bool ok = false;
+    Rect bbox;
+    vector<KeyPoint> keypoints;
+    Mat descriptors;
+    string warning;
+    RoiSample sample;       // 🔹 ROI ya ecualizada (se guarda en el paquete si se pidió uno)
+    bool hasSample = false;
+};
+
+// 🔹 Lee la ROI del objeto k de la imagen i (o la toma del paquete), la ecualiza y extrae sus características
+SIFTResult extractSIFT(size_t i, size_t k, const RoiSample *packed)
+{
+    thread_local Ptr<Feature2D> extractor = createFeatureExtractor(featureBackend); // 🔹 Un extractor por hilo
+    SIFTResult result;
+
+    if (packed)
     {
-        if (entry.path().extension() == ".jpg")
-        {
-            string image_path = entry.path().string();
-            fs::path xmlFilePath = entry.path();
-            xmlFilePath.replace_extension(".xml");
-            string xml_path = xmlFilePath.string();
+        result.sample = *packed;
+    }
+    else
+    {
+        // 🔹 Decodificación directa a gris, ajuste del bounding box a la imagen y tamaño mínimo de 20 px
+        result.sample = loadGrayRoi(imagePaths[i], boundingBoxes[i][k], 20, decodeOptions);
 
-            if (fs::exists(xml_path))
-            {
-                Rect bbox = parseVOCBoundingBox(xml_path);
-                if (bbox.width > 0 && bbox.height > 0)
-                {
-                    imagePaths.push_back(image_path);
-                    boundingBoxes.push_back(bbox);
-                }
-            }
-        }
+        // 🔹 Aplicar preprocesamiento para mejorar detección de SIFT
+        if (result.sample.status == RoiSample::OK)
+            equalizeHist(result.sample.pixels, result.sample.pixels); // 🔹 Aumentar el contraste
+    }
+    result.hasSample = true;
+
+    if (result.sample.status == RoiSample::DECODE_FAILED)
+    {
+        result.warning = "⚠️ Error al cargar la imagen: " + imagePaths[i];
+        return result;
+    }
+    if (result.sample.status == RoiSample::TOO_SMALL) // 🔹 Evitar bounding boxes demasiado pequeños
+    {
+        result.warning = "⚠️ Bounding box muy pequeño en la imagen " + imagePaths[i] + ". Se omite.";
+        return result;
+    }
+
+    extractor->detectAndCompute(result.sample.pixels, noArray(), result.keypoints, result.descriptors);
+    scaleKeypoints(result.keypoints, result.sample.reduction);
+
+    if (result.descriptors.empty())
+    {
+        result.warning = "⚠️ No se detectaron descriptores en la imagen " + imagePaths[i] + ". Se omite.";
+        return result;
     }
 
-    cout << "✅ Total de imágenes cargadas: " << imagePaths.size() << endl;
+    result.bbox = result.sample.roi;
+    result.ok = true;
+    return result;
 }
 
-// 🔹 Función para extraer SIFT y guardar bounding boxes en el archivo YML
-void extractAndSaveSIFT(const string &output_file)
+// 🔹 Función para extraer SIFT y guardar bounding boxes en la base binaria de descriptores.
+// Solo se extraen las imágenes nuevas o modificadas; las demás se copian de la base anterior.
+// Devuelve false si la base no se pudo guardar.
+bool extractAndSaveSIFT(const string &output_file, unsigned jobs)
 {
-    FileStorage fs(output_file, FileStorage::WRITE);
-
+    vector<size_t> pending;
     for (size_t i = 0; i < imagePaths.size(); ++i)
     {
-        Mat img = imread(imagePaths[i], IMREAD_GRAYSCALE);
-        if (img.empty())
-        {
-            cerr << "⚠️ Error al cargar la imagen: " << imagePaths[i] << endl;
-            continue;
-        }
-
-        // Validar que la imagen tenga un bounding box asignado
-        if (i >= boundingBoxes.size())
-        {
-            cerr << "⚠️ La imagen " << imagePaths[i] << " no tiene bounding box asociado. Se omite." << endl;
-            continue;
-        }
+        if (!reuseEntry[i])
+            pending.push_back(i);
+    }
+    cout << "🔹 Imágenes a extraer: " << pending.size() << " (reutilizadas: " << imagePaths.size() - pending.size() << ")" << endl;
 
-        Rect bbox = boundingBoxes[i];
+    // 🔹 Una tarea por objeto anotado de cada imagen pendiente
+    vector<pair<size_t, size_t>> tasks;
+    for (size_t i : pending)
+    {
+        for (size_t k = 0; k < boundingBoxes[i].size(); k++)
+            tasks.push_back({i, k});
+    }
 
-        // Ajustar bounding box si está fuera de la imagen
-        bbox.x = max(0, min(bbox.x, img.cols - 1));
-        bbox.y = max(0, min(bbox.y, img.rows - 1));
-        bbox.width = min(bbox.width, img.cols - bbox.x);
-        bbox.height = min(bbox.height, img.rows - bbox.y);
+    vector<vector<SIFTResult>> results(imagePaths.size());
+    for (size_t i : pending)
+        results[i].resize(boundingBoxes[i].size());
 
-        // 🔹 Validar que el bounding box tenga un tamaño mínimo
-        if (bbox.width < 20 || bbox.height < 20) // 🔹 Evitar bounding boxes demasiado pequeños
+    // 🔹 ROIs que se pueden tomar del paquete sin decodificar la imagen
+    bool use_pack = !packPath.empty();
+    vector<int> pack_index(tasks.size(), -1);
+    size_t from_pack = 0;
+    if (oldPack.isOpen())
+    {
+        for (size_t t = 0; t < tasks.size(); t++)
         {
-            cerr << "⚠️ Bounding box muy pequeño en la imagen " << imagePaths[i] << ". Se omite." << endl;
-            continue;
+            size_t i = tasks[t].first;
+            pack_index[t] = oldPack.findFresh(imagePaths[i], imageRecords[i].image, imageRecords[i].xml, tasks[t].second);
+            from_pack += pack_index[t] >= 0;
         }
+    }
+    if (use_pack)
+        cout << "🔹 ROIs del paquete: " << from_pack << " (a decodificar: " << tasks.size() - from_pack << ")" << endl;
 
-        // 🔹 Extraer el ROI
-        Mat roi = img(bbox);
-
-        // 🔹 Aplicar preprocesamiento para mejorar detección de SIFT
-        equalizeHist(roi, roi); // 🔹 Aumentar el contraste
-
-        vector<KeyPoint> keypoints;
-        Mat descriptors;
-        sift->detectAndCompute(roi, noArray(), keypoints, descriptors);
+    // 🔹 Los hilos del pool ya ocupan todos los núcleos, se evita el paralelismo interno de OpenCV
+    int cv_threads = getNumThreads();
+    if (jobs > 1)
+        setNumThreads(1);
 
-        if (!descriptors.empty())
+    parallelFor(tasks.size(), jobs, [&](size_t t)
+    {
+        size_t i = tasks[t].first, k = tasks[t].second;
+        RoiSample packed;
+        if (pack_index[t] >= 0)
+            packed = oldPack.sample(pack_index[t]);
+        results[i][k] = extractSIFT(i, k, pack_index[t] >= 0 ? &packed : nullptr);
+    });
+
+    setNumThreads(cv_threads);
+
+    // 🔹 Escritura en el orden original: la salida es idéntica a la de una ejecución con -j 1
+    auto previous_entries = entriesByPath(oldDb);
+    DescriptorDBWriter db;
+    db.setBackend(featureBackend);
+    DatasetPackWriter pack;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        ManifestRecord &record = imageRecords[i];
+        if (reuseEntry[i])
         {
-            fs << "image_" + to_string(i) << descriptors;
-            fs << "bbox_" + to_string(i) << bbox;  // 🔹 Guardamos el bounding box en el YAML
+            // 🔹 Las ROIs del paquete anterior siguen valiendo si la imagen no cambió
+            for (size_t k = 0; use_pack && oldPack.isOpen(); k++)
+            {
+                int idx = oldPack.findFresh(imagePaths[i], record.image, record.xml, k);
+                if (idx < 0)
+                    break;
+                pack.addFrom(oldPack, idx);
+            }
+            for (size_t idx : previous_entries[imagePaths[i]])
+                db.addFrom(oldDb, idx);
+            newManifest.add(record);
+            continue;
         }
-        else
+
+        record.entries = 0;
+        for (auto &result : results[i])
         {
-            cerr << "⚠️ No se detectaron descriptores en la imagen " << imagePaths[i] << ". Se omite." << endl;
+            if (use_pack && result.hasSample)
+                pack.add(imagePaths[i], record.image, record.xml, result.sample);
+            if (!result.ok)
+            {
+                cerr << result.warning << endl;
+                continue;
+            }
+            db.add(imagePaths[i], result.bbox, result.keypoints, result.descriptors); // 🔹 Descriptores, bounding box y keypoints de la ROI
+            record.entries++;
         }
+        newManifest.add(record);
+        results[i].clear(); // 🔹 Liberar memoria a medida que se escribe
     }
 
-    fs.release();
-    cout << "✅ Descriptores de SIFT y bounding boxes guardados en " << output_file << endl;
+    if (!db.save(output_file))
+    {
+        cerr << "❌ Error al guardar la base de descriptores " << output_file << endl;
+        return false;
+    }
+    newManifest.save(manifestPathFor(output_file));
+    if (use_pack && pack.save(packPath, roiParams()))
+        cout << "✅ Paquete de ROIs guardado en " << packPath << " (" << pack.size() << " ROIs)" << endl;
+    oldPack.close();
+    cout << "✅ Descriptores de " << featureBackendName(featureBackend) << " y bounding boxes guardados en " << output_file << " (" << db.size() << " ROIs)" << endl;
+    return true;
 }
 
 // 🔹 Función para revisar que los bounding boxes fueron guardados correctamente
 void checkBoundingBoxes(const string &output_file)
 {
-    FileStorage fs(output_file, FileStorage::READ);
-    if (!fs.isOpened())
+    DescriptorDB db;
+    if (!db.open(output_file))
     {
         cerr << "❌ Error al abrir el archivo de descriptores SIFT." << endl;
         return;
     }
 
-    int i = 0;
-    while (true)
+    for (size_t i = 0; i < db.size(); i++)
     {
-        Rect bbox;
-        string key_bbox = "bbox_" + to_string(i);
-
-        fs[key_bbox] >> bbox;
-
-        if (bbox.width == 0 || bbox.height == 0)
-            break;
+        Rect bbox = db.bbox(i);
 
         cout << "📏 Bounding Box " << i << ": x=" << bbox.x << ", y=" << bbox.y
              << ", width=" << bbox.width << ", height=" << bbox.height << endl;
-
-        i++;
     }
-
-    fs.release();
 }
 
 // 🔹 Main
-int main()
+// Uso: ./train.bin [-j N] [--full] [--features sift|surf|orb|akaze|brisk] [--out ARCHIVO]
+//   -j N        hilos de extracción (por defecto todos los núcleos, -j 1 = secuencial)
+//   --full      ignora el manifiesto y vuelve a extraer todo el dataset
+//   --features  extractor (por defecto sift); queda registrado en la base
+//   --out       base de salida (por defecto <extractor>_descriptors.vdb, p. ej. sift_descriptors.vdb)
+//   --pack ARCHIVO         paquete con las ROIs ya recortadas y ecualizadas: las imágenes que no
+//                          cambiaron se leen de ahí en vez de decodificar el JPEG
+//   --decode-min-roi N     decodifica los JPEG a 1/2, 1/4 o 1/8 mientras el lado menor de la ROI
+//                          siga siendo de al menos N px (0 = resolución completa, por defecto)
+int main(int argc, char *argv[])
 {
     string dataset_path = "train/";
-    string sift_output_file = "sift_descriptors.yml";
+    string sift_output_file;
+    unsigned jobs = parseJobsArg(argc, argv);
+    bool full = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--full")
+            full = true;
+        else if (arg == "--pack" && i + 1 < argc)
+            packPath = argv[++i];
+        else if (arg == "--decode-min-roi" && i + 1 < argc)
+            decodeOptions.minRoiSide = max(0, atoi(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc)
+            sift_output_file = argv[++i];
+    }
 
-    loadDataset(dataset_path);
-    extractAndSaveSIFT(sift_output_file);
+    featureBackend = parseFeaturesArg(argc, argv);
+    if (sift_output_file.empty())
+        sift_output_file = defaultDescriptorDb(featureBackend);
+    const string extractorConfig = extractorParams();
+
+    cout << "🔹 Extracción con " << featureBackendName(featureBackend) << " y " << jobs << " hilo(s) hacia " << sift_output_file << endl;
+
+    // 🔹 Entrenamiento incremental: requiere el manifiesto y la base anteriores con los mismos parámetros
+    newManifest.params = extractorConfig;
+    bool incremental = !full && fs::exists(manifestPathFor(sift_output_file)) &&
+                       oldManifest.load(manifestPathFor(sift_output_file)) &&
+                       oldManifest.params == extractorConfig && oldDb.open(sift_output_file);
+    if (incremental)
+        cout << "🔹 Manifiesto anterior con " << oldManifest.size() << " imágenes, solo se procesan los cambios" << endl;
+    else
+        oldDb.close();
+
+    if (!packPath.empty() && oldPack.open(packPath, roiParams()))
+        cout << "🔹 Paquete de ROIs " << packPath << " con " << oldPack.size() << " ROIs" << endl;
+
+    loadDataset(dataset_path, jobs, incremental);
+    if (!extractAndSaveSIFT(sift_output_file, jobs))
+        return -1;
+    if (incremental)
+        cout << "🔹 Imágenes eliminadas desde el último entrenamiento: " << countRemoved(oldManifest, newManifest) << endl;
+
+    // 🔹 Construir el índice global una sola vez y guardarlo junto a la base
+    buildAndSaveIndex(sift_output_file);
 
     // 🔹 Revisar que los bounding boxes fueron correctamente guardados
     checkBoundingBoxes(sift_output_file);
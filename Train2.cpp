@@ -1,103 +1,347 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/xfeatures2d.hpp>
-#include <tinyxml2.h>
 #include <filesystem>
 #include <iostream>
+#include "AnnotationIndex.hpp"
+#include "DatasetLoader.hpp"
+#include "DatasetPack.hpp"
+#include "DescriptorCodec.hpp"
+#include "DescriptorDB.hpp"
+#include "FeatureBackend.hpp"
+#include "GlobalIndex.hpp"
+#include "Manifest.hpp"
+#include "Parallel.hpp"
+#include "Vocabulary.hpp"
 
 using namespace std;
 using namespace cv;
 using namespace cv::xfeatures2d;
 namespace fs = std::filesystem;
-using namespace tinyxml2;
 
-int main() {
-    string datasetPath = "train";  
-    string outputYml = "train_sift_descriptors.yml";
+// Preprocesado de las ROIs: si cambia, el paquete de ROIs anterior deja de servir
+string roiParams(const DecodeOptions &decode) {
+    string params = "gray; minRoi=10";
+    if (decode.minRoiSide > 0) params += "; decodeMinRoi=" + to_string(decode.minRoiSide);
+    return params;
+}
 
-    Ptr<SIFT> sift = SIFT::create();
-    FileStorage fsOut(outputYml, FileStorage::WRITE);
-    if (!fsOut.isOpened()) {
-        cerr << "[ERROR] No se pudo abrir " << outputYml << " para escritura." << endl;
-        return -1;
+// Parámetros del extractor: si cambian, el manifiesto anterior deja de servir
+string extractorParams(FeatureBackend backend, const DecodeOptions &decode) {
+    return featureBackendParams(backend) + "; " + roiParams(decode);
+}
+
+// Resultado de procesar un objeto anotado: se calcula en un hilo del pool y se escribe en orden
+struct EntryResult {
+    bool ok = false;
+    Rect roi;
+    vector<KeyPoint> kp;
+    Mat des;
+    string error;
+    RoiSample sample;   // ROI leída (se guarda en el paquete si se pidió uno)
+    bool hasSample = false;
+};
+
+// Error de anotación de la imagen (vacío si tiene objetos que procesar)
+string annotationError(const fs::path &imageFile, const AnnotatedImage *annotated) {
+    fs::path xmlPath = imageFile;
+    xmlPath.replace_extension(".xml");
+    if (!annotated) return "[ERROR] No existe el XML para la imagen: " + xmlPath.string();
+    if (!annotated->valid) return "[ERROR] No se pudo cargar el XML: \"" + xmlPath.string() + "\"";
+    return "";
+}
+
+// Lee la ROI anotada de la imagen (o la toma del paquete) y extrae sus características
+EntryResult processEntry(const fs::path &imageFile, const Rect &annotated, FeatureBackend backend,
+                         const DecodeOptions &decode, const RoiSample *packed) {
+    thread_local Ptr<Feature2D> extractor = createFeatureExtractor(backend); // Un extractor por hilo
+    EntryResult r;
+    string imagePath = imageFile.string();
+
+    if (packed) {
+        r.sample = *packed;
+    } else {
+        // Directo a gris: SIFT convertiría la imagen a gris de todos modos
+        r.sample = loadGrayRoi(imagePath, annotated, 10, decode);
     }
+    r.hasSample = true;
 
-    int descriptorCount = 0;
+    if (r.sample.status == RoiSample::DECODE_FAILED) {
+        r.error = "[ERROR] No se pudo cargar la imagen: " + imagePath;
+        return r;
+    }
+    if (r.sample.status == RoiSample::TOO_SMALL) {
+        r.error = "[ERROR] ROI muy pequeña en " + imagePath;
+        return r;
+    }
 
-    for (const auto &entry : fs::directory_iterator(datasetPath)) {
-        if (entry.path().extension() == ".jpg" || entry.path().extension() == ".png") {
-            string imagePath = entry.path().string();
-            fs::path xmlPath = entry.path();
-            xmlPath.replace_extension(".xml");
+    r.roi = r.sample.roi;
+    extractor->detectAndCompute(r.sample.pixels, noArray(), r.kp, r.des);
+    scaleKeypoints(r.kp, r.sample.reduction);
 
-            Mat img = imread(imagePath, IMREAD_COLOR);
-            if (img.empty()) {
-                cerr << "[ERROR] No se pudo cargar la imagen: " << imagePath << endl;
-                continue;
-            }
+    if (r.des.empty()) {
+        r.error = "[ERROR] No se detectaron descriptores en " + imagePath;
+        return r;
+    }
 
-            if (!fs::exists(xmlPath)) {
-                cerr << "[ERROR] No existe el XML para la imagen: " << imagePath << endl;
-                continue;
-            }
+    r.ok = true;
+    return r;
+}
 
-            XMLDocument doc;
-            if (doc.LoadFile(xmlPath.string().c_str()) != XML_SUCCESS) {
-                cerr << "[ERROR] No se pudo cargar el XML: " << xmlPath << endl;
-                continue;
+// Descriptores con los que se ajusta el códec (PCA + rango de cuantización)
+const int CODEC_SAMPLE_ROWS = 100000;
+
+// Muestra de hasta maxRows descriptores repartida de forma uniforme entre todas las ROIs extraídas
+Mat codecSample(const vector<vector<EntryResult>> &results, int maxRows) {
+    vector<Mat> all;
+    int total = 0;
+    for (const auto &image : results) {
+        for (const auto &r : image) {
+            if (r.ok && !r.des.empty()) {
+                all.push_back(r.des);
+                total += r.des.rows;
             }
+        }
+    }
+    Mat samples;
+    int step = max(1, total / maxRows);
+    int k = 0;
+    for (const auto &des : all) {
+        for (int row = 0; row < des.rows; row++, k++) {
+            if (k % step == 0) samples.push_back(des.row(row));
+        }
+    }
+    return samples;
+}
 
-            XMLElement* annotation = doc.FirstChildElement("annotation");
-            if (!annotation) continue;
-            XMLElement* object = annotation->FirstChildElement("object");
-            if (!object) continue;
-            XMLElement* bndbox = object->FirstChildElement("bndbox");
-            if (!bndbox) continue;
-
-            int xmin, ymin, xmax, ymax;
-            bndbox->FirstChildElement("xmin")->QueryIntText(&xmin);
-            bndbox->FirstChildElement("ymin")->QueryIntText(&ymin);
-            bndbox->FirstChildElement("xmax")->QueryIntText(&xmax);
-            bndbox->FirstChildElement("ymax")->QueryIntText(&ymax);
-
-            xmin = max(0, min(xmin, img.cols - 1));
-            ymin = max(0, min(ymin, img.rows - 1));
-            xmax = max(0, min(xmax, img.cols - 1));
-            ymax = max(0, min(ymax, img.rows - 1));
-
-            if ((xmax - xmin) < 10 || (ymax - ymin) < 10) {
-                cerr << "[ERROR] ROI muy pequeña en " << imagePath << endl;
-                continue;
+// Uso: ./train2.bin [-j N] [--full] [--features sift|surf|orb|akaze|brisk] [--quantize] [--pca N] [--out ARCHIVO]
+//   -j N        hilos (por defecto todos los núcleos, -j 1 = secuencial)
+//   --out       base de salida (por defecto train_<extractor>_descriptors.vdb, p. ej. train_sift_descriptors.vdb)
+//   --full      ignora el manifiesto y vuelve a extraer todo el dataset
+//   --features  extractor (por defecto sift); queda registrado en la base
+//   --quantize  guarda los descriptores float en un byte por valor (4 veces menos memoria)
+//   --pca N     proyecta los descriptores float a N dimensiones (32 o 64) con PCA
+//   El códec se guarda en <base>.codec.yml y test3.bin lo aplica a las consultas.
+//   --pack ARCHIVO         paquete con las ROIs ya recortadas en gris: las imágenes que no cambiaron
+//                          se leen de ahí en vez de decodificar el JPEG, y se actualiza al terminar
+//   --decode-min-roi N     decodifica los JPEG a 1/2, 1/4 o 1/8 mientras el lado menor de la ROI
+//                          siga siendo de al menos N px (0 = resolución completa, por defecto)
+int main(int argc, char *argv[]) {
+    string datasetPath = "train";  
+    unsigned jobs = parseJobsArg(argc, argv);
+    FeatureBackend backend = parseFeaturesArg(argc, argv);
+    string outputDb = defaultDescriptorDb(backend, "train_");
+    bool full = false, quantize = false;
+    int pcaDims = 0;
+    string packPath;
+    DecodeOptions decode;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--full") full = true;
+        else if (arg == "--quantize") quantize = true;
+        else if (arg == "--pca" && i + 1 < argc) pcaDims = max(0, atoi(argv[++i]));
+        else if (arg == "--pack" && i + 1 < argc) packPath = argv[++i];
+        else if (arg == "--decode-min-roi" && i + 1 < argc) decode.minRoiSide = max(0, atoi(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc) outputDb = argv[++i];
+    }
+    if (isBinaryBackend(backend) && (quantize || pcaDims > 0)) {
+        cerr << "[ERROR] --quantize y --pca solo se aplican a descriptores float; se ignoran con "
+             << featureBackendName(backend) << "." << endl;
+        quantize = false;
+        pcaDims = 0;
+    }
+    bool useCodec = quantize || pcaDims > 0;
+    const string extractorConfig = extractorParams(backend, decode) + codecOptions(pcaDims, quantize);
+
+    // Entrenamiento incremental: requiere el manifiesto y la base anteriores con los mismos parámetros
+    DatasetManifest oldManifest, newManifest;
+    DescriptorDB oldDb;
+    newManifest.params = extractorConfig;
+    string manifestPath = manifestPathFor(outputDb);
+    bool incremental = !full && fs::exists(manifestPath) && oldManifest.load(manifestPath) &&
+                       oldManifest.params == extractorConfig && oldDb.open(outputDb);
+    // Las ROIs reutilizadas ya están codificadas: se conserva el códec anterior en vez de ajustar uno nuevo
+    DescriptorCodec codec;
+    bool codecReady = false;
+    if (incremental && useCodec) {
+        codecReady = codec.load(codecPathFor(outputDb));
+        incremental = codecReady;
+    }
+    if (!incremental) oldDb.close();
+    auto previousEntries = entriesByPath(oldDb);
+
+    DescriptorDBWriter dbOut;
+    dbOut.setBackend(backend);
+
+    vector<fs::path> imageFiles;
+    for (const auto &path : listDatasetImages(datasetPath)) imageFiles.push_back(path);
+
+    // Anotaciones de todos los objetos, desde el índice compilado (solo se parsean los XML modificados)
+    AnnotationIndex annotations = compileAnnotations(datasetPath, jobs);
+    vector<const AnnotatedImage *> annotated(imageFiles.size());
+    for (size_t i = 0; i < imageFiles.size(); i++) annotated[i] = annotations.find(imageFiles[i].string());
+
+    // ROIs ya recortadas de una ejecución anterior
+    DatasetPack oldPack;
+    bool usePack = !packPath.empty();
+    if (usePack && oldPack.open(packPath, roiParams(decode))) {
+        cout << "[INFO] Paquete de ROIs " << packPath << " con " << oldPack.size() << " ROIs." << endl;
+    }
+
+    // Comparar cada imagen y su XML con el manifiesto (puede requerir hashear el contenido)
+    vector<ManifestRecord> records(imageFiles.size());
+    vector<char> reuse(imageFiles.size(), 0);
+    parallelFor(imageFiles.size(), jobs, [&](size_t i) {
+        string imagePath = imageFiles[i].string();
+        fs::path xmlPath = imageFiles[i];
+        xmlPath.replace_extension(".xml");
+
+        const ManifestRecord *prev = incremental ? oldManifest.find(imagePath) : nullptr;
+        records[i].imagePath = imagePath;
+        bool sameImage = fileUnchanged(imagePath, prev ? &prev->image : nullptr, records[i].image);
+        // El índice de anotaciones ya tiene el sello actual del XML
+        bool sameXml;
+        if (annotated[i]) {
+            records[i].xml = annotated[i]->xml;
+            sameXml = prev && prev->xml.size == records[i].xml.size && prev->xml.hash == records[i].xml.hash;
+        } else {
+            sameXml = fileUnchanged(xmlPath.string(), prev ? &prev->xml : nullptr, records[i].xml);
+        }
+        if (prev && sameImage && sameXml) {
+            // Solo se reutiliza si la base anterior tiene las ROIs que indica el manifiesto
+            auto it = previousEntries.find(imagePath);
+            size_t available = it == previousEntries.end() ? 0 : it->second.size();
+            if ((int)available == prev->entries) {
+                reuse[i] = 1;
+                records[i].entries = prev->entries;
             }
+        }
+    });
+
+    vector<size_t> pending;
+    for (size_t i = 0; i < imageFiles.size(); i++) {
+        if (!reuse[i]) pending.push_back(i);
+    }
+    cout << "[INFO] Procesando " << pending.size() << " de " << imageFiles.size() << " imágenes con "
+         << featureBackendName(backend) << " y " << jobs << " hilo(s)";
+    if (incremental) cout << " (" << imageFiles.size() - pending.size() << " sin cambios desde el último entrenamiento)";
+    cout << "." << endl;
 
-            Rect roi(xmin, ymin, xmax - xmin, ymax - ymin);
-            Mat roiImg = img(roi).clone();
+    // Los hilos del pool ya ocupan todos los núcleos, se evita el paralelismo interno de OpenCV
+    int cvThreads = getNumThreads();
+    if (jobs > 1) setNumThreads(1);
 
-            vector<KeyPoint> kp;
-            Mat des;
-            sift->detectAndCompute(roiImg, noArray(), kp, des);
+    // Una tarea por objeto anotado de cada imagen pendiente
+    vector<vector<EntryResult>> results(imageFiles.size());
+    vector<pair<size_t, size_t>> tasks;
+    for (size_t i : pending) {
+        if (!annotated[i]) continue;
+        results[i].resize(annotated[i]->objects.size());
+        for (size_t k = 0; k < annotated[i]->objects.size(); k++) tasks.push_back({i, k});
+    }
+    vector<int> packIndex(tasks.size(), -1);
+    for (size_t t = 0; t < tasks.size() && oldPack.isOpen(); t++) {
+        size_t i = tasks[t].first;
+        packIndex[t] = oldPack.findFresh(imageFiles[i].string(), records[i].image, records[i].xml, tasks[t].second);
+    }
+    parallelFor(tasks.size(), jobs, [&](size_t t) {
+        size_t i = tasks[t].first, k = tasks[t].second;
+        RoiSample packed;
+        if (packIndex[t] >= 0) packed = oldPack.sample(packIndex[t]);
+        results[i][k] = processEntry(imageFiles[i], annotated[i]->objects[k].box, backend, decode,
+                                     packIndex[t] >= 0 ? &packed : nullptr);
+    });
 
-            if (des.empty()) {
-                cerr << "[ERROR] No se detectaron descriptores en " << imagePath << endl;
-                continue;
+    setNumThreads(cvThreads);
+
+    if (usePack) {
+        size_t fromPack = 0;
+        for (int idx : packIndex) fromPack += idx >= 0;
+        cout << "[INFO] ROIs leídas del paquete: " << fromPack << ", decodificadas: " << tasks.size() - fromPack << endl;
+    }
+
+    if (useCodec && !codecReady) {
+        Mat samples = codecSample(results, CODEC_SAMPLE_ROWS);
+        if (!codec.fit(samples, pcaDims, quantize)) {
+            cerr << "[ERROR] No se pudo ajustar el códec de descriptores." << endl;
+            return -1;
+        }
+        cout << "[INFO] Códec ajustado con " << samples.rows << " descriptores"
+             << (pcaDims > 0 ? " (PCA a " + to_string(pcaDims) + " dimensiones)" : string()) << "." << endl;
+    }
+
+    // Escritura en el orden del directorio: la base es idéntica a la de una ejecución con -j 1
+    int descriptorCount = 0;
+    DatasetPackWriter packOut;
+    for (size_t i = 0; i < results.size(); i++) {
+        ManifestRecord &record = records[i];
+        if (reuse[i]) {
+            // Las ROIs del paquete anterior siguen valiendo si la imagen no cambió
+            for (size_t k = 0; usePack && oldPack.isOpen(); k++) {
+                int idx = oldPack.findFresh(record.imagePath, record.image, record.xml, k);
+                if (idx < 0) break;
+                packOut.addFrom(oldPack, idx);
+            }
+            for (size_t idx : previousEntries[record.imagePath]) {
+                if (dbOut.addFrom(oldDb, idx)) descriptorCount++;
             }
+            newManifest.add(record);
+            continue;
+        }
 
-            // Guardar descriptores y keypoints en el archivo
-            fsOut << ("descriptor_" + to_string(descriptorCount)) << des;
-            fsOut << ("bbox_" + to_string(descriptorCount)) << "[:" << xmin << ymin << xmax << ymax << "]";
-            fsOut << ("imagePath_" + to_string(descriptorCount)) << imagePath;
+        record.entries = 0;
+        string error = annotationError(imageFiles[i], annotated[i]);
+        if (!error.empty()) cerr << error << endl;
 
-            fsOut << ("keypoints_" + to_string(descriptorCount)) << "[";
-            for (const auto& k : kp) {
-                fsOut << k.pt.x << k.pt.y;
+        for (EntryResult &r : results[i]) {
+            if (usePack && r.hasSample) packOut.add(record.imagePath, record.image, record.xml, r.sample);
+            if (!r.ok) {
+                if (!r.error.empty()) cerr << r.error << endl;
+                continue;
             }
-            fsOut << "]";
 
-            cout << "[DEBUG] Descriptor " << descriptorCount << " guardado con " << des.rows << " x " << des.cols << " y " << kp.size() << " keypoints." << endl;
+            // Guardar descriptores (en el formato del códec), bbox, ruta y keypoints en la base
+            Mat stored;
+            codec.encode(r.des, stored);
+            if (!dbOut.add(imageFiles[i].string(), r.roi, r.kp, stored)) continue;
+
+            cout << "[DEBUG] Descriptor " << descriptorCount << " guardado con " << stored.rows << " x " << stored.cols << " y " << r.kp.size() << " keypoints." << endl;
             descriptorCount++;
+            record.entries++;
+        }
+        newManifest.add(record);
+        results[i].clear(); // Liberar memoria a medida que se escribe
+    }
+
+    if (!dbOut.save(outputDb)) {
+        cerr << "[ERROR] No se pudo escribir " << outputDb << endl;
+        return -1;
+    }
+    if (useCodec) {
+        codec.save(codecPathFor(outputDb));
+    } else {
+        fs::remove(codecPathFor(outputDb));
+    }
+    newManifest.save(manifestPath);
+    if (usePack) {
+        if (packOut.save(packPath, roiParams(decode))) {
+            cout << "[INFO] Paquete de ROIs guardado en " << packPath << " (" << packOut.size() << " ROIs)." << endl;
         }
+        oldPack.close();
+    }
+    cout << "[INFO] Se guardaron " << descriptorCount << " descriptores en " << outputDb << endl;
+    if (incremental) {
+        cout << "[INFO] Imágenes eliminadas desde el último entrenamiento: " << countRemoved(oldManifest, newManifest) << endl;
     }
 
-    fsOut.release();
-    cout << "[INFO] Se guardaron " << descriptorCount << " descriptores en " << outputYml << endl;
+    // Índice global prearmado para que los procesos de consulta no paguen su construcción
+    buildAndSaveIndex(outputDb);
+
+    // Vocabulario visual (BoVW) con el que test3.bin preselecciona las ROIs a verificar.
+    // El k-means trabaja con distancias L2: con descriptores binarios no se genera.
+    if (isBinaryBackend(backend)) {
+        fs::remove(vocabularyPathFor(outputDb));
+    } else {
+        buildAndSaveVocabulary(outputDb, jobs);
+    }
     return 0;
 }
@@ -0,0 +1,367 @@
+#include "Vocabulary.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include "Parallel.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const char VOCAB_MAGIC[4] = {'V', 'C', 'B', 'W'};
+static const uint32_t VOCAB_VERSION = 2;   // la 2 agrega la huella de la base
+
+#pragma pack(push, 1)
+struct VocabHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t descCols;
+    int32_t nodeCount;
+    int32_t wordCount;
+    uint64_t dbEntries;
+    uint64_t dbRows;
+    uint64_t dbFingerprint;     // DescriptorDB::fingerprint() de la base con la que se construyó
+};
+#pragma pack(pop)
+
+static float squaredDistance(const float *a, const float *b, int n) {
+    float s = 0;
+    for (int k = 0; k < n; k++) {
+        float d = a[k] - b[k];
+        s += d * d;
+    }
+    return s;
+}
+
+//----------------------------------------------------------
+// Construcción del árbol
+//----------------------------------------------------------
+int VisualVocabulary::addNode(const Mat &center) {
+    centers.push_back(center);
+    firstChild.push_back(-1);
+    childCount.push_back(0);
+    wordOfNode.push_back(-1);
+    return (int)firstChild.size() - 1;
+}
+
+void VisualVocabulary::split(int node, const Mat &samples, const vector<int> &rows, int level,
+                             const VocabularyParams &params) {
+    // Hoja: último nivel o muy pocos descriptores para repartir
+    if (level == params.depth || (int)rows.size() < 2 * params.branching) {
+        wordOfNode[node] = wordCount++;
+        return;
+    }
+
+    Mat data((int)rows.size(), descCols, CV_32F);
+    for (size_t r = 0; r < rows.size(); r++) samples.row(rows[r]).copyTo(data.row((int)r));
+
+    Mat labels, clusterCenters;
+    kmeans(data, params.branching, labels,
+           TermCriteria(TermCriteria::MAX_ITER + TermCriteria::EPS, params.kmeansIterations, 1e-4),
+           1, KMEANS_PP_CENTERS, clusterCenters);
+
+    vector<vector<int>> members(params.branching);
+    for (size_t r = 0; r < rows.size(); r++) members[labels.at<int>((int)r)].push_back(rows[r]);
+
+    // Los hijos de un nodo quedan contiguos; los grupos vacíos se descartan
+    vector<int> children;
+    for (int k = 0; k < params.branching; k++) {
+        if (!members[k].empty()) children.push_back(k);
+    }
+    firstChild[node] = (int)firstChild.size();
+    childCount[node] = (int)children.size();
+    for (int k : children) addNode(clusterCenters.row(k));
+
+    for (size_t c = 0; c < children.size(); c++) {
+        split(firstChild[node] + (int)c, samples, members[children[c]], level + 1, params);
+    }
+}
+
+bool VisualVocabulary::build(const DescriptorDB &db, const VocabularyParams &params, unsigned jobs) {
+    if (!db.isOpen() || db.totalRows() == 0) return false;
+    if (isBinaryBackend(db.featureBackend())) {
+        cerr << "[ERROR] El vocabulario visual requiere descriptores float (SIFT, SURF)." << endl;
+        return false;
+    }
+
+    descCols = db.descriptorCols();
+    centers.release();
+    firstChild.clear();
+    childCount.clear();
+    wordOfNode.clear();
+    wordCount = 0;
+
+    // Muestra aleatoria (reproducible) de los descriptores para el k-means
+    // Los descriptores cuantizados (DescriptorCodec) se llevan a float solo durante la construcción
+    Mat all = db.allDescriptors();
+    if (all.type() != CV_32F) all.convertTo(all, CV_32F);
+    vector<int> rows(all.rows);
+    iota(rows.begin(), rows.end(), 0);
+    mt19937 rng(params.seed);
+    if ((int)rows.size() > params.maxTrainRows) {
+        shuffle(rows.begin(), rows.end(), rng);
+        rows.resize(params.maxTrainRows);
+        sort(rows.begin(), rows.end());
+    }
+    setRNGSeed(params.seed);
+
+    addNode(Mat::zeros(1, descCols, CV_32F));
+    split(0, all, rows, 0, params);
+
+    // Palabra de cada descriptor de la base
+    dbEntries = db.size();
+    dbRows = db.totalRows();
+    dbFingerprint = db.fingerprint();
+    wordOfRow.assign(dbRows, 0);
+    parallelFor(dbRows, jobs, [&](size_t r) {
+        wordOfRow[r] = quantize(all.ptr<float>((int)r));
+    });
+
+    buildInvertedFile(db);
+    return true;
+}
+
+int VisualVocabulary::quantize(const float *descriptor) const {
+    int node = 0;
+    while (firstChild[node] >= 0) {
+        int best = firstChild[node];
+        float bestDist = FLT_MAX;
+        for (int c = firstChild[node]; c < firstChild[node] + childCount[node]; c++) {
+            float d = squaredDistance(descriptor, centers.ptr<float>(c), descCols);
+            if (d < bestDist) {
+                bestDist = d;
+                best = c;
+            }
+        }
+        node = best;
+    }
+    return wordOfNode[node];
+}
+
+//----------------------------------------------------------
+// Archivo invertido con pesos TF-IDF
+//----------------------------------------------------------
+// Pesos tf x idf de una lista ordenada de palabras; devuelve la norma L2 al cuadrado
+static double tfidfWeights(const vector<int32_t> &sortedWords, const vector<float> &idf,
+                           vector<pair<int, float>> &weights) {
+    weights.clear();
+    double norm = 0;
+    for (size_t k = 0; k < sortedWords.size();) {
+        size_t end = k;
+        while (end < sortedWords.size() && sortedWords[end] == sortedWords[k]) end++;
+        float w = (float)(end - k) * idf[sortedWords[k]];
+        if (w > 0) {
+            weights.push_back({sortedWords[k], w});
+            norm += (double)w * w;
+        }
+        k = end;
+    }
+    return norm;
+}
+
+void VisualVocabulary::buildInvertedFile(const DescriptorDB &db) {
+    // Palabras (con repetición) de cada ROI, ordenadas para contar
+    vector<vector<int32_t>> roiWords(dbEntries);
+    vector<int> documentFrequency(wordCount, 0);
+    int documents = 0;
+    for (size_t i = 0; i < dbEntries; i++) {
+        const DBEntry &e = db.entry(i);
+        roiWords[i].assign(wordOfRow.begin() + e.descRow, wordOfRow.begin() + e.descRow + e.descCount);
+        sort(roiWords[i].begin(), roiWords[i].end());
+        if (!roiWords[i].empty()) documents++;
+        for (size_t k = 0; k < roiWords[i].size(); k++) {
+            if (k == 0 || roiWords[i][k] != roiWords[i][k - 1]) documentFrequency[roiWords[i][k]]++;
+        }
+    }
+
+    idf.assign(wordCount, 0.f);
+    for (int w = 0; w < wordCount; w++) {
+        if (documentFrequency[w] > 0) idf[w] = (float)log((double)documents / documentFrequency[w]);
+    }
+
+    invertedFile.assign(wordCount, vector<Posting>());
+    for (size_t i = 0; i < dbEntries; i++) {
+        vector<pair<int, float>> weights;
+        double norm = tfidfWeights(roiWords[i], idf, weights);
+        if (norm <= 0) continue;
+        float inv = (float)(1.0 / sqrt(norm));
+        for (const auto &w : weights) invertedFile[w.first].push_back({(int)i, w.second * inv});
+    }
+}
+
+vector<int> VisualVocabulary::shortlist(const Mat &queryDescriptors, int topK) const {
+    vector<int> result;
+    if (empty() || queryDescriptors.empty() || topK <= 0) return result;
+    CV_Assert(queryDescriptors.cols == descCols);
+
+    Mat query = queryDescriptors;
+    if (query.type() != CV_32F) queryDescriptors.convertTo(query, CV_32F);
+    vector<int32_t> words(query.rows);
+    for (int r = 0; r < query.rows; r++) words[r] = quantize(query.ptr<float>(r));
+    sort(words.begin(), words.end());
+
+    vector<pair<int, float>> weights;
+    double norm = tfidfWeights(words, idf, weights);
+    if (norm <= 0) return result;
+    float inv = (float)(1.0 / sqrt(norm));
+
+    // Solo se tocan las ROIs que aparecen en las listas de las palabras de la consulta;
+    // el acumulador se reutiliza entre consultas y se limpia solo en esas posiciones
+    thread_local vector<float> scores;
+    if (scores.size() != dbEntries) scores.assign(dbEntries, 0.f);
+    vector<int> touched;
+
+    for (const auto &w : weights) {
+        for (const Posting &p : invertedFile[w.first]) {
+            if (scores[p.roi] == 0) touched.push_back(p.roi);
+            scores[p.roi] += w.second * inv * p.weight;
+        }
+    }
+
+    int k = min((int)touched.size(), topK);
+    partial_sort(touched.begin(), touched.begin() + k, touched.end(),
+                 [](int a, int b) { return scores[a] > scores[b] || (scores[a] == scores[b] && a < b); });
+    result.assign(touched.begin(), touched.begin() + k);
+    for (int roi : touched) scores[roi] = 0;
+    return result;
+}
+
+//----------------------------------------------------------
+// Archivo
+//----------------------------------------------------------
+bool VisualVocabulary::save(const string &path) const {
+    if (empty()) return false;
+
+    VocabHeader h;
+    memcpy(h.magic, VOCAB_MAGIC, 4);
+    h.version = VOCAB_VERSION;
+    h.descCols = descCols;
+    h.nodeCount = (int32_t)firstChild.size();
+    h.wordCount = wordCount;
+    h.dbEntries = dbEntries;
+    h.dbRows = dbRows;
+    h.dbFingerprint = dbFingerprint;
+
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "[ERROR] No se pudo abrir " << tmpPath << " para escritura." << endl;
+        return false;
+    }
+    out.write((const char *)&h, sizeof(h));
+    for (int n = 0; n < h.nodeCount; n++) out.write((const char *)centers.ptr<float>(n), descCols * sizeof(float));
+    out.write((const char *)firstChild.data(), firstChild.size() * sizeof(int32_t));
+    out.write((const char *)childCount.data(), childCount.size() * sizeof(int32_t));
+    out.write((const char *)wordOfNode.data(), wordOfNode.size() * sizeof(int32_t));
+    out.write((const char *)wordOfRow.data(), wordOfRow.size() * sizeof(int32_t));
+    out.close();
+
+    if (!out) {
+        cerr << "[ERROR] Falló la escritura de " << tmpPath << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cerr << "[ERROR] No se pudo renombrar " << tmpPath << " a " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// quantize() baja desde la raíz siguiendo firstChild y buildInvertedFile() indexa con las
+// palabras: los hijos deben estar después del padre (así el recorrido termina) y dentro
+// del árbol, y toda palabra de una hoja o de una fila debe ser menor que words
+bool VisualVocabulary::validTree(int words) const {
+    int nodes = (int)firstChild.size();
+    for (int n = 0; n < nodes; n++) {
+        if (firstChild[n] < 0) {
+            if (wordOfNode[n] < 0 || wordOfNode[n] >= words) return false;
+        } else if (firstChild[n] <= n || childCount[n] <= 0 || childCount[n] > nodes - firstChild[n]) {
+            return false;
+        }
+    }
+    for (int32_t w : wordOfRow) {
+        if (w < 0 || w >= words) return false;
+    }
+    return true;
+}
+
+bool VisualVocabulary::load(const DescriptorDB &db, const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+
+    VocabHeader h;
+    in.read((char *)&h, sizeof(h));
+    if (!in || memcmp(h.magic, VOCAB_MAGIC, 4) != 0 || h.version != VOCAB_VERSION) {
+        cerr << "[ERROR] " << path << " no es un vocabulario válido." << endl;
+        return false;
+    }
+    if (!db.isOpen() || isBinaryBackend(db.featureBackend()) || h.dbEntries != db.size() || h.dbRows != db.totalRows() ||
+        h.descCols != db.descriptorCols() || h.dbFingerprint != db.fingerprint()) {
+        cerr << "[ERROR] El vocabulario " << path << " no corresponde a la base de descriptores." << endl;
+        return false;
+    }
+
+    // El tamaño del archivo debe cuadrar con la cabecera antes de reservar nada
+    in.seekg(0, ios::end);
+    uint64_t fileSize = (uint64_t)in.tellg();
+    in.seekg(sizeof(h), ios::beg);
+    if (h.descCols <= 0 || h.nodeCount <= 0 || h.wordCount <= 0 || h.wordCount > h.nodeCount ||
+        fileSize != sizeof(h) + (uint64_t)h.nodeCount * (h.descCols + 3) * sizeof(int32_t) + h.dbRows * sizeof(int32_t)) {
+        cerr << "[ERROR] El vocabulario " << path << " está dañado." << endl;
+        return false;
+    }
+
+    descCols = h.descCols;
+    centers.create(h.nodeCount, descCols, CV_32F);
+    for (int n = 0; n < h.nodeCount; n++) in.read((char *)centers.ptr<float>(n), descCols * sizeof(float));
+    firstChild.resize(h.nodeCount);
+    childCount.resize(h.nodeCount);
+    wordOfNode.resize(h.nodeCount);
+    wordOfRow.resize(h.dbRows);
+    in.read((char *)firstChild.data(), firstChild.size() * sizeof(int32_t));
+    in.read((char *)childCount.data(), childCount.size() * sizeof(int32_t));
+    in.read((char *)wordOfNode.data(), wordOfNode.size() * sizeof(int32_t));
+    in.read((char *)wordOfRow.data(), wordOfRow.size() * sizeof(int32_t));
+    if (!in) {
+        cerr << "[ERROR] El vocabulario " << path << " está incompleto." << endl;
+        wordCount = 0;
+        return false;
+    }
+    if (!validTree(h.wordCount)) {
+        cerr << "[ERROR] El vocabulario " << path << " está dañado." << endl;
+        wordCount = 0;
+        return false;
+    }
+
+    wordCount = h.wordCount;
+    dbEntries = h.dbEntries;
+    dbRows = h.dbRows;
+    dbFingerprint = h.dbFingerprint;
+    buildInvertedFile(db);
+    return true;
+}
+
+string vocabularyPathFor(const string &dbPath) {
+    return dbPath + ".bovw";
+}
+
+bool buildAndSaveVocabulary(const string &dbPath, unsigned jobs) {
+    DescriptorDB db;
+    if (!db.open(dbPath)) return false;
+
+    VisualVocabulary vocabulary;
+    if (!vocabulary.build(db, VocabularyParams(), jobs)) {
+        cerr << "[ERROR] No se pudo construir el vocabulario visual para " << dbPath << endl;
+        return false;
+    }
+    string path = vocabularyPathFor(dbPath);
+    if (!vocabulary.save(path)) return false;
+    cout << "[INFO] Vocabulario visual (" << vocabulary.words() << " palabras) guardado en " << path << endl;
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef VOCABULARY_HPP
+#define VOCABULARY_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "DescriptorDB.hpp"
+
+// Recuperación por bolsa de palabras visuales (BoVW) para preseleccionar ROIs
+// antes del matching de descriptores y la homografía de Test3.
+//
+// El vocabulario es un árbol de k-means jerárquico (branching hijos por nodo,
+// depth niveles): asignar un descriptor a su palabra cuesta branching x depth
+// distancias en vez de una por palabra. Cada ROI de la base se representa con
+// su histograma de palabras ponderado con TF-IDF y normalizado; el archivo
+// invertido (palabra -> ROIs que la contienen) permite puntuar una consulta
+// recorriendo solo las ROIs que comparten palabras con ella.
+//
+// Se construye al entrenar y se guarda junto a la base (<db>.bovw) con la huella
+// de la base (DescriptorDB::fingerprint); si la base cambia, aunque tenga el mismo
+// número de ROIs y descriptores, el vocabulario se descarta.
+
+struct VocabularyParams {
+    int branching = 10;
+    int depth = 3;                  // hasta branching^depth palabras
+    int maxTrainRows = 200000;      // muestra de descriptores para el k-means
+    int kmeansIterations = 10;
+    int seed = 12345;
+};
+
+class VisualVocabulary {
+public:
+    // Construye el árbol con una muestra de la base y asigna cada descriptor a su palabra
+    bool build(const DescriptorDB &db, const VocabularyParams &params = VocabularyParams(), unsigned jobs = 1);
+
+    // Escribe a un archivo temporal y lo renombra
+    bool save(const std::string &path) const;
+    // Carga un vocabulario guardado; falla si no corresponde a la base
+    bool load(const DescriptorDB &db, const std::string &path);
+
+    // Palabra visual de un descriptor (fila CV_32F; las consultas cuantizadas se convierten en shortlist)
+    int quantize(const float *descriptor) const;
+
+    // Las topK ROIs con mayor similitud coseno TF-IDF con los descriptores de consulta,
+    // de mayor a menor puntuación. Las ROIs sin palabras en común no se devuelven.
+    std::vector<int> shortlist(const cv::Mat &queryDescriptors, int topK) const;
+
+    bool empty() const { return wordCount == 0; }
+    int words() const { return wordCount; }
+
+private:
+    struct Posting {
+        int roi;
+        float weight;               // tf-idf normalizado de la palabra en la ROI
+    };
+
+    int addNode(const cv::Mat &center);
+    void split(int node, const cv::Mat &samples, const std::vector<int> &rows, int level, const VocabularyParams &params);
+    void buildInvertedFile(const DescriptorDB &db);
+    bool validTree(int words) const;
+
+    int descCols = 0;
+    cv::Mat centers;                    // un centro por nodo (la fila 0, la raíz, no se usa)
+    std::vector<int32_t> firstChild;    // primer hijo de cada nodo (-1 en las hojas)
+    std::vector<int32_t> childCount;
+    std::vector<int32_t> wordOfNode;    // palabra de cada hoja (-1 en nodos internos)
+    int wordCount = 0;
+
+    // Estado dependiente de la base
+    uint64_t dbEntries = 0, dbRows = 0, dbFingerprint = 0;
+    std::vector<int32_t> wordOfRow;     // palabra de cada descriptor de la base
+    std::vector<float> idf;
+    std::vector<std::vector<Posting>> invertedFile;
+};
+
+// Ruta del vocabulario que acompaña a una base de descriptores
+std::string vocabularyPathFor(const std::string &dbPath);
+
+// Abre la base, construye el vocabulario y lo guarda junto a ella (se usa al entrenar)
+bool buildAndSaveVocabulary(const std::string &dbPath, unsigned jobs = 1);
+
+#endif
@@ -1,8 +1,8 @@
-from flask import Flask, request, send_file, jsonify
+from flask import Flask, request, send_file, jsonify, Response
 import os
 import cv2
 import numpy as np
-from detector import detectar_objetos
+import detection_client
 
 app = Flask(__name__)
 
@@ -19,7 +19,24 @@ def upload():
     file = request.files['file']
     if file.filename == '':
         return jsonify({"error": "El archivo no tiene nombre"}), 400
-    
+
+    # Con el demonio de detección corriendo la imagen no pasa por disco y los modelos ya están cargados
+    if detection_client.disponible():
+        try:
+            resultado, anotada = detection_client.detectar([file.read()], detection_client.PIPELINE_HOMOGRAPHY,
+                                                           anotar=True)[0]
+        except OSError:
+            # Socket huérfano de un demonio caído, o demonio sin el modelo (NoDisponible): camino de disco
+            file.stream.seek(0)
+        else:
+            if not resultado.get("ok"):
+                return jsonify({"error": resultado.get("error", "Error en la detección")}), 400
+            response = Response(anotada, mimetype='image/jpeg')
+            response.headers["X-Detections"] = str(len(resultado["detections"]))
+            return response
+
+    # Sin demonio: detector.py carga sus referencias al importarse
+    from detector import detectar_objetos
     filename = os.path.join(UPLOAD_FOLDER, file.filename)
     file.save(filename)
 
@@ -0,0 +1,101 @@
+"""Cliente del demonio de detección (daemon.bin).
+
+Envía las imágenes en memoria por el socket Unix del demonio y recibe las
+detecciones en JSON y, si se pide, el JPEG anotado. El protocolo está descrito
+en DaemonProtocol.hpp.
+"""
+import json
+import os
+import socket
+import struct
+import threading
+
+SOCKET_PATH = os.environ.get("VISION_SOCKET", "/tmp/vision.sock")
+
+PIPELINE_HOMOGRAPHY = 0
+PIPELINE_LBP = 1
+PIPELINE_CASCADE = 2
+
+DAEMON_ANNOTATE = 1
+
+_REQUEST = struct.Struct("<4sIIII")   # magic, version, pipeline, flags, imageCount
+_RESPONSE = struct.Struct("<4sIIQ")   # magic, version, imageCount, jsonLength
+_SIZE = struct.Struct("<Q")
+
+class NoDisponible(OSError):
+    """El demonio corre sin el modelo (base o SVM) que necesita el pipeline pedido."""
+
+
+_local = threading.local()   # una conexión persistente por hilo de Flask
+
+
+def disponible(socket_path=SOCKET_PATH):
+    """True si existe el socket del demonio en socket_path.
+
+    Si el demonio murió sin limpiar (kill -9, OOM) el archivo queda y detectar()
+    lanza OSError: los llamadores deben atraparlo y usar su camino sin demonio.
+    """
+    return os.path.exists(socket_path)
+
+
+def _recv_exact(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(min(size - len(data), 1 << 20))
+        if not chunk:
+            raise ConnectionError("El demonio cerró la conexión")
+        data += chunk
+    return bytes(data)
+
+
+def _conexion(socket_path):
+    sock = getattr(_local, "sock", None)
+    if sock is None or getattr(_local, "path", None) != socket_path:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(socket_path)
+        _local.sock, _local.path = sock, socket_path
+    return sock
+
+
+def _cerrar():
+    sock = getattr(_local, "sock", None)
+    if sock is not None:
+        sock.close()
+    _local.sock = None
+
+
+def detectar(imagenes, pipeline=PIPELINE_HOMOGRAPHY, anotar=False, socket_path=SOCKET_PATH):
+    """Detecta sobre una lista de imágenes (bytes del JPEG/PNG).
+
+    Devuelve una lista de (resultado, jpeg_anotado) en el mismo orden; jpeg_anotado
+    es None si no se pidió. Si la conexión se cortó (p. ej. el demonio se reinició)
+    se reintenta una vez con una conexión nueva. Si el demonio no tiene cargado el
+    modelo del pipeline lanza NoDisponible (un OSError), igual que si no hubiera demonio.
+    """
+    peticion = [_REQUEST.pack(b"VDRQ", 1, pipeline, DAEMON_ANNOTATE if anotar else 0, len(imagenes))]
+    for datos in imagenes:
+        peticion.append(_SIZE.pack(len(datos)))
+        peticion.append(datos)
+    peticion = b"".join(peticion)
+
+    for intento in range(2):
+        try:
+            sock = _conexion(socket_path)
+            sock.sendall(peticion)
+            magic, version, cantidad, json_length = _RESPONSE.unpack(_recv_exact(sock, _RESPONSE.size))
+            if magic != b"VDRS" or cantidad != len(imagenes):
+                raise ConnectionError("Respuesta inválida del demonio")
+            resultados = json.loads(_recv_exact(sock, json_length))
+            anotadas = []
+            for _ in range(cantidad):
+                (size,) = _SIZE.unpack(_recv_exact(sock, _SIZE.size))
+                anotadas.append(_recv_exact(sock, size) if size else None)
+        except (ConnectionError, OSError):
+            _cerrar()
+            if intento == 1:
+                raise
+            continue
+        for resultado in resultados:
+            if resultado.get("unavailable"):
+                raise NoDisponible(resultado.get("error", "Pipeline no disponible en el demonio"))
+        return list(zip(resultados, anotadas))
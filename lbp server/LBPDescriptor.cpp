@@ -0,0 +1,358 @@
+#include "LBPDescriptor.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LBP_X86 1
+#endif
+
+using namespace std;
+using namespace cv;
+
+//----------------------------------------------------------
+// Kernels por fila. Cada uno calcula out[j] para el píxel central mid[j + 1]
+// a partir de los punteros a las filas de arriba, centro y abajo, con el mismo
+// orden de bits que la versión original píxel a píxel:
+//   7: arriba-izq  6: arriba  5: arriba-der  4: derecha
+//   3: abajo-der   2: abajo   1: abajo-izq   0: izquierda
+//----------------------------------------------------------
+namespace {
+
+void lbpRowScalar(const uchar *up, const uchar *mid, const uchar *down, uchar *out, int from, int width) {
+    for(int j = from; j < width; j++) {
+        uchar center = mid[j + 1];
+        uchar code = 0;
+        code |= (up[j]       > center) << 7;
+        code |= (up[j + 1]   > center) << 6;
+        code |= (up[j + 2]   > center) << 5;
+        code |= (mid[j + 2]  > center) << 4;
+        code |= (down[j + 2] > center) << 3;
+        code |= (down[j + 1] > center) << 2;
+        code |= (down[j]     > center) << 1;
+        code |= (mid[j]      > center) << 0;
+        out[j] = code;
+    }
+}
+
+#ifdef LBP_X86
+// No hay comparación sin signo de 8 bits en SSE2/AVX2: a > b (sin signo)
+// equivale a (a ^ 0x80) > (b ^ 0x80) con signo.
+
+// SSE2: 16 píxeles por iteración; devuelve cuántos píxeles procesó
+inline __m128i bitSSE2(const uchar *p, __m128i center, __m128i bias, char weight) {
+    __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), bias);
+    return _mm_and_si128(_mm_cmpgt_epi8(v, center), _mm_set1_epi8(weight));
+}
+
+int lbpRowSSE2(const uchar *up, const uchar *mid, const uchar *down, uchar *out, int width) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    int j = 0;
+    for(; j + 16 <= width; j += 16) {
+        __m128i c = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(mid + j + 1)), bias);
+        __m128i code = bitSSE2(up + j, c, bias, (char)0x80);
+        code = _mm_or_si128(code, bitSSE2(up + j + 1,   c, bias, 0x40));
+        code = _mm_or_si128(code, bitSSE2(up + j + 2,   c, bias, 0x20));
+        code = _mm_or_si128(code, bitSSE2(mid + j + 2,  c, bias, 0x10));
+        code = _mm_or_si128(code, bitSSE2(down + j + 2, c, bias, 0x08));
+        code = _mm_or_si128(code, bitSSE2(down + j + 1, c, bias, 0x04));
+        code = _mm_or_si128(code, bitSSE2(down + j,     c, bias, 0x02));
+        code = _mm_or_si128(code, bitSSE2(mid + j,      c, bias, 0x01));
+        _mm_storeu_si128((__m128i *)(out + j), code);
+    }
+    return j;
+}
+
+// AVX2: 32 píxeles por iteración (se compila aparte y solo se usa si la CPU lo soporta)
+__attribute__((target("avx2")))
+inline __m256i bitAVX2(const uchar *p, __m256i center, __m256i bias, char weight) {
+    __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p), bias);
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, center), _mm256_set1_epi8(weight));
+}
+
+__attribute__((target("avx2")))
+int lbpRowAVX2(const uchar *up, const uchar *mid, const uchar *down, uchar *out, int width) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    int j = 0;
+    for(; j + 32 <= width; j += 32) {
+        __m256i c = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(mid + j + 1)), bias);
+        __m256i code = bitAVX2(up + j, c, bias, (char)0x80);
+        code = _mm256_or_si256(code, bitAVX2(up + j + 1,   c, bias, 0x40));
+        code = _mm256_or_si256(code, bitAVX2(up + j + 2,   c, bias, 0x20));
+        code = _mm256_or_si256(code, bitAVX2(mid + j + 2,  c, bias, 0x10));
+        code = _mm256_or_si256(code, bitAVX2(down + j + 2, c, bias, 0x08));
+        code = _mm256_or_si256(code, bitAVX2(down + j + 1, c, bias, 0x04));
+        code = _mm256_or_si256(code, bitAVX2(down + j,     c, bias, 0x02));
+        code = _mm256_or_si256(code, bitAVX2(mid + j,      c, bias, 0x01));
+        _mm256_storeu_si256((__m256i *)(out + j), code);
+    }
+    // El resto (menos de 32) pasa por SSE2 antes del escalar
+    return j + lbpRowSSE2(up + j, mid + j, down + j, out + j, width - j);
+}
+#endif
+
+typedef int (*LBPRowKernel)(const uchar *, const uchar *, const uchar *, uchar *, int);
+
+int lbpRowNone(const uchar *, const uchar *, const uchar *, uchar *, int) {
+    return 0;
+}
+
+// Se elige una sola vez, al cargar el programa, según la CPU
+LBPRowKernel selectRowKernel() {
+#ifdef LBP_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return lbpRowAVX2;
+    if(__builtin_cpu_supports("sse2")) return lbpRowSSE2;
+#endif
+    return lbpRowNone;
+}
+
+const LBPRowKernel rowKernel = selectRowKernel();
+
+// Códigos LBP de la fila i (1..rows-2) de src en out (cols - 2 valores)
+inline void lbpRow(const Mat &src, int i, uchar *out) {
+    const uchar *up = src.ptr<uchar>(i - 1);
+    const uchar *mid = src.ptr<uchar>(i);
+    const uchar *down = src.ptr<uchar>(i + 1);
+    int width = src.cols - 2;
+    int done = rowKernel(up, mid, down, out, width);
+    lbpRowScalar(up, mid, down, out, done, width);
+}
+
+// Cuatro sub-histogramas para que los incrementos consecutivos del mismo bin no
+// dependan unos de otros; se suman al normalizar
+struct LBPCounts {
+    uint32_t c[4][256] = {};
+
+    void add(const uchar *codes, int n) {
+        int j = 0;
+        for(; j + 4 <= n; j += 4) {
+            c[0][codes[j]]++;
+            c[1][codes[j + 1]]++;
+            c[2][codes[j + 2]]++;
+            c[3][codes[j + 3]]++;
+        }
+        for(; j < n; j++) c[0][codes[j]]++;
+    }
+
+    // Mismo resultado que contar en float y dividir por la suma
+    vector<float> normalized() const {
+        vector<float> hist(256, 0.0f);
+        for(int b = 0; b < 256; b++) {
+            hist[b] = (float)(c[0][b] + c[1][b] + c[2][b] + c[3][b]);
+        }
+        float sum = 0.0f;
+        for(int b = 0; b < 256; b++) {
+            sum += hist[b];
+        }
+        if(sum > 0.0f) {
+            for(int b = 0; b < 256; b++) {
+                hist[b] /= sum;
+            }
+        }
+        return hist;
+    }
+};
+
+// Número de transiciones 0/1 recorriendo los 8 vecinos en círculo. Los bits
+// consecutivos del código son vecinos consecutivos, y el bit 0 (izquierda) es
+// vecino del bit 7 (arriba-izquierda), así que basta rotar un bit.
+int circularTransitions(int code) {
+    int rotated = ((code >> 1) | (code << 7)) & 0xFF;
+    return __builtin_popcount(code ^ rotated);
+}
+
+struct LBPTables {
+    uchar full[256];
+    uchar uniform[256];
+    uchar riu2[256];
+
+    LBPTables() {
+        int next = 0;
+        for(int code = 0; code < 256; code++) {
+            bool isUniform = circularTransitions(code) <= 2;
+            full[code] = (uchar)code;
+            // Los 58 patrones uniformes en orden de código; los demás al bin 58
+            uniform[code] = isUniform ? (uchar)next++ : 58;
+            riu2[code] = isUniform ? (uchar)__builtin_popcount(code) : 9;
+        }
+    }
+};
+
+const LBPTables &lbpTables() {
+    static const LBPTables tables;
+    return tables;
+}
+
+} // namespace
+
+//----------------------------------------------------------
+// Función para calcular la imagen LBP a partir de una imagen en escala de grises
+//----------------------------------------------------------
+Mat computeLBPImage(const Mat &src) {
+    if(src.rows < 3 || src.cols < 3) {
+        cerr << "La imagen es demasiado pequeña para calcular LBP." << endl;
+        return Mat();
+    }
+    Mat lbp(src.rows - 2, src.cols - 2, CV_8UC1);
+    for(int i = 1; i < src.rows - 1; i++) {
+        lbpRow(src, i, lbp.ptr<uchar>(i - 1));
+    }
+    return lbp;
+}
+
+//----------------------------------------------------------
+// Función para calcular el histograma LBP (256 bins)
+//----------------------------------------------------------
+vector<float> computeLBPHistogram(const Mat &lbpImg) {
+    LBPCounts counts;
+    for(int i = 0; i < lbpImg.rows; i++) {
+        counts.add(lbpImg.ptr<uchar>(i), lbpImg.cols);
+    }
+    return counts.normalized();
+}
+
+//----------------------------------------------------------
+// Imagen LBP + histograma en una sola pasada: cada fila de códigos se cuenta
+// mientras sigue en caché y la imagen LBP completa nunca se materializa
+//----------------------------------------------------------
+vector<float> computeLBPHistogramFromGray(const Mat &src) {
+    if(src.rows < 3 || src.cols < 3) {
+        cerr << "La imagen es demasiado pequeña para calcular LBP." << endl;
+        return vector<float>();
+    }
+    vector<uchar> codes(src.cols - 2);
+    LBPCounts counts;
+    for(int i = 1; i < src.rows - 1; i++) {
+        lbpRow(src, i, codes.data());
+        counts.add(codes.data(), (int)codes.size());
+    }
+    return counts.normalized();
+}
+
+//----------------------------------------------------------
+// Variantes uniforme / invariante a rotación y rejilla de celdas
+//----------------------------------------------------------
+int LBPConfig::binsPerCell() const {
+    switch(variant) {
+    case LBP_UNIFORM: return 59;
+    case LBP_RIU2: return 10;
+    default: return 256;
+    }
+}
+
+const char *lbpVariantName(LBPVariant variant) {
+    switch(variant) {
+    case LBP_UNIFORM: return "uniform";
+    case LBP_RIU2: return "riu2";
+    default: return "full";
+    }
+}
+
+bool parseLBPVariant(const string &name, LBPVariant &variant) {
+    if(name == "full") variant = LBP_FULL;
+    else if(name == "uniform") variant = LBP_UNIFORM;
+    else if(name == "riu2") variant = LBP_RIU2;
+    else return false;
+    return true;
+}
+
+const uchar *lbpMappingTable(LBPVariant variant) {
+    const LBPTables &t = lbpTables();
+    switch(variant) {
+    case LBP_UNIFORM: return t.uniform;
+    case LBP_RIU2: return t.riu2;
+    default: return t.full;
+    }
+}
+
+vector<float> computeLBPFeatures(const Mat &src, const LBPConfig &config) {
+    if(config.variant == LBP_FULL && config.gridX == 1 && config.gridY == 1) {
+        return computeLBPHistogramFromGray(src);
+    }
+    if(src.rows < 3 || src.cols < 3 || src.cols - 2 < config.gridX || src.rows - 2 < config.gridY) {
+        cerr << "La imagen es demasiado pequeña para calcular LBP con la rejilla indicada." << endl;
+        return vector<float>();
+    }
+
+    int width = src.cols - 2;
+    int height = src.rows - 2;
+    int bins = config.binsPerCell();
+    const uchar *table = lbpMappingTable(config.variant);
+
+    // Desplazamiento del histograma de la celda de cada columna dentro de su fila de celdas
+    vector<int> colOffset(width);
+    for(int j = 0; j < width; j++) {
+        colOffset[j] = (j * config.gridX / width) * bins;
+    }
+
+    vector<uint32_t> counts((size_t)config.featureSize(), 0);
+    vector<uchar> codes(width);
+    for(int i = 1; i < src.rows - 1; i++) {
+        lbpRow(src, i, codes.data());
+        uint32_t *cellRow = counts.data() + (size_t)((i - 1) * config.gridY / height) * config.gridX * bins;
+        for(int j = 0; j < width; j++) {
+            cellRow[colOffset[j] + table[codes[j]]]++;
+        }
+    }
+
+    // Cada celda se normaliza por su cuenta
+    vector<float> features(counts.size());
+    for(size_t cell = 0; cell < counts.size(); cell += bins) {
+        float sum = 0.0f;
+        for(int b = 0; b < bins; b++) {
+            features[cell + b] = (float)counts[cell + b];
+            sum += features[cell + b];
+        }
+        if(sum > 0.0f) {
+            for(int b = 0; b < bins; b++) {
+                features[cell + b] /= sum;
+            }
+        }
+    }
+    return features;
+}
+
+string lbpConfigPathFor(const string &modelPath) {
+    return modelPath + ".lbp.yml";
+}
+
+bool saveLBPConfig(const string &path, const LBPConfig &config) {
+    FileStorage fs(path, FileStorage::WRITE);
+    if(!fs.isOpened()) {
+        cerr << "No se pudo escribir la configuración LBP en " << path << endl;
+        return false;
+    }
+    fs << "variant" << lbpVariantName(config.variant);
+    fs << "grid_x" << config.gridX;
+    fs << "grid_y" << config.gridY;
+    fs << "roi_size" << config.roiSize;
+    fs << "feature_size" << config.featureSize();
+    return true;
+}
+
+bool loadLBPConfig(const string &path, LBPConfig &config) {
+    config = LBPConfig();
+    if(!ifstream(path).good()) return true;  // modelo antiguo: descriptor original
+
+    FileStorage fs(path, FileStorage::READ);
+    if(!fs.isOpened()) {
+        cerr << "No se pudo leer la configuración LBP de " << path << endl;
+        return false;
+    }
+    string variant;
+    fs["variant"] >> variant;
+    if(!parseLBPVariant(variant, config.variant)) {
+        cerr << "Variante LBP desconocida en " << path << ": " << variant << endl;
+        return false;
+    }
+    fs["grid_x"] >> config.gridX;
+    fs["grid_y"] >> config.gridY;
+    fs["roi_size"] >> config.roiSize;
+    if(config.gridX < 1 || config.gridY < 1 || config.roiSize < 3) {
+        cerr << "Configuración LBP no válida en " << path << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef LBP_DESCRIPTOR_HPP
+#define LBP_DESCRIPTOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------
+// Descriptor LBP (8 vecinos, radio 1) usado por el clasificador SVM
+//----------------------------------------------------------
+
+// Imagen LBP a partir de una imagen en escala de grises (sin el borde de 1 píxel)
+cv::Mat computeLBPImage(const cv::Mat &src);
+
+// Histograma LBP normalizado (256 bins)
+std::vector<float> computeLBPHistogram(const cv::Mat &lbpImg);
+
+// Equivale a computeLBPHistogram(computeLBPImage(src)) sin la imagen intermedia.
+// Los códigos se calculan con SSE2/AVX2 cuando la CPU lo permite (resultado idéntico
+// al escalar). Devuelve un vector vacío si la imagen es demasiado pequeña.
+std::vector<float> computeLBPHistogramFromGray(const cv::Mat &src);
+
+//----------------------------------------------------------
+// Variantes del descriptor. Los códigos se agrupan con una tabla de 256 entradas:
+//   LBP_FULL    -> 256 bins, un bin por código (el descriptor original)
+//   LBP_UNIFORM -> 59 bins, uno por cada patrón uniforme (≤ 2 transiciones 0/1
+//                  en el círculo) y uno compartido por todos los no uniformes
+//   LBP_RIU2    -> 10 bins, uniformes invariantes a rotación: número de vecinos
+//                  mayores que el centro (0..8) y un bin para los no uniformes
+// Con una rejilla gridX x gridY se calcula un histograma por celda, cada uno
+// normalizado por separado, y se concatenan por filas.
+//----------------------------------------------------------
+enum LBPVariant { LBP_FULL = 0, LBP_UNIFORM = 1, LBP_RIU2 = 2 };
+
+struct LBPConfig {
+    LBPVariant variant = LBP_FULL;
+    int gridX = 1;
+    int gridY = 1;
+    int roiSize = 64;   // lado de la ROI en gris antes de calcular el LBP
+
+    int binsPerCell() const;
+    int featureSize() const { return binsPerCell() * gridX * gridY; }
+};
+
+const char *lbpVariantName(LBPVariant variant);
+bool parseLBPVariant(const std::string &name, LBPVariant &variant);
+
+// Tabla código -> bin de la variante
+const uchar *lbpMappingTable(LBPVariant variant);
+
+// Vector de características según la configuración. Con LBP_FULL y una sola
+// celda es exactamente computeLBPHistogramFromGray. Vector vacío si la imagen
+// es demasiado pequeña para la rejilla.
+std::vector<float> computeLBPFeatures(const cv::Mat &src, const LBPConfig &config);
+
+// La configuración se guarda junto al modelo (<modelo>.lbp.yml). Un modelo sin
+// ese archivo usa la configuración por defecto (256 bins, sin rejilla).
+std::string lbpConfigPathFor(const std::string &modelPath);
+bool saveLBPConfig(const std::string &path, const LBPConfig &config);
+bool loadLBPConfig(const std::string &path, LBPConfig &config);
+
+#endif
@@ -0,0 +1,164 @@
+#include "RedMask.hpp"
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RED_MASK_X86 1
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// Mismos rangos que validacion.cpp (H en escala 0..180 de OpenCV)
+const Scalar RED_LOW_1(0, 70, 70), RED_HIGH_1(10, 255, 255);
+const Scalar RED_LOW_2(170, 70, 70), RED_HIGH_2(180, 255, 255);
+const int RED_MIN_VALUE = 70;   // V = max(B, G, R) >= 70
+
+// Un bit por color BGR, índice (b << 16) | (g << 8) | r
+class RedColorTable {
+public:
+    RedColorTable() : bits(1 << 21, 0) {
+        // Un plano de 256 x 256 colores (g, r) por cada valor de azul
+        Mat plane(256, 256, CV_8UC3), hsv, m1, m2;
+        for(int b = 0; b < 256; b++) {
+            for(int g = 0; g < 256; g++) {
+                Vec3b *row = plane.ptr<Vec3b>(g);
+                for(int r = 0; r < 256; r++) row[r] = Vec3b((uchar)b, (uchar)g, (uchar)r);
+            }
+            cvtColor(plane, hsv, COLOR_BGR2HSV);
+            inRange(hsv, RED_LOW_1, RED_HIGH_1, m1);
+            inRange(hsv, RED_LOW_2, RED_HIGH_2, m2);
+            for(int g = 0; g < 256; g++) {
+                const uchar *a = m1.ptr<uchar>(g);
+                const uchar *c = m2.ptr<uchar>(g);
+                for(int r = 0; r < 256; r++) {
+                    if(a[r] | c[r]) {
+                        uint32_t idx = ((uint32_t)b << 16) | ((uint32_t)g << 8) | (uint32_t)r;
+                        bits[idx >> 3] |= (uint8_t)(1 << (idx & 7));
+                    }
+                }
+            }
+        }
+    }
+
+    inline bool isRed(uchar b, uchar g, uchar r) const {
+        uint32_t idx = ((uint32_t)b << 16) | ((uint32_t)g << 8) | (uint32_t)r;
+        return (bits[idx >> 3] >> (idx & 7)) & 1;
+    }
+
+private:
+    vector<uint8_t> bits;
+};
+
+const RedColorTable &redTable() {
+    static const RedColorTable table;
+    return table;
+}
+
+// Filtro previo: condición necesaria para que el color sea rojo
+inline bool redCandidate(uchar b, uchar g, uchar r) {
+    return r >= RED_MIN_VALUE && r >= g && r >= b;
+}
+
+void redRowScalar(const uchar *bgr, uchar *out, int from, int width, int step, const RedColorTable &table) {
+    for(int x = from; x < width; x++) {
+        const uchar *p = bgr + (size_t)x * step * 3;
+        out[x] = (redCandidate(p[0], p[1], p[2]) && table.isRed(p[0], p[1], p[2])) ? 255 : 0;
+    }
+}
+
+#ifdef RED_MASK_X86
+// SSSE3: 16 píxeles (48 bytes) por iteración. Los planos B, G y R se separan con
+// tres pshufb por plano; el byte del canal c del píxel i está en la posición 3i + c.
+struct DeinterleaveMasks {
+    alignas(16) uchar m[3][3][16];   // [canal][bloque de 16 bytes][lane]
+
+    DeinterleaveMasks() {
+        for(int c = 0; c < 3; c++)
+            for(int k = 0; k < 3; k++)
+                for(int i = 0; i < 16; i++) {
+                    int pos = 3 * i + c;
+                    m[c][k][i] = (pos / 16 == k) ? (uchar)(pos % 16) : 0x80;
+                }
+    }
+};
+
+const DeinterleaveMasks deinterleave;
+
+__attribute__((target("ssse3")))
+inline __m128i channelSSSE3(__m128i a0, __m128i a1, __m128i a2, int c) {
+    const __m128i *m = (const __m128i *)deinterleave.m[c];
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, _mm_load_si128(m)),
+                                     _mm_shuffle_epi8(a1, _mm_load_si128(m + 1))),
+                        _mm_shuffle_epi8(a2, _mm_load_si128(m + 2)));
+}
+
+__attribute__((target("ssse3")))
+int redRowSSSE3(const uchar *bgr, uchar *out, int width, const RedColorTable &table) {
+    const __m128i minValue = _mm_set1_epi8((char)RED_MIN_VALUE);
+    int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        const uchar *p = bgr + (size_t)x * 3;
+        __m128i a0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i a2 = _mm_loadu_si128((const __m128i *)(p + 32));
+        __m128i b = channelSSSE3(a0, a1, a2, 0);
+        __m128i g = channelSSSE3(a0, a1, a2, 1);
+        __m128i r = channelSSSE3(a0, a1, a2, 2);
+
+        // r >= x (sin signo) <=> max(r, x) == r
+        __m128i cand = _mm_cmpeq_epi8(_mm_max_epu8(r, minValue), r);
+        cand = _mm_and_si128(cand, _mm_cmpeq_epi8(_mm_max_epu8(r, g), r));
+        cand = _mm_and_si128(cand, _mm_cmpeq_epi8(_mm_max_epu8(r, b), r));
+
+        _mm_storeu_si128((__m128i *)(out + x), _mm_setzero_si128());
+        int bits = _mm_movemask_epi8(cand);
+        while(bits) {
+            int i = __builtin_ctz(bits);
+            bits &= bits - 1;
+            const uchar *q = p + 3 * i;
+            if(table.isRed(q[0], q[1], q[2])) out[x + i] = 255;
+        }
+    }
+    return x;
+}
+#endif
+
+bool cpuHasSSSE3() {
+#ifdef RED_MASK_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+const bool useSSSE3 = cpuHasSSSE3();
+
+} // namespace
+
+void computeRedMask(const Mat &bgr, Mat &mask, int scale) {
+    CV_Assert(bgr.type() == CV_8UC3 && scale >= 1);
+    const RedColorTable &table = redTable();
+
+    int width = bgr.cols / scale;
+    int height = bgr.rows / scale;
+    mask.create(height, width, CV_8UC1);
+
+    for(int y = 0; y < height; y++) {
+        const uchar *src = bgr.ptr<uchar>(y * scale);
+        uchar *out = mask.ptr<uchar>(y);
+        int done = 0;
+#ifdef RED_MASK_X86
+        if(scale == 1 && useSSSE3) done = redRowSSSE3(src, out, width, table);
+#endif
+        redRowScalar(src, out, done, width, scale, table);
+    }
+}
+
+void initRedMask() {
+    redTable();
+}
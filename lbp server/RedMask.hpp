@@ -0,0 +1,28 @@
+#ifndef RED_MASK_HPP
+#define RED_MASK_HPP
+
+#include <opencv2/opencv.hpp>
+
+//----------------------------------------------------------
+// Máscara del rojo en una sola pasada sobre el frame BGR. Equivale a
+//
+//   cvtColor(frame, hsv, COLOR_BGR2HSV);
+//   inRange(hsv, (0, 70, 70), (10, 255, 255), m1);
+//   inRange(hsv, (170, 70, 70), (180, 255, 255), m2);
+//   mask = m1 | m2;
+//
+// sin ninguna imagen intermedia. La decisión para cada uno de los 2^24 colores
+// se precalcula una vez con el propio cvtColor + inRange (tabla de 2 MB, un bit
+// por color), así que el resultado es idéntico. Un color solo puede caer en esos
+// rangos si R es el canal máximo y R >= 70; ese filtro se evalúa con SSSE3 sobre
+// 16 píxeles a la vez y la tabla solo se consulta para los píxeles que lo pasan.
+//
+// Con scale > 1 la máscara se calcula sobre uno de cada scale x scale píxeles
+// (tamaño cols / scale x rows / scale) sin redimensionar el frame.
+//----------------------------------------------------------
+void computeRedMask(const cv::Mat &bgr, cv::Mat &mask, int scale = 1);
+
+// Construye la tabla de colores por adelantado (si no, se construye en el primer frame)
+void initRedMask();
+
+#endif
@@ -0,0 +1,229 @@
+#include "SVMBatch.hpp"
+#include <cmath>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SVM_X86 1
+#endif
+
+using namespace std;
+using namespace cv;
+using namespace cv::ml;
+
+//----------------------------------------------------------
+// Kernels sobre una fila de longitud n (múltiplo de 8, con relleno de ceros).
+// Como en cv::ml, cada diferencia/producto se calcula en float y se acumula
+// en double; solo cambia el orden de la suma.
+//----------------------------------------------------------
+namespace {
+
+double squaredDistanceScalar(const float *a, const float *b, int n) {
+    double s = 0;
+    for(int k = 0; k < n; k++) {
+        double t = a[k] - b[k];
+        s += t * t;
+    }
+    return s;
+}
+
+double dotScalar(const float *a, const float *b, int n) {
+    double s = 0;
+    for(int k = 0; k < n; k++) {
+        s += a[k] * b[k];
+    }
+    return s;
+}
+
+#ifdef SVM_X86
+__attribute__((target("avx2,fma")))
+inline double horizontalSum(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// 8 floats por iteración: diferencia en float, cuadrado y suma en double
+__attribute__((target("avx2,fma")))
+double squaredDistanceAVX2(const float *a, const float *b, int n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for(int k = 0; k < n; k += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k));
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+        __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+        acc0 = _mm256_fmadd_pd(lo, lo, acc0);
+        acc1 = _mm256_fmadd_pd(hi, hi, acc1);
+    }
+    return horizontalSum(_mm256_add_pd(acc0, acc1));
+}
+
+__attribute__((target("avx2,fma")))
+double dotAVX2(const float *a, const float *b, int n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for(int k = 0; k < n; k += 8) {
+        __m256 p = _mm256_mul_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k));
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+    }
+    return horizontalSum(_mm256_add_pd(acc0, acc1));
+}
+#endif
+
+typedef double (*RowKernel)(const float *, const float *, int);
+
+bool cpuHasAVX2() {
+#ifdef SVM_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+
+const bool useAVX2 = cpuHasAVX2();
+
+RowKernel squaredDistance() {
+#ifdef SVM_X86
+    if(useAVX2) return squaredDistanceAVX2;
+#endif
+    return squaredDistanceScalar;
+}
+
+RowKernel dot() {
+#ifdef SVM_X86
+    if(useAVX2) return dotAVX2;
+#endif
+    return dotScalar;
+}
+
+// Candidatos por bloque: sus filas (1 KB cada una con 256 características)
+// quedan en caché mientras se recorren todos los vectores de soporte
+const int BLOCK_ROWS = 16;
+
+} // namespace
+
+bool SVMBatch::compile(const Ptr<SVM> &svm, const string &modelPath) {
+    supportVectors.release();
+    decisionFunctions.clear();
+    classLabels.clear();
+
+    if(svm.empty() || (svm->getType() != SVM::C_SVC && svm->getType() != SVM::NU_SVC)) {
+        cerr << "SVMBatch: solo se admiten modelos de clasificación C_SVC / NU_SVC." << endl;
+        return false;
+    }
+    kernelType = svm->getKernelType();
+    if(kernelType != SVM::RBF && kernelType != SVM::LINEAR) {
+        cerr << "SVMBatch: kernel no soportado, se usará SVM::predict." << endl;
+        return false;
+    }
+    gamma = svm->getGamma();
+    vars = svm->getVarCount();
+
+    // class_labels no tiene getter en cv::ml: se lee del propio archivo del modelo
+    FileStorage fs(modelPath, FileStorage::READ);
+    if(!fs.isOpened()) {
+        cerr << "SVMBatch: no se pudo leer " << modelPath << endl;
+        return false;
+    }
+    Mat labels;
+    fs["opencv_ml_svm"]["class_labels"] >> labels;
+    if(labels.empty()) {
+        cerr << "SVMBatch: el modelo no tiene class_labels." << endl;
+        return false;
+    }
+    labels.convertTo(labels, CV_32S);
+    classLabels.assign(labels.ptr<int>(), labels.ptr<int>() + labels.total());
+
+    // Con kernel lineal OpenCV guarda un vector comprimido por función de decisión;
+    // getSupportVectors devuelve el conjunto que indexan las funciones de decisión
+    Mat sv = svm->getSupportVectors();
+    if(sv.type() != CV_32F || sv.cols != vars) {
+        cerr << "SVMBatch: vectores de soporte con formato inesperado." << endl;
+        return false;
+    }
+
+    stride = (vars + 7) & ~7;
+    Mat padded = Mat::zeros(sv.rows, stride, CV_32F);
+    sv.copyTo(padded.colRange(0, vars));
+
+    int classCount = (int)classLabels.size();
+    int dfCount = classCount * (classCount - 1) / 2;
+    for(int i = 0; i < dfCount; i++) {
+        Mat alpha, svIndex;
+        DecisionFunction df;
+        df.rho = svm->getDecisionFunction(i, alpha, svIndex);
+        alpha.convertTo(alpha, CV_64F);
+        df.alpha.assign(alpha.ptr<double>(), alpha.ptr<double>() + alpha.total());
+        df.svIndex.assign(svIndex.ptr<int>(), svIndex.ptr<int>() + svIndex.total());
+        decisionFunctions.push_back(df);
+    }
+
+    supportVectors = padded;
+    return true;
+}
+
+void SVMBatch::predict(const Mat &samples, vector<int> &labels, Mat *decisionValues) const {
+    CV_Assert(compiled() && samples.type() == CV_32F && samples.cols == vars);
+
+    int n = samples.rows;
+    int svCount = supportVectors.rows;
+    labels.assign(n, 0);
+    if(decisionValues) decisionValues->create(n, (int)decisionFunctions.size(), CV_64F);
+    if(n == 0) return;
+
+    // Buffers por hilo reutilizados entre frames: solo se reservan cuando crece el
+    // número de candidatos (o cambia el modelo); el SVMBatch se comparte entre hilos
+    thread_local Mat batchBuffer, K;
+    thread_local vector<int> votes;
+
+    // Copia de los candidatos con el mismo relleno (en cero) que los vectores de soporte
+    if(batchBuffer.rows < n || batchBuffer.cols != stride) batchBuffer.create(max(n, BLOCK_ROWS), stride, CV_32F);
+    Mat batch = batchBuffer.rowRange(0, n);
+    samples.copyTo(batch.colRange(0, vars));
+    if(stride > vars) batch.colRange(vars, stride).setTo(0);
+
+    RowKernel kernel = kernelType == SVM::RBF ? squaredDistance() : dot();
+    double scale = kernelType == SVM::RBF ? -gamma : 1.0;
+
+    // Kernels de un bloque de candidatos contra todos los vectores de soporte
+    K.create(BLOCK_ROWS, svCount, CV_32F);
+    votes.resize(classLabels.size());
+
+    for(int first = 0; first < n; first += BLOCK_ROWS) {
+        int rows = min(BLOCK_ROWS, n - first);
+        for(int m = 0; m < svCount; m++) {
+            const float *sv = supportVectors.ptr<float>(m);
+            for(int r = 0; r < rows; r++) {
+                K.at<float>(r, m) = (float)(kernel(sv, batch.ptr<float>(first + r), stride) * scale);
+            }
+        }
+        if(kernelType == SVM::RBF) {
+            Mat block = K.rowRange(0, rows);
+            exp(block, block);
+        }
+
+        // Uno contra uno: la función (i, j) vota por i si su valor es positivo
+        for(int r = 0; r < rows; r++) {
+            const float *k = K.ptr<float>(r);
+            fill(votes.begin(), votes.end(), 0);
+            int dfi = 0;
+            for(int i = 0; i < (int)classLabels.size(); i++) {
+                for(int j = i + 1; j < (int)classLabels.size(); j++, dfi++) {
+                    const DecisionFunction &df = decisionFunctions[dfi];
+                    double sum = -df.rho;
+                    for(size_t a = 0; a < df.alpha.size(); a++) {
+                        sum += df.alpha[a] * k[df.svIndex[a]];
+                    }
+                    votes[sum > 0 ? i : j]++;
+                    if(decisionValues) decisionValues->at<double>(first + r, dfi) = sum;
+                }
+            }
+            int best = 0;
+            for(int i = 1; i < (int)votes.size(); i++) {
+                if(votes[i] > votes[best]) best = i;
+            }
+            labels[first + r] = classLabels[best];
+        }
+    }
+}
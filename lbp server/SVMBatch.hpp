@@ -0,0 +1,51 @@
+#ifndef SVM_BATCH_HPP
+#define SVM_BATCH_HPP
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/ml.hpp>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------
+// Evaluador por lotes de un SVM de clasificación (C_SVC / NU_SVC) entrenado con
+// cv::ml. Los vectores de soporte se copian una sola vez a una matriz contigua
+// alineada (con las filas rellenadas a múltiplo de 8) y todos los candidatos de
+// un frame se evalúan juntos: primero la matriz de kernels candidato x vector de
+// soporte (distancias con AVX2 + FMA si la CPU lo permite) y después las
+// funciones de decisión uno contra uno con votación, igual que SVM::predict.
+//
+// Kernels soportados: RBF y LINEAR. Con otros kernels compile() devuelve false
+// y hay que seguir usando SVM::predict.
+//----------------------------------------------------------
+class SVMBatch {
+public:
+    // Prepara el evaluador a partir del modelo cargado. modelPath se usa para leer
+    // class_labels, que cv::ml no expone.
+    bool compile(const cv::Ptr<cv::ml::SVM> &svm, const std::string &modelPath);
+    bool compiled() const { return !supportVectors.empty(); }
+
+    // samples: N x varCount (CV_32F), una fila por candidato.
+    // labels: etiqueta predicha de cada fila.
+    // decisionValues (opcional): N x número de funciones de decisión (CV_64F), el valor
+    // de cada par de clases (i, j) en el mismo orden que usa OpenCV; > 0 vota por i.
+    void predict(const cv::Mat &samples, std::vector<int> &labels, cv::Mat *decisionValues = nullptr) const;
+
+    int varCount() const { return vars; }
+
+private:
+    struct DecisionFunction {
+        double rho;
+        std::vector<double> alpha;
+        std::vector<int> svIndex;
+    };
+
+    int kernelType = 0;
+    double gamma = 0;
+    int vars = 0;
+    int stride = 0;                 // columnas por fila con relleno
+    cv::Mat supportVectors;         // svCount x stride, CV_32F, relleno con ceros
+    std::vector<DecisionFunction> decisionFunctions;
+    std::vector<int> classLabels;
+};
+
+#endif
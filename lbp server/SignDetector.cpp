@@ -0,0 +1,155 @@
+#include "SignDetector.hpp"
+#include "LBPDescriptor.hpp"
+#include "RedMask.hpp"
+#include "../Metrics.hpp"
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+using namespace cv::ml;
+
+static double msSince(int64 start) {
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+bool loadSignClassifier(const string &modelPath, SignClassifier &classifier) {
+    classifier.svm = SVM::load(modelPath);
+    if(classifier.svm.empty()) {
+        cerr << "No se pudo cargar el clasificador SVM desde '" << modelPath << "'." << endl;
+        return false;
+    }
+    if(!loadLBPConfig(lbpConfigPathFor(modelPath), classifier.lbp)) return false;
+
+    if(classifier.svm->getVarCount() != classifier.lbp.featureSize()) {
+        cerr << "El modelo espera " << classifier.svm->getVarCount() << " características y la configuración LBP ("
+             << lbpVariantName(classifier.lbp.variant) << ", " << classifier.lbp.gridX << "x" << classifier.lbp.gridY
+             << ") produce " << classifier.lbp.featureSize() << "." << endl;
+        return false;
+    }
+
+    // Evaluador por lotes; si el kernel no está soportado se sigue usando SVM::predict
+    classifier.batch.compile(classifier.svm, modelPath);
+    initRedMask();
+    return true;
+}
+
+vector<Rect> findSignCandidates(const Mat &frame, SignTiming *timing, int maskScale) {
+    int64 t = getTickCount();
+
+    // ---------------------------------------------------
+    // 1. Segmentar el color rojo directamente desde BGR
+    //    (mismo resultado que HSV + los dos inRange, ver RedMask.hpp)
+    // ---------------------------------------------------
+    thread_local Mat maskRed;
+    computeRedMask(frame, maskRed, maskScale);
+
+    // Operaciones morfológicas para limpiar ruido (el elemento se reduce con la máscara)
+    int kernelSize = maskScale == 1 ? 5 : 3;
+    Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(kernelSize, kernelSize));
+    morphologyEx(maskRed, maskRed, MORPH_CLOSE, kernel);
+    morphologyEx(maskRed, maskRed, MORPH_OPEN, kernel);
+
+    // ---------------------------------------------------
+    // 2. Encontrar contornos en la máscara
+    // ---------------------------------------------------
+    vector<vector<Point>> contours;
+    findContours(maskRed, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+
+    vector<Rect> candidates;
+    for(const auto &contour : contours) {
+        // Rectángulo en la resolución del frame
+        Rect r = boundingRect(contour);
+        Rect candidateRect = Rect(r.x * maskScale, r.y * maskScale, r.width * maskScale, r.height * maskScale) &
+                             Rect(0, 0, frame.cols, frame.rows);
+        // Filtrar contornos muy pequeños
+        if(candidateRect.area() < 300) continue;
+        candidates.push_back(candidateRect);
+    }
+    double ms = msSince(t);
+    if(timing) timing->segmentationMs += ms;
+    recordStage(METRIC_SEGMENTATION, ms);
+    addCounter(COUNTER_CANDIDATES, candidates.size());
+    return candidates;
+}
+
+vector<int> classifySignCandidates(const Mat &frame, const vector<Rect> &candidates,
+                                   const SignClassifier &classifier, SignTiming *timing) {
+    const LBPConfig &config = classifier.lbp;
+
+    // Una fila de características por candidato
+    Mat features(0, config.featureSize(), CV_32F);
+    vector<int> rowOf(candidates.size(), -1);
+
+    int64 t = getTickCount();
+    for(size_t i = 0; i < candidates.size(); i++) {
+        // Extraer la ROI en escala de grises
+        Mat roiGray;
+        cvtColor(frame(candidates[i]), roiGray, COLOR_BGR2GRAY);
+        // Redimensionar al tamaño de entrenamiento (64x64 por defecto)
+        Mat resized;
+        resize(roiGray, resized, Size(config.roiSize, config.roiSize));
+
+        // Calcular el descriptor LBP (histograma global o por celdas)
+        vector<float> hist = computeLBPFeatures(resized, config);
+        if(hist.empty()) continue;
+
+        rowOf[i] = features.rows;
+        features.push_back(Mat(1, (int)hist.size(), CV_32F, hist.data()));
+    }
+    double ms = msSince(t);
+    if(timing) timing->featuresMs += ms;
+    recordStage(METRIC_LBP, ms);
+
+    // ---------------------------------------------------
+    // 3. Clasificar todos los candidatos de una vez
+    //    (0 -> no señal, 1 -> 30 km/h, 2 -> 50 km/h)
+    // ---------------------------------------------------
+    t = getTickCount();
+    vector<int> responses;
+    if(classifier.batch.compiled()) {
+        classifier.batch.predict(features, responses);
+    } else {
+        for(int i = 0; i < features.rows; i++) {
+            responses.push_back((int)classifier.svm->predict(features.row(i)));
+        }
+    }
+    ms = msSince(t);
+    if(timing) timing->classifyMs += ms;
+    recordStage(METRIC_CLASSIFY, ms);
+
+    vector<int> labels(candidates.size(), 0);
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(rowOf[i] >= 0) labels[i] = responses[rowOf[i]];
+    }
+    return labels;
+}
+
+vector<Detection> detectSigns(const Mat &frame, const SignClassifier &classifier, SignTiming *timing,
+                              int maskScale) {
+    vector<Rect> candidates = findSignCandidates(frame, timing, maskScale);
+    vector<int> responses = classifySignCandidates(frame, candidates, classifier, timing);
+
+    // Vector para almacenar detecciones
+    vector<Detection> detections;
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(responses[i] == 1 || responses[i] == 2) {
+            // Guardar la detección
+            Detection det;
+            det.box = candidates[i];
+            det.label = responses[i];
+            detections.push_back(det);
+        }
+    }
+    addCounter(COUNTER_DETECTIONS, detections.size());
+
+    return detections;
+}
+
+void drawSigns(Mat &frame, const vector<Detection> &detections) {
+    for(const auto &d : detections) {
+        string text = (d.label == 1) ? "Speed Limit 30 km/h" : "Speed Limit 50 km/h";
+        rectangle(frame, d.box, Scalar(0, 255, 0), 2);
+        putText(frame, text, Point(d.box.x, d.box.y - 10),
+                FONT_HERSHEY_SIMPLEX, 0.9, Scalar(0, 255, 0), 2);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SIGN_DETECTOR_HPP
+#define SIGN_DETECTOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/ml.hpp>
+#include <string>
+#include <vector>
+#include "LBPDescriptor.hpp"
+#include "SVMBatch.hpp"
+
+//----------------------------------------------------------
+// Detector de señales de validacion.cpp: segmentación del rojo (rangos HSV),
+// contornos como candidatos y clasificación LBP + SVM de cada candidato
+//----------------------------------------------------------
+
+// Estructura para almacenar una detección: rectángulo + clase
+struct Detection {
+    cv::Rect box;
+    int label; // 1: 30 km/h, 2: 50 km/h
+};
+
+// Tiempo de cada etapa (ms), acumulado sobre todos los candidatos del frame
+struct SignTiming {
+    double segmentationMs = 0;  // máscara del rojo + morfología + contornos
+    double featuresMs = 0;      // ROI en gris + LBP + histograma
+    double classifyMs = 0;      // predicción del SVM (todos los candidatos en un lote)
+};
+
+// SVM + configuración del LBP con la que se entrenó
+struct SignClassifier {
+    cv::Ptr<cv::ml::SVM> svm;
+    SVMBatch batch;     // mismo modelo, evaluado por lotes
+    LBPConfig lbp;
+};
+
+// Carga el modelo y su <modelo>.lbp.yml; falla si el tamaño del vector no coincide.
+// También prepara el evaluador por lotes.
+bool loadSignClassifier(const std::string &modelPath, SignClassifier &classifier);
+
+// Etapa 1: rectángulos candidatos (contornos rojos de al menos 300 px) en la
+// resolución del frame
+std::vector<cv::Rect> findSignCandidates(const cv::Mat &frame, SignTiming *timing = nullptr, int maskScale = 1);
+
+// Etapa 2: clase de cada candidato con LBP + SVM en un solo lote (0 = no señal)
+std::vector<int> classifySignCandidates(const cv::Mat &frame, const std::vector<cv::Rect> &candidates,
+                                        const SignClassifier &classifier, SignTiming *timing = nullptr);
+
+// Detecta las señales del frame (BGR). Si timing no es nulo se rellenan los tiempos.
+// Con maskScale > 1 la segmentación se hace a 1/maskScale de resolución y los
+// candidatos se llevan de vuelta a la resolución completa antes del LBP.
+std::vector<Detection> detectSigns(const cv::Mat &frame, const SignClassifier &classifier,
+                                   SignTiming *timing = nullptr, int maskScale = 1);
+
+// Dibuja los rectángulos y el texto de cada detección
+void drawSigns(cv::Mat &frame, const std::vector<Detection> &detections);
+
+#endif
@@ -0,0 +1,136 @@
+#include "SignTracker.hpp"
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+const int THUMB_SIZE = 16;
+
+double iou(const Rect &a, const Rect &b) {
+    double inter = (a & b).area();
+    if(inter <= 0) return 0;
+    return inter / (a.area() + b.area() - inter);
+}
+
+// Miniatura en gris: se reduce primero la ROI en color para no convertir la ROI completa
+Mat thumbnailOf(const Mat &frame, const Rect &box) {
+    Mat small, gray;
+    resize(frame(box), small, Size(THUMB_SIZE, THUMB_SIZE), 0, 0, INTER_AREA);
+    cvtColor(small, gray, COLOR_BGR2GRAY);
+    return gray;
+}
+
+double appearanceChange(const Mat &a, const Mat &b) {
+    return norm(a, b, NORM_L1) / (THUMB_SIZE * THUMB_SIZE);
+}
+
+} // namespace
+
+void SignTracker::addVote(Track &track, int response) const {
+    for(float &v : track.votes) v *= (float)params.voteDecay;
+    if(response >= 0 && response < 3) track.votes[response] += 1;
+
+    // La etiqueta solo cambia si otra clase supera a la actual
+    int best = track.label;
+    for(int c = 0; c < 3; c++) {
+        if(track.votes[c] > track.votes[best]) best = c;
+    }
+    track.label = best;
+    track.framesSinceClassified = 0;
+}
+
+vector<Detection> SignTracker::update(const Mat &frame, const SignClassifier &classifier,
+                                      SignTiming *timing, int maskScale) {
+    vector<Rect> candidates = findSignCandidates(frame, timing, maskScale);
+    seen += (long)candidates.size();
+
+    // ---------------------------------------------------
+    // 1. Asociación voraz por IoU: primero los pares con más solape
+    // ---------------------------------------------------
+    struct Pair { double iou; int track, candidate; };
+    vector<Pair> pairs;
+    for(int t = 0; t < (int)tracks.size(); t++) {
+        for(int c = 0; c < (int)candidates.size(); c++) {
+            double v = iou(tracks[t].box, candidates[c]);
+            if(v >= params.minIoU) pairs.push_back({v, t, c});
+        }
+    }
+    sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) { return a.iou > b.iou; });
+
+    vector<int> trackOf(candidates.size(), -1);
+    vector<bool> trackMatched(tracks.size(), false);
+    for(const Pair &p : pairs) {
+        if(trackMatched[p.track] || trackOf[p.candidate] >= 0) continue;
+        trackMatched[p.track] = true;
+        trackOf[p.candidate] = p.track;
+    }
+
+    // Pistas sin candidato en este frame: se conservan unos frames por si vuelven
+    for(size_t t = 0; t < tracks.size(); t++) {
+        if(!trackMatched[t]) tracks[t].missed++;
+    }
+
+    // ---------------------------------------------------
+    // 2. Decidir qué candidatos pasan por el clasificador
+    // ---------------------------------------------------
+    vector<Rect> toClassify;
+    vector<Mat> thumbnails;
+    vector<int> owners;     // pista de cada candidato a clasificar
+    for(int c = 0; c < (int)candidates.size(); c++) {
+        Mat thumb = thumbnailOf(frame, candidates[c]);
+        int t = trackOf[c];
+        if(t < 0) {
+            Track track;
+            track.id = nextId++;
+            tracks.push_back(track);
+            t = (int)tracks.size() - 1;
+        } else {
+            Track &track = tracks[t];
+            track.missed = 0;
+            track.framesSinceClassified++;
+            bool stale = track.framesSinceClassified >= params.reclassifyEvery;
+            bool changed = appearanceChange(track.thumbnail, thumb) > params.appearanceThreshold;
+            if(!stale && !changed) {
+                track.box = candidates[c];
+                continue;
+            }
+        }
+        tracks[t].box = candidates[c];
+        toClassify.push_back(candidates[c]);
+        thumbnails.push_back(thumb);
+        owners.push_back(t);
+    }
+
+    // ---------------------------------------------------
+    // 3. Un solo lote para todas las pistas que lo necesitan
+    // ---------------------------------------------------
+    if(!toClassify.empty()) {
+        vector<int> responses = classifySignCandidates(frame, toClassify, classifier, timing);
+        classified += (long)toClassify.size();
+        for(size_t i = 0; i < owners.size(); i++) {
+            Track &track = tracks[owners[i]];
+            addVote(track, responses[i]);
+            track.thumbnail = thumbnails[i];
+        }
+    }
+
+    // ---------------------------------------------------
+    // 4. Salida: pistas presentes en este frame con etiqueta de señal
+    // ---------------------------------------------------
+    vector<Detection> detections;
+    for(const Track &track : tracks) {
+        if(track.missed == 0 && (track.label == 1 || track.label == 2)) {
+            Detection det;
+            det.box = track.box;
+            det.label = track.label;
+            detections.push_back(det);
+        }
+    }
+
+    tracks.erase(remove_if(tracks.begin(), tracks.end(),
+                           [&](const Track &t) { return t.missed > params.maxMissed; }),
+                 tracks.end());
+    return detections;
+}
@@ -0,0 +1,60 @@
+#ifndef SIGN_TRACKER_HPP
+#define SIGN_TRACKER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "SignDetector.hpp"
+
+//----------------------------------------------------------
+// Seguimiento de candidatos entre frames para no reclasificar señales estables.
+// Cada frame se segmenta igual que en detectSigns, pero los candidatos se asocian
+// a las pistas del frame anterior por IoU (asignación voraz). Una pista solo se
+// vuelve a pasar por LBP + SVM cuando es nueva, cuando han pasado
+// reclassifyEvery frames o cuando su apariencia (miniatura 16x16 en gris) cambia
+// respecto a la última clasificación. La etiqueta mostrada sale de los votos
+// acumulados (con decaimiento), así que no salta entre 30 y 50 por un frame.
+//
+// No es seguro entre hilos: una instancia por hilo de detección.
+//----------------------------------------------------------
+
+struct TrackerParams {
+    double minIoU = 0.3;              // IoU mínimo para asociar un candidato a una pista
+    int reclassifyEvery = 10;         // frames entre clasificaciones de una pista estable
+    double appearanceThreshold = 12;  // diferencia media (0..255) de la miniatura que fuerza reclasificar
+    double voteDecay = 0.7;           // factor de los votos anteriores en cada clasificación
+    int maxMissed = 5;                // frames sin candidato antes de borrar la pista
+};
+
+class SignTracker {
+public:
+    explicit SignTracker(const TrackerParams &params = TrackerParams()) : params(params) {}
+
+    // Procesa un frame (BGR) y devuelve las pistas vistas en él con etiqueta 1 o 2
+    std::vector<Detection> update(const cv::Mat &frame, const SignClassifier &classifier,
+                                  SignTiming *timing = nullptr, int maskScale = 1);
+
+    // Contadores acumulados: candidatos vistos y cuántos pasaron por el SVM
+    long candidatesSeen() const { return seen; }
+    long candidatesClassified() const { return classified; }
+
+private:
+    struct Track {
+        int id;
+        cv::Rect box;
+        float votes[3] = {0, 0, 0};   // 0: no señal, 1: 30 km/h, 2: 50 km/h
+        int label = 0;
+        int framesSinceClassified = 0;
+        int missed = 0;
+        cv::Mat thumbnail;            // apariencia en la última clasificación
+    };
+
+    void addVote(Track &track, int response) const;
+
+    TrackerParams params;
+    std::vector<Track> tracks;
+    int nextId = 0;
+    long seen = 0;
+    long classified = 0;
+};
+
+#endif
@@ -2,6 +2,11 @@ from flask import Flask, request, jsonify, send_file, Response
 import cv2
 import numpy as np
 import os
+import sys
+
+# Cliente del demonio de detección (en la carpeta del proyecto)
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+import detection_client
 
 app = Flask(__name__)
 
@@ -45,6 +50,23 @@ def detect():
         return jsonify({'error': 'No image provided'}), 400
 
     image_file = request.files['image']
+
+    # Con el demonio de detección corriendo la imagen se procesa en memoria con el detector LBP de C++
+    if detection_client.disponible():
+        try:
+            resultado, anotada = detection_client.detectar([image_file.read()], detection_client.PIPELINE_LBP,
+                                                           anotar=True)[0]
+        except OSError:
+            # Socket huérfano de un demonio caído, o demonio sin el modelo (NoDisponible): camino de disco
+            image_file.stream.seek(0)
+        else:
+            if not resultado.get('ok'):
+                return jsonify({'error': resultado.get('error', 'Invalid image format')}), 400
+            response = Response(anotada, mimetype="image/jpeg")
+            response.headers["Content-Disposition"] = "attachment; filename=processed.jpg"
+            response.headers["Cache-Control"] = "no-store, no-cache, must-revalidate, max-age=0"
+            return response
+
     temp_path = "temp.jpg"
     image_file.save(temp_path)
 
@@ -0,0 +1,334 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/ml.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "LBPDescriptor.hpp"
+#include "../Parallel.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ml;
+
+//----------------------------------------------------------
+// Entrenamiento del SVM de validacion.cpp con cualquier variante de LBP.
+//
+//   positives.txt: <imagen> <n> [<x> <y> <w> <h> <clase>] x n   (clase 1: 30 km/h, 2: 50 km/h)
+//   negatives.txt: <imagen>                                      (clase 0, imagen completa)
+//
+// Las características se extraen en paralelo (una tarea por imagen) y se
+// guardan en una caché binaria; mientras las listas y la configuración del LBP
+// no cambien, los siguientes entrenamientos (p. ej. barridos de C y gamma) no
+// vuelven a decodificar ninguna imagen. Con --auto se buscan C y gamma con
+// validación cruzada (SVM::trainAuto, que reparte la rejilla entre los núcleos).
+//
+// Guarda el modelo y, a su lado, <modelo>.lbp.yml con la configuración del
+// descriptor para que validacion.cpp calcule el mismo vector al predecir.
+//----------------------------------------------------------
+
+struct Sample {
+    string imagePath;
+    Rect box;      // vacío = imagen completa
+    int label;
+};
+
+//----------------------------------------------------------
+// Lectura de las listas de muestras
+//----------------------------------------------------------
+bool readPositives(const string &path, vector<Sample> &samples) {
+    ifstream in(path);
+    if(!in.is_open()) {
+        cerr << "No se pudo abrir " << path << endl;
+        return false;
+    }
+    string line;
+    while(getline(in, line)) {
+        istringstream ss(line);
+        string imagePath;
+        int count = 0;
+        if(!(ss >> imagePath >> count)) continue;
+        for(int k = 0; k < count; k++) {
+            Sample s;
+            s.imagePath = imagePath;
+            if(!(ss >> s.box.x >> s.box.y >> s.box.width >> s.box.height >> s.label)) break;
+            samples.push_back(s);
+        }
+    }
+    return true;
+}
+
+bool readNegatives(const string &path, vector<Sample> &samples) {
+    ifstream in(path);
+    if(!in.is_open()) {
+        cerr << "No se pudo abrir " << path << endl;
+        return false;
+    }
+    string line;
+    while(getline(in, line)) {
+        istringstream ss(line);
+        string imagePath;
+        if(ss >> imagePath) samples.push_back({imagePath, Rect(), 0});
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// Descriptor de una muestra: mismo preprocesado que validacion.cpp
+//----------------------------------------------------------
+bool sampleFeatures(const Sample &s, const Mat &img, const LBPConfig &config, vector<float> &features) {
+    Rect box = s.box.area() > 0 ? (s.box & Rect(0, 0, img.cols, img.rows)) : Rect(0, 0, img.cols, img.rows);
+    if(box.area() == 0) return false;
+
+    Mat roiGray;
+    cvtColor(img(box), roiGray, COLOR_BGR2GRAY);
+    Mat resized;
+    resize(roiGray, resized, Size(config.roiSize, config.roiSize));
+
+    features = computeLBPFeatures(resized, config);
+    return !features.empty();
+}
+
+//----------------------------------------------------------
+// Caché de características
+//   cabecera | etiquetas (int32 x filas) | características (float x filas x featureSize)
+// La clave es el contenido de las dos listas más la configuración del LBP.
+//----------------------------------------------------------
+#pragma pack(push, 1)
+struct FeatureCacheHeader {
+    char magic[4];          // "LBPF"
+    uint32_t version;
+    uint64_t listsHash;
+    int32_t variant;
+    int32_t gridX;
+    int32_t gridY;
+    int32_t roiSize;
+    int32_t featureSize;
+    int32_t rows;
+};
+#pragma pack(pop)
+
+static const uint32_t FEATURE_CACHE_VERSION = 1;
+
+// FNV-1a de 64 bits sobre el contenido de un archivo, encadenado con "hash"
+uint64_t hashFileContents(const string &path, uint64_t hash) {
+    ifstream in(path, ios::binary);
+    char buffer[1 << 16];
+    while(in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        for(streamsize i = 0; i < in.gcount(); i++) {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+bool loadFeatureCache(const string &path, uint64_t listsHash, const LBPConfig &config, Mat &data, vector<int> &labels) {
+    ifstream in(path, ios::binary);
+    if(!in.is_open()) return false;
+
+    FeatureCacheHeader h;
+    if(!in.read((char *)&h, sizeof(h)) || string(h.magic, 4) != "LBPF" || h.version != FEATURE_CACHE_VERSION) {
+        return false;
+    }
+    if(h.listsHash != listsHash || h.variant != config.variant || h.gridX != config.gridX ||
+       h.gridY != config.gridY || h.roiSize != config.roiSize || h.featureSize != config.featureSize()) {
+        cout << "La caché " << path << " corresponde a otras listas o a otra configuración, se regenera." << endl;
+        return false;
+    }
+
+    labels.resize(h.rows);
+    data.create(h.rows, h.featureSize, CV_32F);
+    if(!in.read((char *)labels.data(), sizeof(int32_t) * h.rows) ||
+       !in.read((char *)data.ptr<float>(), sizeof(float) * (size_t)h.rows * h.featureSize)) {
+        cerr << "La caché " << path << " está incompleta, se regenera." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Se escribe en un temporal y se renombra, así una caché a medio escribir nunca se lee
+bool saveFeatureCache(const string &path, uint64_t listsHash, const LBPConfig &config, const Mat &data, const vector<int> &labels) {
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary);
+        if(!out.is_open()) {
+            cerr << "No se pudo escribir la caché " << tmp << endl;
+            return false;
+        }
+        FeatureCacheHeader h = {{'L', 'B', 'P', 'F'}, FEATURE_CACHE_VERSION, listsHash, config.variant,
+                                config.gridX, config.gridY, config.roiSize, config.featureSize(), data.rows};
+        out.write((const char *)&h, sizeof(h));
+        out.write((const char *)labels.data(), sizeof(int32_t) * labels.size());
+        for(int r = 0; r < data.rows; r++) {
+            out.write((const char *)data.ptr<float>(r), sizeof(float) * data.cols);
+        }
+        if(!out.good()) {
+            cerr << "Error al escribir la caché " << tmp << endl;
+            return false;
+        }
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+//----------------------------------------------------------
+// Extracción en paralelo: una tarea por imagen (sus ROIs van seguidas en la lista),
+// cada imagen se decodifica una sola vez y el resultado se ensambla en el orden de la lista
+//----------------------------------------------------------
+void extractFeatures(const vector<Sample> &samples, const LBPConfig &config, unsigned jobs,
+                     Mat &data, vector<int> &labels) {
+    vector<size_t> groupStart;
+    for(size_t i = 0; i < samples.size(); i++) {
+        if(i == 0 || samples[i].imagePath != samples[i - 1].imagePath) groupStart.push_back(i);
+    }
+    groupStart.push_back(samples.size());
+    size_t groups = groupStart.size() - 1;
+
+    vector<vector<float>> features(samples.size());
+    vector<char> valid(samples.size(), 0);
+
+    // Los hilos del pool ya ocupan todos los núcleos, se evita el paralelismo interno de OpenCV
+    int cvThreads = getNumThreads();
+    if(jobs > 1) setNumThreads(1);
+    parallelFor(groups, jobs, [&](size_t g) {
+        Mat img = imread(samples[groupStart[g]].imagePath, IMREAD_COLOR);
+        if(img.empty()) return;
+        for(size_t i = groupStart[g]; i < groupStart[g + 1]; i++) {
+            valid[i] = sampleFeatures(samples[i], img, config, features[i]);
+        }
+    });
+    setNumThreads(cvThreads);
+
+    size_t skipped = 0;
+    data.create(0, config.featureSize(), CV_32F);
+    labels.clear();
+    for(size_t i = 0; i < samples.size(); i++) {
+        if(!valid[i]) {
+            skipped++;
+            continue;
+        }
+        data.push_back(Mat(1, (int)features[i].size(), CV_32F, features[i].data()));
+        labels.push_back(samples[i].label);
+    }
+    if(skipped > 0) {
+        cerr << "Se omitieron " << skipped << " muestras (imagen no encontrada o ROI vacía)." << endl;
+    }
+}
+
+//----------------------------------------------------------
+// MAIN
+//   ./entrenar [--variant full|uniform|riu2] [--grid GXxGY] [--roi 64]
+//              [--pos positives.txt] [--neg negatives.txt] [--out svm_lbp.yml]
+//              [--cache lbp_features.bin] [--no-cache]
+//              [--C 1] [--gamma 1] [--auto] [--kfold 5] [--seed 12345] [-j N]
+//----------------------------------------------------------
+int main(int argc, char *argv[]) {
+    LBPConfig config;
+    string positivesPath = "positives.txt";
+    string negativesPath = "negatives.txt";
+    string modelPath = "svm_lbp.yml";   // svm_limit.yml es el modelo que se distribuye: solo se reemplaza con --out
+    string cachePath = "lbp_features.bin";
+    bool useCache = true;
+    bool autoParams = false;
+    int kFold = 5;
+    int seed = 12345;
+    double C = 1.0, gamma = 1.0;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--auto") autoParams = true;
+        else if(arg == "--no-cache") useCache = false;
+        else if(!hasValue) break;
+        else if(arg == "--variant") {
+            if(!parseLBPVariant(argv[++i], config.variant)) {
+                cerr << "Variante desconocida: " << argv[i] << " (full, uniform, riu2)" << endl;
+                return -1;
+            }
+        } else if(arg == "--grid") {
+            if(sscanf(argv[++i], "%dx%d", &config.gridX, &config.gridY) != 2 || config.gridX < 1 || config.gridY < 1) {
+                cerr << "Rejilla no válida: " << argv[i] << " (ejemplo: 4x4)" << endl;
+                return -1;
+            }
+        } else if(arg == "--roi") config.roiSize = atoi(argv[++i]);
+        else if(arg == "--pos") positivesPath = argv[++i];
+        else if(arg == "--neg") negativesPath = argv[++i];
+        else if(arg == "--out") modelPath = argv[++i];
+        else if(arg == "--cache") cachePath = argv[++i];
+        else if(arg == "--C") C = atof(argv[++i]);
+        else if(arg == "--gamma") gamma = atof(argv[++i]);
+        else if(arg == "--kfold") kFold = atoi(argv[++i]);
+        else if(arg == "--seed") seed = atoi(argv[++i]);
+    }
+    if(config.roiSize < 3) {
+        cerr << "Tamaño de ROI no válido: " << config.roiSize << endl;
+        return -1;
+    }
+    unsigned jobs = parseJobsArg(argc, argv);
+
+    vector<Sample> samples;
+    if(!readPositives(positivesPath, samples) || !readNegatives(negativesPath, samples)) {
+        return -1;
+    }
+    cout << "Muestras: " << samples.size() << " | LBP " << lbpVariantName(config.variant) << ", rejilla "
+         << config.gridX << "x" << config.gridY << ", ROI " << config.roiSize << "x" << config.roiSize
+         << " -> " << config.featureSize() << " características" << endl;
+
+    uint64_t listsHash = hashFileContents(negativesPath, hashFileContents(positivesPath, 14695981039346656037ULL));
+
+    Mat data;
+    vector<int> labels;
+    int64 t = getTickCount();
+    if(useCache && loadFeatureCache(cachePath, listsHash, config, data, labels)) {
+        cout << "Características leídas de la caché " << cachePath << " (" << data.rows << " muestras)" << endl;
+    } else {
+        extractFeatures(samples, config, jobs, data, labels);
+        cout << "Características extraídas con " << jobs << " hilo(s) en "
+             << (getTickCount() - t) / getTickFrequency() << " s" << endl;
+        if(useCache && data.rows > 0 && saveFeatureCache(cachePath, listsHash, config, data, labels)) {
+            cout << "Caché guardada en " << cachePath << endl;
+        }
+    }
+    if(data.rows == 0) {
+        cerr << "No hay muestras para entrenar." << endl;
+        return -1;
+    }
+
+    // Mismos parámetros que el modelo original (C_SVC, RBF, C = 1, gamma = 1)
+    Ptr<SVM> svm = SVM::create();
+    svm->setType(SVM::C_SVC);
+    svm->setKernel(SVM::RBF);
+    svm->setC(C);
+    svm->setGamma(gamma);
+    svm->setTermCriteria(TermCriteria(TermCriteria::MAX_ITER, 100, 1e-6));
+
+    // Semilla fija: el reparto de los pliegues de la validación cruzada es reproducible
+    setRNGSeed(seed);
+    setNumThreads((int)jobs);
+
+    t = getTickCount();
+    if(autoParams) {
+        cout << "Buscando C y gamma con validación cruzada de " << kFold << " pliegues (" << data.rows
+             << " muestras)..." << endl;
+        Ptr<TrainData> trainData = TrainData::create(data, ROW_SAMPLE, Mat(labels, true));
+        svm->trainAuto(trainData, kFold,
+                       SVM::getDefaultGrid(SVM::C), SVM::getDefaultGrid(SVM::GAMMA),
+                       SVM::getDefaultGrid(SVM::P), SVM::getDefaultGrid(SVM::NU),
+                       SVM::getDefaultGrid(SVM::COEF), SVM::getDefaultGrid(SVM::DEGREE), true);
+        cout << "Mejores parámetros: C = " << svm->getC() << ", gamma = " << svm->getGamma() << endl;
+    } else {
+        cout << "Entrenando con " << data.rows << " muestras (C = " << C << ", gamma = " << gamma << ")..." << endl;
+        svm->train(data, ROW_SAMPLE, Mat(labels, true));
+    }
+    cout << "Entrenamiento: " << (getTickCount() - t) / getTickFrequency() << " s" << endl;
+
+    svm->save(modelPath);
+    if(!saveLBPConfig(lbpConfigPathFor(modelPath), config)) {
+        return -1;
+    }
+    cout << "Modelo guardado en " << modelPath << " (" << svm->getSupportVectors().rows
+         << " vectores de soporte) y configuración en " << lbpConfigPathFor(modelPath) << endl;
+    return 0;
+}